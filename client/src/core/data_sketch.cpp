@@ -0,0 +1,177 @@
+#include "data_sketch.hpp"
+
+namespace {
+const quint8 formatVersion = 1;
+// Values closer to zero than this all end up in the zero bucket.
+const double minIndexableValue = 1e-9;
+const double growth
+    = (1 + DataSketch::relativeAccuracy) / (1 - DataSketch::relativeAccuracy);
+const double logGrowth = std::log(growth);
+
+// Bucket i holds the values in (growth^(i - 1), growth^i].
+int bucketIndex(double value)
+{
+    return static_cast<int>(std::ceil(std::log(value) / logGrowth));
+}
+
+// The value with the same relative distance to both ends of bucket i.
+double bucketRepresentative(int index)
+{
+    return 2 * std::pow(growth, index) / (growth + 1);
+}
+}
+
+DataSketch::DataSketch()
+    : totalCount(0)
+    , exact(true)
+    , zeroCount(0)
+{
+}
+
+void DataSketch::add(const QString& value)
+{
+    totalCount++;
+    if (exact) {
+        exactCounts[value]++;
+        if (exactCounts.size() > maxExactValues)
+            foldExactCounts();
+        return;
+    }
+
+    bool ok = false;
+    const auto number = value.toDouble(&ok);
+    if (ok)
+        addNumeric(number, 1);
+}
+
+void DataSketch::merge(const DataSketch& other)
+{
+    totalCount += other.totalCount;
+    if (exact && other.exact) {
+        for (auto it = other.exactCounts.begin(); it != other.exactCounts.end();
+             ++it)
+            exactCounts[it.key()] += it.value();
+        if (exactCounts.size() > maxExactValues)
+            foldExactCounts();
+        return;
+    }
+
+    if (exact)
+        foldExactCounts();
+    auto folded = other;
+    if (folded.exact)
+        folded.foldExactCounts();
+
+    zeroCount += folded.zeroCount;
+    for (auto it = folded.positiveBuckets.begin();
+         it != folded.positiveBuckets.end(); ++it)
+        positiveBuckets[it.key()] += it.value();
+    for (auto it = folded.negativeBuckets.begin();
+         it != folded.negativeBuckets.end(); ++it)
+        negativeBuckets[it.key()] += it.value();
+    collapse(positiveBuckets);
+    collapse(negativeBuckets);
+}
+
+qint64 DataSketch::count() const { return totalCount; }
+
+bool DataSketch::isExact() const { return exact; }
+
+std::optional<QMap<QString, int>> DataSketch::countCohorts(
+    const Query& query) const
+{
+    if (totalCount == 0 || (!exact && query.discrete))
+        return std::nullopt;
+
+    QMap<QString, int> cohortData;
+    for (const auto& cohort : query.cohorts)
+        cohortData[cohort] = 0;
+
+    if (exact) {
+        for (auto it = exactCounts.begin(); it != exactCounts.end(); ++it)
+            for (const auto& cohort : query.matchingCohorts(it.key()))
+                cohortData[cohort] += static_cast<int>(it.value());
+        return cohortData;
+    }
+
+    for (const auto& [value, count] : representatives()) {
+        const auto formatted = QString::number(value, 'g', 17);
+        for (const auto& cohort : query.matchingCohorts(formatted))
+            cohortData[cohort] += static_cast<int>(count);
+    }
+    return cohortData;
+}
+
+QByteArray DataSketch::toByteArray() const
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << formatVersion << totalCount << exact << exactCounts << zeroCount
+           << positiveBuckets << negativeBuckets;
+    return data;
+}
+
+Result<DataSketch> DataSketch::fromByteArray(const QByteArray& data)
+{
+    QDataStream stream(data);
+    quint8 version = 0;
+    stream >> version;
+    if (version != formatVersion)
+        return Result<DataSketch>::Failure(
+            QString("Unsupported sketch version %1").arg(version));
+
+    DataSketch sketch;
+    stream >> sketch.totalCount >> sketch.exact >> sketch.exactCounts
+        >> sketch.zeroCount >> sketch.positiveBuckets >> sketch.negativeBuckets;
+    if (stream.status() != QDataStream::Ok)
+        return Result<DataSketch>::Failure("Truncated sketch");
+    return Result(sketch);
+}
+
+void DataSketch::foldExactCounts()
+{
+    exact = false;
+    for (auto it = exactCounts.begin(); it != exactCounts.end(); ++it) {
+        bool ok = false;
+        const auto number = it.key().toDouble(&ok);
+        if (ok)
+            addNumeric(number, it.value());
+    }
+    exactCounts.clear();
+}
+
+void DataSketch::addNumeric(double value, qint64 count)
+{
+    if (!std::isfinite(value))
+        return;
+    if (std::abs(value) < minIndexableValue) {
+        zeroCount += count;
+        return;
+    }
+
+    auto& buckets = value > 0 ? positiveBuckets : negativeBuckets;
+    buckets[bucketIndex(std::abs(value))] += count;
+    collapse(buckets);
+}
+
+void DataSketch::collapse(QMap<int, qint64>& buckets)
+{
+    // Merge the buckets closest to zero, they cover the smallest ranges.
+    while (buckets.size() > maxBuckets) {
+        const auto count = buckets.first();
+        buckets.erase(buckets.begin());
+        buckets.first() += count;
+    }
+}
+
+QList<QPair<double, qint64>> DataSketch::representatives() const
+{
+    QList<QPair<double, qint64>> values;
+    if (zeroCount > 0)
+        values.append({ 0, zeroCount });
+    for (auto it = positiveBuckets.begin(); it != positiveBuckets.end(); ++it)
+        values.append({ bucketRepresentative(it.key()), it.value() });
+    for (auto it = negativeBuckets.begin(); it != negativeBuckets.end(); ++it)
+        values.append({ -bucketRepresentative(it.key()), it.value() });
+    return values;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QtCore>
+
+#include "result.hpp"
+#include "survey.hpp"
+
+/**
+ * A fixed-size summary of all values submitted for a data key, kept instead
+ * of the raw data points for high-volume keys.
+ *
+ * As long as a key has at most maxExactValues distinct values, they are
+ * counted exactly and every query is answered exactly. Beyond that, numeric
+ * values are kept in a mergeable quantile sketch with logarithmic buckets of
+ * relative accuracy relativeAccuracy (a DDSketch). Interval and histogram
+ * cohorts are then counted from the bucket representatives, so a value v may
+ * be counted as any value within v * relativeAccuracy of it: only values that
+ * close to a cohort bound can end up in a neighbouring cohort. If a sign has
+ * more than maxBuckets buckets, the ones closest to zero are collapsed, so
+ * very small values may be counted as larger ones. Discrete queries and
+ * non-numeric values can't be answered from the quantile sketch.
+ */
+class DataSketch {
+public:
+    static constexpr int maxExactValues = 64;
+    static constexpr int maxBuckets = 2048;
+    static constexpr double relativeAccuracy = 0.01;
+
+    DataSketch();
+
+    void add(const QString& value);
+    void merge(const DataSketch& other);
+
+    qint64 count() const;
+    bool isExact() const;
+
+    /**
+     * Counts the values in each cohort of query. Returns no value if there
+     * are no values at all, or if the query is discrete and the values are no
+     * longer counted exactly.
+     */
+    std::optional<QMap<QString, int>> countCohorts(const Query& query) const;
+
+    QByteArray toByteArray() const;
+    static Result<DataSketch> fromByteArray(const QByteArray& data);
+
+private:
+    qint64 totalCount;
+    bool exact;
+    QHash<QString, qint64> exactCounts;
+    qint64 zeroCount;
+    // By bucket index, for the absolute value of positive and negative values.
+    QMap<int, qint64> positiveBuckets;
+    QMap<int, qint64> negativeBuckets;
+
+    void foldExactCounts();
+    void addNumeric(double value, qint64 count);
+    void collapse(QMap<int, qint64>& buckets);
+    QList<QPair<double, qint64>> representatives() const;
+};
@@ -0,0 +1,86 @@
+#include "histogram.hpp"
+
+namespace {
+// Beyond this, doubles can't represent every integer.
+const double maxExactInteger = 9007199254740992.0;
+
+// Formats bounds the same way as the server, to agree on the cohort names:
+// integers up to 2^53 without decimals, anything else like Python's repr(),
+// with the shortest digits that round-trip, in scientific notation if the
+// exponent is below -4 or above 15.
+QString formatBound(double bound)
+{
+    if (std::floor(bound) == bound && std::abs(bound) <= maxExactInteger)
+        return QString::number(static_cast<qint64>(bound));
+    if (!std::isfinite(bound))
+        return QString::number(bound);
+
+    const auto scientific
+        = QString::number(bound, 'e', QLocale::FloatingPointShortest);
+    const auto separator = scientific.indexOf('e');
+    auto mantissa = scientific.left(separator);
+    const auto exponent = scientific.mid(separator + 1).toInt();
+    if (exponent < -4 || exponent > 15) {
+        return QString("%1e%2%3")
+            .arg(mantissa, exponent < 0 ? "-" : "+")
+            .arg(std::abs(exponent), 2, 10, QChar('0'));
+    }
+
+    const auto sign = mantissa.startsWith('-') ? QString("-") : QString();
+    const auto digits = mantissa.remove('-').remove('.');
+    if (exponent < 0)
+        return sign + "0." + QString(-exponent - 1, '0') + digits;
+    if (digits.size() <= exponent + 1)
+        return sign + digits + QString(exponent + 1 - digits.size(), '0')
+            + ".0";
+    return sign + digits.left(exponent + 1) + "." + digits.mid(exponent + 1);
+}
+}
+
+Histogram::Histogram(double start, double width, int bucketCount)
+    : start(start)
+    , width(width)
+    , bucketCount(bucketCount)
+    , inverseWidth(1 / width)
+{
+    if (!std::isfinite(start) || !std::isfinite(width) || width <= 0)
+        throw std::invalid_argument("Invalid histogram bounds");
+    if (bucketCount <= 0)
+        throw std::invalid_argument("Histogram needs at least one bucket");
+    if (bucketCount > maxBucketCount)
+        throw std::invalid_argument("Histogram has too many buckets");
+}
+
+int Histogram::bucketOf(double value) const
+{
+    if (value < start)
+        return -1;
+    const auto index = std::floor((value - start) * inverseWidth);
+    // Also catches NaN, which doesn't compare less than anything.
+    if (!(index < bucketCount))
+        return bucketCount;
+    return static_cast<int>(index);
+}
+
+QList<QString> Histogram::getCohorts() const
+{
+    QList<QString> cohorts;
+    cohorts.reserve(bucketCount + 2);
+    cohorts.append(QString("(-inf, %1)").arg(formatBound(start)));
+    for (int i = 0; i < bucketCount; i++) {
+        cohorts.append(QString("[%1, %2)")
+                           .arg(formatBound(start + i * width),
+                               formatBound(start + (i + 1) * width)));
+    }
+    cohorts.append(
+        QString("[%1, inf)").arg(formatBound(start + bucketCount * width)));
+    return cohorts;
+}
+
+double Histogram::getStart() const { return start; }
+
+double Histogram::getWidth() const { return width; }
+
+int Histogram::getBucketCount() const { return bucketCount; }
+
+double Histogram::getInverseWidth() const { return inverseWidth; }
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <QtCore>
+
+/**
+ * A compact cohort specification: bucketCount buckets of equal width starting
+ * at start, plus an underflow bucket below start and an overflow bucket above
+ * the last one.
+ */
+class Histogram {
+public:
+    // Each bucket is a cohort, so this bounds the work of every survey. Kept
+    // in sync with MAX_BUCKET_COUNT on the server.
+    static constexpr int maxBucketCount = 1000;
+
+    Histogram(double start, double width, int bucketCount);
+
+    /**
+     * Returns the index of the bucket containing value: -1 for the underflow
+     * bucket, and bucketCount for the overflow bucket.
+     */
+    int bucketOf(double value) const;
+
+    /**
+     * Returns one interval cohort per bucket, starting with the underflow and
+     * ending with the overflow bucket.
+     */
+    QList<QString> getCohorts() const;
+
+    double getStart() const;
+    double getWidth() const;
+    int getBucketCount() const;
+    double getInverseWidth() const;
+
+private:
+    double start;
+    double width;
+    int bucketCount;
+    double inverseWidth;
+};
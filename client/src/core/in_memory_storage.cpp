@@ -0,0 +1,574 @@
+#include "in_memory_storage.hpp"
+
+#include "survey_response.hpp"
+
+namespace {
+// Version 1 had no delegate messages yet, version 2 had the messages instead
+// of their aggregate.
+const quint8 snapshotFormatVersion = 3;
+
+SurveyRecord withResponse(const SurveyRecord& record, bool hasResponse)
+{
+    return SurveyRecord(record.survey, record.clientId, record.publicKey,
+        record.delegatePublicKey, record.aggregationPublicKey, record.groupSize,
+        hasResponse);
+}
+
+QMap<QString, int> countValues(
+    const Query& query, const QHash<QString, int>& valueCounts)
+{
+    QMap<QString, int> cohortData;
+    for (const auto& cohort : query.cohorts)
+        cohortData[cohort] = 0;
+    for (auto it = valueCounts.constBegin(); it != valueCounts.constEnd(); ++it)
+        for (const auto& cohort : query.matchingCohorts(it.key()))
+            cohortData[cohort] += it.value();
+    return cohortData;
+}
+
+template <typename T>
+void writeOptional(QDataStream& stream, const std::optional<T>& optional)
+{
+    stream << optional.has_value();
+    if (optional.has_value())
+        stream << optional.value();
+}
+
+template <typename T> std::optional<T> readOptional(QDataStream& stream)
+{
+    bool hasValue = false;
+    stream >> hasValue;
+    if (!hasValue)
+        return std::nullopt;
+    T value;
+    stream >> value;
+    return value;
+}
+}
+
+InMemoryStorage::InMemoryStorage()
+    : InMemoryStorage(QString(), std::chrono::milliseconds::zero())
+{
+}
+
+InMemoryStorage::InMemoryStorage(
+    const QString& snapshotPath, std::chrono::milliseconds snapshotInterval)
+    : snapshotPath(snapshotPath)
+{
+    if (snapshotPath.isEmpty())
+        return;
+
+    loadSnapshot();
+    if (snapshotInterval > std::chrono::milliseconds::zero()) {
+        snapshotThread.reset(QThread::create(
+            [this, snapshotInterval]() { runSnapshots(snapshotInterval); }));
+        snapshotThread->start();
+    }
+}
+
+InMemoryStorage::~InMemoryStorage()
+{
+    if (snapshotThread) {
+        {
+            QMutexLocker locker(&snapshotMutex);
+            stopping = true;
+            snapshotCondition.wakeAll();
+        }
+        snapshotThread->wait();
+    }
+    if (const auto result = saveSnapshot(); !result.isSuccess())
+        qDebug() << "Error: Unable to save snapshot:"
+                 << result.getErrorMessage();
+}
+
+QList<DataPoint> InMemoryStorage::listDataPoints(const QString& key) const
+{
+    QList<DataPoint> dataPoints;
+    forEachDataPoint(key, [&dataPoints](const DataPoint& dataPoint) {
+        dataPoints.push_back(dataPoint);
+        return true;
+    });
+    return dataPoints;
+}
+
+void InMemoryStorage::forEachDataPoint(const QString& key,
+    const std::function<bool(const DataPoint&)>& callback) const
+{
+    // A shallow copy, so the callback may use the storage itself.
+    QHash<QString, QList<DataPoint>> dataPoints;
+    {
+        QMutexLocker locker(&mutex);
+        dataPoints = state.dataPoints;
+    }
+
+    const auto visit = [&callback](const QList<DataPoint>& list) {
+        for (const auto& dataPoint : list)
+            if (!callback(dataPoint))
+                return false;
+        return true;
+    };
+    if (!key.isEmpty()) {
+        visit(dataPoints.value(key));
+        return;
+    }
+    for (const auto& list : dataPoints)
+        if (!visit(list))
+            return;
+}
+
+void InMemoryStorage::addDataPoint(const QString& key, const QString& value)
+{
+    addDataPoints({ { .key = key,
+        .value = value,
+        .createdAt = QDateTime::currentDateTimeUtc() } });
+}
+
+bool InMemoryStorage::addDataPoints(const QList<DataPoint>& dataPoints)
+{
+    QMutexLocker locker(&mutex);
+    for (const auto& dataPoint : dataPoints)
+        addToState(dataPoint);
+    return true;
+}
+
+std::optional<DataPoint> InMemoryStorage::findLatestDataPoint(
+    const QString& key) const
+{
+    QMutexLocker locker(&mutex);
+    const auto latest = state.latestDataPoints.constFind(key);
+    if (latest == state.latestDataPoints.constEnd())
+        return std::nullopt;
+    return latest.value();
+}
+
+bool InMemoryStorage::checkIfDataPointPresent(const QString& key) const
+{
+    QMutexLocker locker(&mutex);
+    return state.latestDataPoints.contains(key);
+}
+
+bool InMemoryStorage::enableSketch(const QString& key)
+{
+    QMutexLocker locker(&mutex);
+    if (state.sketches.contains(key))
+        return true;
+
+    DataSketch sketch;
+    for (const auto& dataPoint : state.dataPoints.take(key))
+        sketch.add(dataPoint.value);
+    state.valueCounts.remove(key);
+    state.sketches.insert(key, sketch);
+    changeCount++;
+    return true;
+}
+
+QHash<QString, QMap<QString, int>> InMemoryStorage::countCohorts(
+    const QString& key, const QList<QSharedPointer<Query>>& queries) const
+{
+    QMutexLocker locker(&mutex);
+    const auto latest = state.latestDataPoints.constFind(key);
+    if (latest == state.latestDataPoints.constEnd())
+        return {};
+    const auto latestValue = latest->value;
+    std::optional<DataSketch> sketch;
+    if (const auto it = state.sketches.constFind(key);
+        it != state.sketches.constEnd())
+        sketch = it.value();
+    const auto valueCounts = state.valueCounts.value(key);
+    locker.unlock();
+
+    QHash<QString, QMap<QString, int>> cohortCounts;
+    for (const auto& query : queries) {
+        if (query->latest)
+            cohortCounts[query->id]
+                = countValues(*query, { { latestValue, 1 } });
+        else if (!sketch.has_value())
+            cohortCounts[query->id] = countValues(*query, valueCounts);
+        // Queries the sketch can't answer are left out.
+        else if (const auto cohortData = sketch->countCohorts(*query))
+            cohortCounts[query->id] = cohortData.value();
+    }
+    return cohortCounts;
+}
+
+QList<SurveyResponseRecord> InMemoryStorage::listSurveyResponses() const
+{
+    QList<SurveyResponseRecord> responses;
+    forEachSurveyResponse([&responses](const SurveyResponseRecord& response) {
+        responses.push_back(response);
+        return true;
+    });
+    return responses;
+}
+
+void InMemoryStorage::forEachSurveyResponse(
+    const std::function<bool(const SurveyResponseRecord&)>& callback) const
+{
+    QList<StoredResponse> responses;
+    {
+        QMutexLocker locker(&mutex);
+        responses = state.responses;
+    }
+    for (const auto& stored : responses)
+        if (!callback(toResponseRecord(stored)))
+            return;
+}
+
+void InMemoryStorage::addSurveyResponse(
+    const SurveyResponse& response, const Survey& survey)
+{
+    QMutexLocker locker(&mutex);
+    state.responses.append(
+        { .response = QSharedPointer<SurveyResponse>::create(response),
+            .surveyId = survey.id,
+            .createdAt = QDateTime::currentDateTimeUtc() });
+    changeCount++;
+    if (const auto record = state.surveyRecords.value(survey.id))
+        replaceSurveyRecord(withResponse(*record, true));
+}
+
+std::optional<SurveyResponseRecord> InMemoryStorage::findSurveyResponseFor(
+    const QString& surveyId) const
+{
+    QMutexLocker locker(&mutex);
+    for (const auto& stored : state.responses)
+        if (stored.surveyId == surveyId)
+            return toResponseRecord(stored);
+    return std::nullopt;
+}
+
+QList<SurveyRecord> InMemoryStorage::listSurveyRecords() const
+{
+    QMutexLocker locker(&mutex);
+    QList<SurveyRecord> records;
+    records.reserve(state.surveyRecords.count());
+    for (const auto& record : state.surveyRecords)
+        records.append(*record);
+    return records;
+}
+
+QList<SurveyRecord> InMemoryStorage::listSurveyRecords(
+    const SurveyState& surveyState) const
+{
+    QMutexLocker locker(&mutex);
+    QList<SurveyRecord> records;
+    for (const auto& record : state.surveyRecords)
+        if (record->getState() == surveyState)
+            records.append(*record);
+    return records;
+}
+
+void InMemoryStorage::addSurveyRecord(const Survey& survey,
+    const QString& clientId, const QString& publicKey,
+    const QString& delegatePublicKey,
+    const std::optional<QString>& aggregationPublicKey,
+    const std::optional<int>& groupSize)
+{
+    QMutexLocker locker(&mutex);
+    const auto hasResponse = std::any_of(state.responses.begin(),
+        state.responses.end(),
+        [&survey](const auto& stored) { return stored.surveyId == survey.id; });
+    replaceSurveyRecord(SurveyRecord(QSharedPointer<Survey>::create(survey),
+        clientId, publicKey, delegatePublicKey, aggregationPublicKey, groupSize,
+        hasResponse));
+}
+
+void InMemoryStorage::saveSurveyRecord(const SurveyRecord& record)
+{
+    QMutexLocker locker(&mutex);
+    const auto storedRecord = state.surveyRecords.value(record.survey->id);
+    if (storedRecord.isNull())
+        return;
+    // Whether there's a response isn't up to the caller.
+    replaceSurveyRecord(
+        withResponse(record, storedRecord->getState() == Done));
+}
+
+QSharedPointer<SurveyRecord> InMemoryStorage::findSurveyRecordById(
+    const QString& surveyId) const
+{
+    QMutexLocker locker(&mutex);
+    const auto record = state.surveyRecords.value(surveyId);
+    if (record.isNull())
+        return nullptr;
+    // A copy, so callers can't change the stored record.
+    return QSharedPointer<SurveyRecord>::create(*record);
+}
+
+DelegateAggregation InMemoryStorage::findDelegateAggregation(
+    const QString& surveyId) const
+{
+    QMutexLocker locker(&mutex);
+    return state.delegateAggregations.value(surveyId).aggregation;
+}
+
+bool InMemoryStorage::checkIfDelegateMessageFolded(
+    const QString& surveyId, const QByteArray& digest) const
+{
+    QMutexLocker locker(&mutex);
+    const auto stored = state.delegateAggregations.constFind(surveyId);
+    return stored != state.delegateAggregations.constEnd()
+        && stored->digests.contains(digest);
+}
+
+void InMemoryStorage::foldDelegateMessages(const QString& surveyId,
+    const QList<QByteArray>& digests, const QByteArray& aggregate,
+    qint64 position)
+{
+    QMutexLocker locker(&mutex);
+    auto& stored = state.delegateAggregations[surveyId];
+    for (const auto& digest : digests)
+        stored.digests.insert(digest);
+    stored.aggregation = { .position = position,
+        .count = int(stored.digests.count()),
+        .aggregate = aggregate };
+    changeCount++;
+}
+
+void InMemoryStorage::removeDelegateAggregation(const QString& surveyId)
+{
+    QMutexLocker locker(&mutex);
+    if (state.delegateAggregations.remove(surveyId))
+        changeCount++;
+}
+
+void InMemoryStorage::transaction()
+{
+    // Released by the matching commit or rollback.
+    mutex.lock();
+    savepoints.append(state);
+}
+
+void InMemoryStorage::commit()
+{
+    savepoints.removeLast();
+    mutex.unlock();
+}
+
+void InMemoryStorage::rollback()
+{
+    state = savepoints.takeLast();
+    changeCount++;
+    mutex.unlock();
+}
+
+Result<void> InMemoryStorage::saveSnapshot()
+{
+    if (snapshotPath.isEmpty())
+        return Result<void>();
+
+    State snapshot;
+    quint64 snapshotChanges = 0;
+    {
+        QMutexLocker locker(&mutex);
+        snapshot = state;
+        snapshotChanges = changeCount;
+    }
+
+    // Not holding the state while writing, so a newer snapshot may have been
+    // written in the meantime.
+    QMutexLocker locker(&snapshotMutex);
+    if (snapshotChanges <= snapshotChangeCount)
+        return Result<void>();
+
+    QSaveFile file(snapshotPath);
+    if (!file.open(QIODevice::WriteOnly))
+        return Result<void>::Failure(file.errorString());
+    QDataStream stream(&file);
+    stream << snapshotFormatVersion;
+
+    qint64 dataPointCount = 0;
+    for (const auto& list : snapshot.dataPoints)
+        dataPointCount += list.count();
+    stream << dataPointCount;
+    for (const auto& list : snapshot.dataPoints)
+        for (const auto& dataPoint : list)
+            stream << dataPoint.key << dataPoint.value << dataPoint.createdAt;
+
+    stream << qint64(snapshot.latestDataPoints.count());
+    for (const auto& dataPoint : snapshot.latestDataPoints)
+        stream << dataPoint.key << dataPoint.value << dataPoint.createdAt;
+
+    QHash<QString, QByteArray> sketches;
+    for (auto it = snapshot.sketches.constBegin();
+         it != snapshot.sketches.constEnd(); ++it)
+        sketches.insert(it.key(), it->toByteArray());
+    stream << sketches;
+
+    stream << qint64(snapshot.surveyRecords.count());
+    for (const auto& record : snapshot.surveyRecords) {
+        stream << record->survey->toCbor() << record->clientId
+               << record->publicKey << record->delegatePublicKey;
+        writeOptional(stream, record->aggregationPublicKey);
+        writeOptional(stream, record->groupSize);
+    }
+
+    stream << qint64(snapshot.responses.count());
+    for (const auto& stored : snapshot.responses)
+        stream << stored.surveyId << stored.response->toCbor()
+               << stored.createdAt;
+
+    stream << qint64(snapshot.delegateAggregations.count());
+    for (auto it = snapshot.delegateAggregations.constBegin();
+         it != snapshot.delegateAggregations.constEnd(); ++it)
+        stream << it.key() << it->aggregation.position
+               << it->aggregation.aggregate << it->digests;
+
+    if (stream.status() != QDataStream::Ok || !file.commit())
+        return Result<void>::Failure(file.errorString());
+    snapshotChangeCount = snapshotChanges;
+    return Result<void>();
+}
+
+void InMemoryStorage::addToState(const DataPoint& dataPoint)
+{
+    state.latestDataPoints.insert(dataPoint.key, dataPoint);
+    if (const auto sketch = state.sketches.find(dataPoint.key);
+        sketch != state.sketches.end())
+        sketch->add(dataPoint.value);
+    else {
+        state.dataPoints[dataPoint.key].append(dataPoint);
+        state.valueCounts[dataPoint.key][dataPoint.value]++;
+    }
+    changeCount++;
+}
+
+void InMemoryStorage::replaceSurveyRecord(const SurveyRecord& record)
+{
+    state.surveyRecords.insert(
+        record.survey->id, QSharedPointer<const SurveyRecord>::create(record));
+    changeCount++;
+}
+
+SurveyResponseRecord InMemoryStorage::toResponseRecord(
+    const StoredResponse& stored) const
+{
+    return { .response = stored.response,
+        .surveyRecord = findSurveyRecordById(stored.surveyId),
+        .createdAt = stored.createdAt };
+}
+
+void InMemoryStorage::loadSnapshot()
+{
+    QFile file(snapshotPath);
+    if (!file.exists())
+        return;
+    // TODO: Exception instead of return code.
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug() << "Error: Unable to open snapshot" << file.errorString();
+        return;
+    }
+
+    QDataStream stream(&file);
+    quint8 version = 0;
+    stream >> version;
+    if (version < 1 || version > snapshotFormatVersion) {
+        qDebug() << "Error: Unsupported snapshot version" << version;
+        return;
+    }
+
+    qint64 count = 0;
+    stream >> count;
+    for (qint64 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+        DataPoint dataPoint;
+        stream >> dataPoint.key >> dataPoint.value >> dataPoint.createdAt;
+        addToState(dataPoint);
+    }
+
+    // Sketched keys have no data points left to derive them from.
+    stream >> count;
+    for (qint64 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+        DataPoint dataPoint;
+        stream >> dataPoint.key >> dataPoint.value >> dataPoint.createdAt;
+        state.latestDataPoints.insert(dataPoint.key, dataPoint);
+    }
+
+    QHash<QString, QByteArray> sketches;
+    stream >> sketches;
+    for (auto it = sketches.constBegin(); it != sketches.constEnd(); ++it) {
+        const auto sketch = DataSketch::fromByteArray(it.value());
+        if (sketch.isSuccess())
+            state.sketches.insert(it.key(), sketch.getValue());
+    }
+
+    QList<SurveyRecord> records;
+    stream >> count;
+    for (qint64 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+        QByteArray surveyData;
+        QString clientId;
+        QString publicKey;
+        QString delegatePublicKey;
+        stream >> surveyData >> clientId >> publicKey >> delegatePublicKey;
+        const auto aggregationPublicKey = readOptional<QString>(stream);
+        const auto groupSize = readOptional<int>(stream);
+        const auto survey = Survey::fromCbor(surveyData);
+        if (survey.isSuccess())
+            records.append(SurveyRecord(survey.getValue(), clientId, publicKey,
+                delegatePublicKey, aggregationPublicKey, groupSize));
+    }
+
+    QSet<QString> respondedSurveyIds;
+    stream >> count;
+    for (qint64 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+        StoredResponse stored;
+        QByteArray responseData;
+        stream >> stored.surveyId >> responseData >> stored.createdAt;
+        const auto response = SurveyResponse::fromCbor(responseData);
+        if (!response.isSuccess())
+            continue;
+        stored.response = response.getValue();
+        state.responses.append(stored);
+        respondedSurveyIds.insert(stored.surveyId);
+    }
+
+    for (const auto& record : records)
+        replaceSurveyRecord(withResponse(
+            record, respondedSurveyIds.contains(record.survey->id)));
+
+    if (version == 2) {
+        // Only skipped, delegates fetch the messages again without a cursor.
+        stream >> count;
+        for (qint64 i = 0; i < count && stream.status() == QDataStream::Ok;
+             i++) {
+            QString surveyId;
+            qint64 position = 0;
+            QList<QByteArray> messages;
+            stream >> surveyId >> position >> messages;
+        }
+    } else if (version >= 3) {
+        stream >> count;
+        for (qint64 i = 0; i < count && stream.status() == QDataStream::Ok;
+             i++) {
+            QString surveyId;
+            StoredAggregation stored;
+            stream >> surveyId >> stored.aggregation.position
+                >> stored.aggregation.aggregate >> stored.digests;
+            stored.aggregation.count = stored.digests.count();
+            state.delegateAggregations.insert(surveyId, stored);
+        }
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        qDebug() << "Error: Truncated snapshot" << snapshotPath;
+        state = State();
+    }
+    // What was just read doesn't need to be written again.
+    snapshotChangeCount = changeCount;
+}
+
+void InMemoryStorage::runSnapshots(std::chrono::milliseconds interval)
+{
+    while (true) {
+        {
+            QMutexLocker locker(&snapshotMutex);
+            if (!stopping)
+                snapshotCondition.wait(&snapshotMutex,
+                    QDeadlineTimer(static_cast<qint64>(interval.count())));
+            if (stopping)
+                return;
+        }
+        if (const auto result = saveSnapshot(); !result.isSuccess())
+            qDebug() << "Error: Unable to save snapshot:"
+                     << result.getErrorMessage();
+    }
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "data_sketch.hpp"
+#include "storage.hpp"
+#include <QtCore>
+#include <atomic>
+#include <chrono>
+
+/**
+ * Keeps everything in memory, indexed by data key and survey ID, for clients
+ * that don't need to outlive their container, simulations and tests.
+ *
+ * With a snapshot path, the state is recovered from that file on construction
+ * and written back to it periodically, on saveSnapshot() and on destruction.
+ * Changes since the last snapshot are lost on a crash.
+ *
+ * Like SQLite, there's one writer at a time: a transaction holds the storage
+ * until it's committed or rolled back, and other threads wait for it.
+ */
+class InMemoryStorage : public Storage {
+public:
+    static constexpr std::chrono::milliseconds defaultSnapshotInterval {
+        60000
+    };
+
+    InMemoryStorage();
+    explicit InMemoryStorage(const QString& snapshotPath,
+        std::chrono::milliseconds snapshotInterval = defaultSnapshotInterval);
+    ~InMemoryStorage();
+
+    QList<DataPoint> listDataPoints(const QString& key = "") const;
+    void forEachDataPoint(const QString& key,
+        const std::function<bool(const DataPoint&)>& callback) const;
+    void addDataPoint(const QString& key, const QString& value);
+    bool addDataPoints(const QList<DataPoint>& dataPoints);
+    std::optional<DataPoint> findLatestDataPoint(const QString& key) const;
+    bool checkIfDataPointPresent(const QString& key) const;
+    bool enableSketch(const QString& key);
+    QHash<QString, QMap<QString, int>> countCohorts(const QString& key,
+        const QList<QSharedPointer<Query>>& queries) const;
+    QList<SurveyResponseRecord> listSurveyResponses() const;
+    void forEachSurveyResponse(
+        const std::function<bool(const SurveyResponseRecord&)>& callback) const;
+    void addSurveyResponse(
+        const SurveyResponse& response, const Survey& survey);
+    std::optional<SurveyResponseRecord> findSurveyResponseFor(
+        const QString& surveyId) const;
+    QList<SurveyRecord> listSurveyRecords() const;
+    QList<SurveyRecord> listSurveyRecords(const SurveyState& state) const;
+    void addSurveyRecord(const Survey& survey, const QString& clientId,
+        const QString& publicKey, const QString& delegatePublicKey,
+        const std::optional<QString>& aggregationPublicKey,
+        const std::optional<int>& groupSize);
+    void saveSurveyRecord(const SurveyRecord& record);
+    QSharedPointer<SurveyRecord> findSurveyRecordById(
+        const QString& surveyId) const;
+    DelegateAggregation findDelegateAggregation(const QString& surveyId) const;
+    bool checkIfDelegateMessageFolded(
+        const QString& surveyId, const QByteArray& digest) const;
+    void foldDelegateMessages(const QString& surveyId,
+        const QList<QByteArray>& digests, const QByteArray& aggregate,
+        qint64 position);
+    void removeDelegateAggregation(const QString& surveyId);
+    void transaction();
+    void commit();
+    void rollback();
+
+    /**
+     * Writes the state to the snapshot path, replacing the previous snapshot
+     * atomically. Waits for transactions of other threads to finish first.
+     * Does nothing without a snapshot path.
+     */
+    Result<void> saveSnapshot();
+
+private:
+    struct StoredResponse {
+        QSharedPointer<SurveyResponse> response;
+        QString surveyId;
+        QDateTime createdAt;
+    };
+
+    struct StoredAggregation {
+        DelegateAggregation aggregation;
+        // Digests of the folded messages.
+        QSet<QByteArray> digests;
+    };
+
+    // Only holds implicitly shared containers, so copying it for a
+    // transaction or a snapshot is cheap.
+    struct State {
+        // By key, in the order they were added.
+        QHash<QString, QList<DataPoint>> dataPoints;
+        // By key, then by value, so cohorts are counted per distinct value.
+        QHash<QString, QHash<QString, int>> valueCounts;
+        // By key, including the sketched ones.
+        QHash<QString, DataPoint> latestDataPoints;
+        QHash<QString, DataSketch> sketches;
+        // By survey ID. Replaced on changes, never changed in place.
+        QHash<QString, QSharedPointer<const SurveyRecord>> surveyRecords;
+        QList<StoredResponse> responses;
+        // By survey ID.
+        QHash<QString, StoredAggregation> delegateAggregations;
+    };
+
+    const QString snapshotPath;
+    mutable QRecursiveMutex mutex;
+    State state;
+    // States to return to on rollback, one per open transaction level. Only
+    // used by the thread holding the mutex.
+    QList<State> savepoints;
+    // Changes so far, to skip snapshots when nothing changed.
+    std::atomic<quint64> changeCount { 0 };
+    quint64 snapshotChangeCount = 0;
+
+    QMutex snapshotMutex;
+    QWaitCondition snapshotCondition;
+    bool stopping = false;
+    QScopedPointer<QThread> snapshotThread;
+
+    void addToState(const DataPoint& dataPoint);
+    void replaceSurveyRecord(const SurveyRecord& record);
+    SurveyResponseRecord toResponseRecord(const StoredResponse& stored) const;
+    void loadSnapshot();
+    void runSnapshots(std::chrono::milliseconds interval);
+};
@@ -48,3 +48,11 @@ bool Interval::isInInterval(const double& value)
     return (lowerInclusive ? value >= lowerBound : value > lowerBound)
         && (upperInclusive ? value <= upperBound : value < upperBound);
 }
+
+double Interval::getLowerBound() const { return lowerBound; }
+
+double Interval::getUpperBound() const { return upperBound; }
+
+bool Interval::isLowerInclusive() const { return lowerInclusive; }
+
+bool Interval::isUpperInclusive() const { return upperInclusive; }
@@ -8,6 +8,11 @@ public:
 
     bool isInInterval(const double& value);
 
+    double getLowerBound() const;
+    double getUpperBound() const;
+    bool isLowerInclusive() const;
+    bool isUpperInclusive() const;
+
 private:
     bool isValidInterval(const QString& interval);
 
@@ -0,0 +1,99 @@
+#include <QtSql>
+
+#include "sqlite_connection_pool.hpp"
+
+namespace {
+// Tells the connections of different pools apart.
+QAtomicInt poolCount;
+
+void configure(const QSqlDatabase& db)
+{
+    QSqlQuery query(db);
+    // Readers don't block the writer, and commits only sync the log instead
+    // of the whole database.
+    for (const auto& statement : { "PRAGMA journal_mode = WAL",
+             "PRAGMA synchronous = NORMAL",
+             // Wait for the connections of other threads to finish writing.
+             "PRAGMA busy_timeout = 5000" }) {
+        if (!query.exec(statement))
+            qDebug() << query.lastError();
+    }
+}
+}
+
+SqliteConnectionPool::SqliteConnectionPool(const QString& databasePath)
+    : databasePath(databasePath)
+    , namePrefix(QString("privact-%1").arg(poolCount.fetchAndAddRelaxed(1)))
+{
+    QFileInfo(databasePath).dir().mkpath(".");
+}
+
+SqliteConnectionPool::~SqliteConnectionPool()
+{
+    for (auto* thread : connections.keys())
+        removeConnection(thread);
+}
+
+QSqlDatabase SqliteConnectionPool::connection()
+{
+    return QSqlDatabase::database(threadConnection()->name, false);
+}
+
+QSqlQuery& SqliteConnectionPool::preparedQuery(const QString& statement)
+{
+    const auto connection = threadConnection();
+    // Only the calling thread uses its own queries, no need to lock.
+    auto query = connection->queries.value(statement);
+    if (query.isNull()) {
+        query = QSharedPointer<QSqlQuery>::create(
+            QSqlDatabase::database(connection->name, false));
+        query->prepare(statement);
+        connection->queries.insert(statement, query);
+    }
+    // Release the results of the previous use.
+    query->finish();
+    return *query;
+}
+
+QSharedPointer<SqliteConnectionPool::ThreadConnection>
+SqliteConnectionPool::threadConnection()
+{
+    auto* thread = QThread::currentThread();
+    QMutexLocker locker(&mutex);
+    if (const auto connection = connections.value(thread))
+        return connection;
+
+    auto connection = QSharedPointer<ThreadConnection>::create();
+    connection->name = QString("%1-%2").arg(namePrefix).arg(
+        reinterpret_cast<quintptr>(thread));
+    auto db = QSqlDatabase::addDatabase("QSQLITE", connection->name);
+    db.setDatabaseName(databasePath);
+    // TODO: Exception instead of return code.
+    if (!db.open())
+        qDebug() << "Error: Unable to open database";
+    configure(db);
+
+    // Emitted from the finishing thread, where the connection has to be
+    // closed anyway.
+    connection->finishedConnection
+        = QObject::connect(thread, &QThread::finished,
+            [this, thread]() { removeConnection(thread); });
+    connections.insert(thread, connection);
+    return connection;
+}
+
+void SqliteConnectionPool::removeConnection(QThread* thread)
+{
+    QSharedPointer<ThreadConnection> connection;
+    {
+        QMutexLocker locker(&mutex);
+        connection = connections.take(thread);
+    }
+    if (connection.isNull())
+        return;
+
+    QObject::disconnect(connection->finishedConnection);
+    connection->queries.clear();
+    QSqlDatabase::database(connection->name, false).close();
+    QSqlDatabase::removeDatabase(connection->name);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QtCore>
+
+/**
+ * Hands out one connection to the same SQLite database per thread, since Qt
+ * connections may only be used by the thread that opened them. All of them
+ * use WAL, so readers on any thread don't block the writer and vice versa.
+ *
+ * A thread's connection and its prepared statements are removed when the
+ * thread finishes, the remaining ones when the pool is destroyed.
+ */
+class SqliteConnectionPool {
+public:
+    explicit SqliteConnectionPool(const QString& databasePath);
+    ~SqliteConnectionPool();
+
+    /**
+     * Returns the calling thread's connection, opening it if needed.
+     */
+    QSqlDatabase connection();
+
+    /**
+     * Returns a query on the calling thread's connection with the statement
+     * prepared, reusing the one from previous calls with the same statement.
+     * The query stays valid until the thread finishes.
+     */
+    QSqlQuery& preparedQuery(const QString& statement);
+
+private:
+    struct ThreadConnection {
+        QString name;
+        // By SQL. Pointers, so references stay valid when more are added.
+        QHash<QString, QSharedPointer<QSqlQuery>> queries;
+        QMetaObject::Connection finishedConnection;
+    };
+
+    const QString databasePath;
+    const QString namePrefix;
+    QMutex mutex;
+    QHash<QThread*, QSharedPointer<ThreadConnection>> connections;
+
+    QSharedPointer<ThreadConnection> threadConnection();
+    void removeConnection(QThread* thread);
+};
@@ -1,5 +1,6 @@
 #include <QtSql>
 
+#include "core/interval.hpp"
 #include "core/storage.hpp"
 #include "core/survey.hpp"
 #include "survey_response.hpp"
@@ -9,17 +10,16 @@
 namespace {
 const QString userDir = ".privact";
 const QString dbFileName = "db.sqlite3";
-
-QSqlDatabase createDb(const QString& path)
-{
-    if (QSqlDatabase::connectionNames().count() > 0)
-        return QSqlDatabase::database();
-
-    QFileInfo(path).dir().mkpath(".");
-    auto db = QSqlDatabase::addDatabase("QSQLITE");
-    db.setDatabaseName(path);
-    return db;
-}
+// Rows per multi-row insert, below SQLite's limit of 999 bound values.
+const int insertBatchSize = 100;
+// Per cohort counting statement, below SQLite's default limits of 2000 result
+// columns and, before 3.32, 999 bound values.
+const int maxCohortColumns = 1000;
+const int maxCohortBoundValues = 999;
+// Rows per transaction when converting legacy JSON blobs in the background,
+// so writers on other threads never wait long.
+const int blobMigrationBatchSize = 50;
+const QString blobMigrationTask = "legacy_blob_migration";
 
 bool execQuery(QSqlQuery& query)
 {
@@ -30,36 +30,391 @@ bool execQuery(QSqlQuery& query)
     return result;
 }
 
-void migrate()
+// Each entry brings the schema from its index to the next version, which is
+// stored in user_version. Only ever append to this list. The first ones don't
+// fail on databases created before versioning.
+const QList<QList<QString>> migrations = {
+    {
+        "CREATE TABLE IF NOT EXISTS data_point("
+        "    id INTEGER PRIMARY KEY,"
+        "    key TEXT,"
+        "    value TEXT,"
+        "    created_at DATETIME"
+        ")",
+        "CREATE TABLE IF NOT EXISTS survey_response_record("
+        "    id INTEGER PRIMARY KEY,"
+        "    data TEXT,"
+        "    survey_id VARCHAR(255),"
+        "    created_at DATETIME"
+        ")",
+        "CREATE TABLE IF NOT EXISTS survey_record("
+        "    id VARCHAR(255) PRIMARY KEY,"
+        "    survey_id VARCHAR(255),"
+        "    survey_data TEXT,"
+        "    client_id VARCHAR(255),"
+        "    public_key TEXT,"
+        "    delegate_public_key VARCHAR(255),"
+        "    aggregation_public_key TEXT,"
+        "    group_size INT"
+        ")",
+    },
+    {
+        // Kept up to date by a trigger, so it's updated in the same statement
+        // as data_point itself.
+        "CREATE TABLE IF NOT EXISTS latest_data_point("
+        "    key TEXT PRIMARY KEY,"
+        "    value TEXT,"
+        "    created_at DATETIME"
+        ")",
+        "CREATE TRIGGER IF NOT EXISTS data_point_latest"
+        "    AFTER INSERT ON data_point"
+        "    BEGIN"
+        "        INSERT OR REPLACE INTO latest_data_point"
+        "            (key, value, created_at)"
+        "            VALUES (NEW.key, NEW.value, NEW.created_at);"
+        "    END",
+        "INSERT OR REPLACE INTO latest_data_point (key, value, created_at)"
+        "    SELECT key, value, created_at FROM data_point"
+        "    WHERE id IN (SELECT MAX(id) FROM data_point GROUP BY key)",
+        "CREATE TABLE IF NOT EXISTS data_sketch("
+        "    key TEXT PRIMARY KEY,"
+        "    data BLOB"
+        ")",
+    },
+    {
+        // Covers the value as well, so cohorts are counted from the index.
+        "CREATE INDEX IF NOT EXISTS data_point_key_value"
+        "    ON data_point (key, value)",
+        "CREATE INDEX IF NOT EXISTS survey_response_record_survey_id"
+        "    ON survey_response_record (survey_id)",
+        "CREATE INDEX IF NOT EXISTS survey_record_survey_id"
+        "    ON survey_record (survey_id)",
+    },
+    {
+        "CREATE TABLE IF NOT EXISTS delegate_message("
+        "    id INTEGER PRIMARY KEY,"
+        "    survey_id VARCHAR(255),"
+        "    data BLOB"
+        ")",
+        "CREATE INDEX IF NOT EXISTS delegate_message_survey_id"
+        "    ON delegate_message (survey_id)",
+        // Counted along, so polls don't have to count the messages.
+        "CREATE TABLE IF NOT EXISTS delegate_message_cursor("
+        "    survey_id VARCHAR(255) PRIMARY KEY,"
+        "    position INTEGER,"
+        "    count INTEGER"
+        ")",
+    },
+    {
+        // Delegates keep a partial aggregate instead of the messages. Without
+        // a cursor they fetch the dropped messages again.
+        "DROP TABLE IF EXISTS delegate_message",
+        "DROP TABLE IF EXISTS delegate_message_cursor",
+        "CREATE TABLE IF NOT EXISTS delegate_aggregation("
+        "    survey_id VARCHAR(255) PRIMARY KEY,"
+        "    position INTEGER,"
+        "    count INTEGER,"
+        "    aggregate BLOB"
+        ")",
+        "CREATE TABLE IF NOT EXISTS delegate_folded_message("
+        "    survey_id VARCHAR(255),"
+        "    digest BLOB,"
+        "    PRIMARY KEY (survey_id, digest)"
+        ")",
+    },
+    {
+        // One-off background tasks that finished, so they don't run again.
+        "CREATE TABLE IF NOT EXISTS completed_task("
+        "    name VARCHAR(255) PRIMARY KEY"
+        ")",
+    },
+};
+
+int schemaVersion(const QSqlDatabase& db)
 {
-    QSqlQuery query;
-    query.prepare("CREATE TABLE IF NOT EXISTS data_point("
-                  "    id INTEGER PRIMARY KEY,"
-                  "    key TEXT,"
-                  "    value TEXT,"
-                  "    created_at DATETIME"
-                  ")");
-    execQuery(query);
+    QSqlQuery query(db);
+    query.prepare("PRAGMA user_version");
+    if (!execQuery(query) || !query.next())
+        return 0;
+    return query.value(0).toInt();
+}
 
-    query.prepare("CREATE TABLE IF NOT EXISTS survey_response_record("
-                  "    id INTEGER PRIMARY KEY,"
-                  "    data TEXT,"
-                  "    survey_id VARCHAR(255),"
-                  "    created_at DATETIME"
-                  ")");
-    execQuery(query);
+void migrate(QSqlDatabase& db)
+{
+    for (auto version = schemaVersion(db); version < migrations.count();
+         version++) {
+        db.transaction();
+        QSqlQuery query(db);
+        for (const auto& statement : migrations[version]) {
+            query.prepare(statement);
+            if (!execQuery(query)) {
+                qDebug() << "Error: Unable to migrate database to version"
+                         << version + 1;
+                db.rollback();
+                return;
+            }
+        }
+        // PRAGMA doesn't support bound values.
+        query.prepare(QString("PRAGMA user_version = %1").arg(version + 1));
+        execQuery(query);
+        db.commit();
+    }
+}
 
-    query.prepare("CREATE TABLE IF NOT EXISTS survey_record("
-                  "    id VARCHAR(255) PRIMARY KEY,"
-                  "    survey_id VARCHAR(255),"
-                  "    survey_data TEXT,"
-                  "    client_id VARCHAR(255),"
-                  "    public_key TEXT,"
-                  "    delegate_public_key VARCHAR(255),"
-                  "    aggregation_public_key TEXT,"
-                  "    group_size INT"
-                  ")");
-    execQuery(query);
+QHash<QString, QMap<QString, int>> countDiscreteCohorts(const QSqlDatabase& db,
+    const QString& key, const QList<QSharedPointer<Query>>& queries)
+{
+    QSqlQuery sqlQuery(db);
+    sqlQuery.prepare(R"(
+        SELECT value, COUNT(*)
+        FROM data_point
+        WHERE key = :key
+        GROUP BY value
+    )");
+    sqlQuery.bindValue(":key", key);
+    if (!execQuery(sqlQuery))
+        return {};
+
+    QHash<QString, int> valueCounts;
+    while (sqlQuery.next())
+        valueCounts[sqlQuery.value(0).toString()] = sqlQuery.value(1).toInt();
+    if (valueCounts.isEmpty())
+        return {};
+
+    QHash<QString, QMap<QString, int>> cohortCounts;
+    for (const auto& query : queries) {
+        auto& cohortData = cohortCounts[query->id];
+        for (const auto& cohort : query->cohorts)
+            cohortData[cohort] = valueCounts.value(cohort, 0);
+    }
+    return cohortCounts;
+}
+
+// Builds a condition on the column `v` matching the interval, and appends the
+// bounds it references to boundValues.
+QString intervalCondition(const Interval& interval, QVariantList& boundValues)
+{
+    QStringList conditions;
+    if (!std::isinf(interval.getLowerBound())) {
+        conditions.append(interval.isLowerInclusive() ? "v >= ?" : "v > ?");
+        boundValues.append(interval.getLowerBound());
+    }
+    if (!std::isinf(interval.getUpperBound())) {
+        conditions.append(interval.isUpperInclusive() ? "v <= ?" : "v < ?");
+        boundValues.append(interval.getUpperBound());
+    }
+    if (conditions.isEmpty())
+        return "1";
+    return conditions.join(" AND ");
+}
+
+QString cohortCondition(
+    const Query& query, const QString& cohort, QVariantList& boundValues)
+{
+    if (query.discrete) {
+        boundValues.append(cohort);
+        return "value = ?";
+    }
+    try {
+        return intervalCondition(Interval(cohort), boundValues);
+    } catch (const std::invalid_argument&) {
+        return "0";
+    }
+}
+
+// A result column counting one cohort, see countCohortsInSinglePass.
+struct CohortColumn {
+    QString queryId;
+    QString cohort;
+    QString sql;
+    QVariantList boundValues;
+    // Index of the histogram whose bucket it compares, if any.
+    int histogram = -1;
+};
+
+// Runs one statement with the given columns over the key's data points.
+// Returns the count of each column, or nothing if there are no data points.
+std::optional<QList<int>> countCohortColumns(const QSqlDatabase& db,
+    const QString& key, const QList<CohortColumn>& columns,
+    const QList<Histogram>& histograms)
+{
+    QStringList sums { "COUNT(*)" };
+    QVariantList boundValues;
+    QStringList buckets { "value", "v" };
+    QVariantList bucketValues;
+    QSet<int> bucketed;
+    for (const auto& column : columns) {
+        sums.append(column.sql);
+        boundValues += column.boundValues;
+        if (column.histogram < 0 || bucketed.contains(column.histogram))
+            continue;
+        bucketed.insert(column.histogram);
+        const auto& histogram = histograms[column.histogram];
+        buckets.append(QString("CASE WHEN v < ? THEN -1 "
+                               "ELSE MIN(CAST((v - ?) * ? AS INTEGER), %1) "
+                               "END AS bucket_%2")
+                           .arg(histogram.getBucketCount())
+                           .arg(column.histogram));
+        bucketValues << histogram.getStart() << histogram.getStart()
+                     << histogram.getInverseWidth();
+    }
+
+    const auto sql = QString("SELECT %1 FROM (SELECT %2 FROM ("
+                             "SELECT value, CAST(value AS REAL) AS v "
+                             "FROM data_point WHERE key = ?))")
+                         .arg(sums.join(", "), buckets.join(", "));
+    QSqlQuery sqlQuery(db);
+    sqlQuery.prepare(sql);
+    for (const auto& boundValue : boundValues + bucketValues)
+        sqlQuery.addBindValue(boundValue);
+    sqlQuery.addBindValue(key);
+    if (!execQuery(sqlQuery) || !sqlQuery.next())
+        return std::nullopt;
+
+    if (sqlQuery.value(0).toInt() == 0)
+        return std::nullopt;
+
+    QList<int> counts;
+    counts.reserve(columns.count());
+    for (int column = 1; column <= columns.count(); column++)
+        counts.append(sqlQuery.value(column).toInt());
+    return counts;
+}
+
+// Counts the cohorts of all queries in a single pass over the key's data
+// points, or a few if there are too many cohorts for one statement. There's
+// one SUM per cohort rather than a single CASE over all of them, since
+// cohorts may overlap and a data point counts towards each one it's in.
+// Histograms get their bucket index computed once per data point, with one
+// subtraction and multiplication, and one SUM per bucket comparing it.
+// Truncating the index is the same as flooring it, since it's never
+// negative.
+QHash<QString, QMap<QString, int>> countCohortsInSinglePass(
+    const QSqlDatabase& db, const QString& key,
+    const QList<QSharedPointer<Query>>& queries)
+{
+    QHash<QString, QMap<QString, int>> cohortCounts;
+    QList<CohortColumn> columns;
+    QList<Histogram> histograms;
+    for (const auto& query : queries) {
+        cohortCounts[query->id];
+        if (query->histogram.has_value()) {
+            const auto index = int(histograms.count());
+            histograms.append(query->histogram.value());
+            // The cohorts are in bucket order, starting with the underflow.
+            for (int i = 0; i < query->cohorts.count(); i++) {
+                columns.append({ .queryId = query->id,
+                    .cohort = query->cohorts[i],
+                    .sql = QString("SUM(bucket_%1 = %2)").arg(index).arg(i - 1),
+                    .histogram = index });
+            }
+            continue;
+        }
+        for (const auto& cohort : query->cohorts) {
+            CohortColumn column { .queryId = query->id, .cohort = cohort };
+            column.sql = QString("SUM(CASE WHEN %1 THEN 1 ELSE 0 END)")
+                             .arg(cohortCondition(
+                                 *query, cohort, column.boundValues));
+            columns.append(column);
+        }
+    }
+
+    qsizetype start = 0;
+    do {
+        // As many columns as fit, counting COUNT(*), the key and the values
+        // of each histogram's bucket index.
+        auto end = start;
+        int boundValueCount = 1;
+        QSet<int> bucketed;
+        while (end < columns.count() && end - start + 1 < maxCohortColumns) {
+            const auto& column = columns[end];
+            auto columnValueCount = int(column.boundValues.count());
+            if (column.histogram >= 0 && !bucketed.contains(column.histogram))
+                columnValueCount += 3;
+            if (end > start
+                && boundValueCount + columnValueCount > maxCohortBoundValues)
+                break;
+            boundValueCount += columnValueCount;
+            if (column.histogram >= 0)
+                bucketed.insert(column.histogram);
+            end++;
+        }
+
+        const auto chunk = columns.mid(start, end - start);
+        const auto counts = countCohortColumns(db, key, chunk, histograms);
+        if (!counts.has_value())
+            return {};
+        for (qsizetype i = 0; i < chunk.count(); i++)
+            cohortCounts[chunk[i].queryId][chunk[i].cohort] = counts->at(i);
+        start = end;
+    } while (start < columns.count());
+    return cohortCounts;
+}
+
+QMap<QString, int> countValue(const Query& query, const QString& value)
+{
+    QMap<QString, int> cohortData;
+    for (const auto& cohort : query.cohorts)
+        cohortData[cohort] = 0;
+    for (const auto& cohort : query.matchingCohorts(value))
+        cohortData[cohort]++;
+    return cohortData;
+}
+
+// Timestamps are stored the same way as SQLite's CURRENT_TIMESTAMP.
+QString formatTimestamp(const QDateTime& dateTime)
+{
+    return dateTime.toUTC().toString("yyyy-MM-dd HH:mm:ss");
+}
+
+QString insertDataPointsStatement(int rowCount)
+{
+    QStringList rows;
+    rows.fill("(?, ?, ?)", rowCount);
+    return "INSERT INTO data_point (key, value, created_at) VALUES "
+        + rows.join(", ");
+}
+
+// Compares the fields saveSurveyRecord stores.
+bool hasSameSavedFields(const SurveyRecord& a, const SurveyRecord& b)
+{
+    return a.clientId == b.clientId
+        && a.delegatePublicKey == b.delegatePublicKey
+        && a.aggregationPublicKey == b.aggregationPublicKey
+        && a.groupSize == b.groupSize;
+}
+
+SurveyRecord withResponse(const SurveyRecord& record, bool hasResponse)
+{
+    return SurveyRecord(record.survey, record.clientId, record.publicKey,
+        record.delegatePublicKey, record.aggregationPublicKey, record.groupSize,
+        hasResponse);
+}
+
+// Survey data and responses used to be stored as JSON objects, the CBOR
+// arrays written now never start with '{'.
+bool isLegacyJson(const QByteArray& data) { return data.startsWith('{'); }
+
+Result<QSharedPointer<Survey>> decodeSurvey(const QByteArray& data)
+{
+    return isLegacyJson(data) ? Survey::fromByteArray(data)
+                              : Survey::fromCbor(data);
+}
+
+Result<QSharedPointer<SurveyResponse>> decodeSurveyResponse(
+    const QByteArray& data)
+{
+    return isLegacyJson(data) ? SurveyResponse::fromJsonByteArray(data)
+                              : SurveyResponse::fromCbor(data);
+}
+
+// Returns the CBOR form of a legacy JSON blob, or nothing if it can't be read.
+template <typename T>
+std::optional<QByteArray> convertLegacyJson(const Result<T>& result)
+{
+    if (!result.isSuccess())
+        return std::nullopt;
+    return result.getValue()->toCbor();
 }
 
 template <typename T>
@@ -70,12 +425,20 @@ QVariant optionalToQVariant(const std::optional<T>& optional)
 }
 
 SqliteStorage::SqliteStorage(const QString& databasePath)
-    : db(createDb(databasePath))
+    : pool(databasePath)
 {
-    // TODO: Exception instead of return code.
-    if (!db.open())
-        qDebug() << "Error: Unable to open database";
-    migrate();
+    auto db = database();
+    migrate(db);
+    loadKnownKeys();
+    loadSketches();
+    loadSurveyRecords();
+}
+
+SqliteStorage::~SqliteStorage()
+{
+    stopping = true;
+    if (blobMigration)
+        blobMigration->wait();
 }
 
 SqliteStorage::SqliteStorage()
@@ -87,7 +450,20 @@ SqliteStorage::SqliteStorage()
 QList<DataPoint> SqliteStorage::listDataPoints(const QString& key) const
 {
     QList<DataPoint> dataPoints;
-    QSqlQuery query;
+    forEachDataPoint(key, [&dataPoints](const DataPoint& dataPoint) {
+        dataPoints.push_back(dataPoint);
+        return true;
+    });
+    return dataPoints;
+}
+
+void SqliteStorage::forEachDataPoint(const QString& key,
+    const std::function<bool(const DataPoint&)>& callback) const
+{
+    // Not a prepared query, the callback may use the storage itself.
+    QSqlQuery query(database());
+    // Don't keep the rows already visited.
+    query.setForwardOnly(true);
     if (key.isEmpty())
         query.prepare("SELECT key, value, created_at FROM data_point");
     else {
@@ -96,75 +472,260 @@ QList<DataPoint> SqliteStorage::listDataPoints(const QString& key) const
         query.bindValue(":key", key);
     }
     if (!execQuery(query))
-        return dataPoints;
+        return;
 
-    while (query.next())
-        dataPoints.push_back({ .key = query.value(0).toString(),
-            .value = query.value(1).toString(),
-            .createdAt = query.value(2).toDateTime() });
-    return dataPoints;
+    DataPoint dataPoint;
+    while (query.next()) {
+        dataPoint.key = query.value(0).toString();
+        dataPoint.value = query.value(1).toString();
+        dataPoint.createdAt = query.value(2).toDateTime();
+        if (!callback(dataPoint))
+            return;
+    }
 }
 
 void SqliteStorage::addDataPoint(const QString& key, const QString& value)
 {
-    QSqlQuery query;
-    query.prepare("INSERT INTO data_point (key, value, created_at)"
-                  "    values (:key, :value, CURRENT_TIMESTAMP)");
+    addDataPoints({ { .key = key,
+        .value = value,
+        .createdAt = QDateTime::currentDateTimeUtc() } });
+}
+
+bool SqliteStorage::addDataPoints(const QList<DataPoint>& dataPoints)
+{
+    QList<DataPoint> rows;
+    // By key, so each sketch is only written once per batch.
+    QMap<QString, QList<DataPoint>> sketched;
+    {
+        // Sketches are never disabled, so this split stays valid.
+        QMutexLocker locker(&stateMutex);
+        for (const auto& dataPoint : dataPoints) {
+            if (sketches.contains(dataPoint.key))
+                sketched[dataPoint.key].append(dataPoint);
+            else
+                rows.append(dataPoint);
+        }
+    }
+
+    transaction();
+    auto stored = true;
+    for (auto it = sketched.cbegin(); stored && it != sketched.cend(); ++it)
+        stored = addToSketch(it.key(), it.value());
+
+    // Full batches use one multi-row insert each, the same statement every
+    // time so it stays prepared. The rest is inserted row by row.
+    const auto batchStatement = insertDataPointsStatement(insertBatchSize);
+    const auto rowStatement = insertDataPointsStatement(1);
+    for (qsizetype start = 0; stored && start < rows.count();) {
+        const auto rowCount
+            = rows.count() - start >= insertBatchSize ? insertBatchSize : 1;
+        auto& query
+            = preparedQuery(rowCount == 1 ? rowStatement : batchStatement);
+        for (int row = 0; row < rowCount; row++) {
+            const auto& dataPoint = rows[start + row];
+            query.bindValue(row * 3, dataPoint.key);
+            query.bindValue(row * 3 + 1, dataPoint.value);
+            query.bindValue(row * 3 + 2, formatTimestamp(dataPoint.createdAt));
+        }
+        stored = execQuery(query);
+        start += rowCount;
+    }
+    if (!stored)
+        rollback();
+    else
+        stored = tryCommit();
+
+    QMutexLocker locker(&stateMutex);
+    if (!stored) {
+        // The sketches were updated in memory before the writes failed.
+        sketches.clear();
+        loadSketches();
+        return false;
+    }
+    for (const auto& dataPoint : dataPoints)
+        knownKeys.insert(dataPoint.key);
+    return true;
+}
+
+bool SqliteStorage::addToSketch(
+    const QString& key, const QList<DataPoint>& dataPoints)
+{
+    QByteArray data;
+    {
+        QMutexLocker locker(&stateMutex);
+        auto sketch = sketches.find(key);
+        Q_ASSERT(sketch != sketches.end());
+        for (const auto& dataPoint : dataPoints)
+            sketch->add(dataPoint.value);
+        data = sketch->toByteArray();
+    }
+    if (!saveSketch(key, data))
+        return false;
+
+    // There's no insert into data_point to trigger this. The batch is in
+    // submission order, so its last data point is the latest.
+    const auto& latest = dataPoints.last();
+    auto& query = preparedQuery("INSERT OR REPLACE INTO latest_data_point"
+                                "    (key, value, created_at)"
+                                "    VALUES (:key, :value, :created_at)");
     query.bindValue(":key", key);
-    query.bindValue(":value", value);
-    execQuery(query);
+    query.bindValue(":value", latest.value);
+    query.bindValue(":created_at", formatTimestamp(latest.createdAt));
+    return execQuery(query);
 }
 
 bool SqliteStorage::checkIfDataPointPresent(const QString& key) const
 {
-    QSqlQuery query;
-    query.prepare("SELECT EXISTS(SELECT 1 FROM data_point WHERE key LIKE "
-                  ":key)");
+    QMutexLocker locker(&stateMutex);
+    return knownKeys.contains(key);
+}
+
+bool SqliteStorage::enableSketch(const QString& key)
+{
+    {
+        QMutexLocker locker(&stateMutex);
+        if (sketches.contains(key))
+            return true;
+    }
+
+    transaction();
+    DataSketch sketch;
+    forEachDataPoint(key, [&sketch](const DataPoint& dataPoint) {
+        sketch.add(dataPoint.value);
+        return true;
+    });
+
+    QSqlQuery query(database());
+    query.prepare("DELETE FROM data_point WHERE key = :key");
     query.bindValue(":key", key);
-    if (query.exec() && query.next()) {
-        return query.value(0).toBool();
+    // The data points are only deleted along with saving the sketch.
+    if (!execQuery(query) || !saveSketch(key, sketch.toByteArray())) {
+        rollback();
+        return false;
     }
+    if (!tryCommit())
+        return false;
 
-    return false;
+    QMutexLocker locker(&stateMutex);
+    sketches.insert(key, sketch);
+    return true;
+}
+
+std::optional<DataPoint> SqliteStorage::findLatestDataPoint(
+    const QString& key) const
+{
+    auto& query = preparedQuery(
+        "SELECT value, created_at FROM latest_data_point WHERE key = :key");
+    query.bindValue(":key", key);
+    if (!execQuery(query) || !query.next())
+        return std::nullopt;
+
+    return DataPoint { .key = key,
+        .value = query.value(0).toString(),
+        .createdAt = query.value(1).toDateTime() };
+}
+
+QHash<QString, QMap<QString, int>> SqliteStorage::countCohorts(
+    const QString& key, const QList<QSharedPointer<Query>>& queries) const
+{
+    QMutexLocker locker(&stateMutex);
+    const auto sketch = sketches.constFind(key);
+    const auto isSketched = sketch != sketches.constEnd();
+
+    QList<QSharedPointer<Query>> sketchQueries;
+    QList<QSharedPointer<Query>> cohortQueries;
+    QList<QSharedPointer<Query>> latestQueries;
+    for (const auto& query : queries) {
+        if (query->latest)
+            latestQueries.append(query);
+        else if (isSketched)
+            sketchQueries.append(query);
+        else
+            cohortQueries.append(query);
+    }
+
+    QHash<QString, QMap<QString, int>> cohortCounts;
+    if (!sketchQueries.isEmpty()) {
+        if (sketch->count() == 0)
+            return {};
+        // Queries the sketch can't answer are left out.
+        for (const auto& query : sketchQueries)
+            if (const auto cohortData = sketch->countCohorts(*query))
+                cohortCounts[query->id] = cohortData.value();
+    }
+
+    locker.unlock();
+
+    if (!cohortQueries.isEmpty()) {
+        const auto allDiscrete
+            = std::all_of(cohortQueries.begin(), cohortQueries.end(),
+                [](const auto& query) { return query->discrete; });
+        cohortCounts = allDiscrete
+            ? countDiscreteCohorts(database(), key, cohortQueries)
+            : countCohortsInSinglePass(database(), key, cohortQueries);
+        if (cohortCounts.isEmpty())
+            return {};
+    }
+
+    if (!latestQueries.isEmpty()) {
+        const auto latestDataPoint = findLatestDataPoint(key);
+        if (!latestDataPoint.has_value())
+            return {};
+        for (const auto& query : latestQueries)
+            cohortCounts[query->id]
+                = countValue(*query, latestDataPoint->value);
+    }
+    return cohortCounts;
 }
 
 QList<SurveyResponseRecord> SqliteStorage::listSurveyResponses() const
 {
     QList<SurveyResponseRecord> responses;
-    QSqlQuery query;
+    forEachSurveyResponse([&responses](const SurveyResponseRecord& response) {
+        responses.push_back(response);
+        return true;
+    });
+    return responses;
+}
+
+void SqliteStorage::forEachSurveyResponse(
+    const std::function<bool(const SurveyResponseRecord&)>& callback) const
+{
+    QSqlQuery query(database());
+    query.setForwardOnly(true);
     query.prepare(
         "SELECT data, survey_id, created_at FROM survey_response_record");
     if (!execQuery(query))
-        return responses;
+        return;
 
     while (query.next()) {
         const auto data = query.value(0).toByteArray();
         const auto surveyId = query.value(1).toString();
         const auto createdAt = query.value(2).toDateTime();
-        responses.push_back(
-            createSurveyResponseRecord(data, surveyId, createdAt));
+        if (!callback(createSurveyResponseRecord(data, surveyId, createdAt)))
+            return;
     }
-
-    return responses;
 }
 
 void SqliteStorage::addSurveyResponse(
     const SurveyResponse& response, const Survey& survey)
 {
-    QSqlQuery query;
-    query.prepare(
+    auto& query = preparedQuery(
         "INSERT INTO survey_response_record (data, survey_id, created_at)"
         "values (:data, :survey_id, CURRENT_TIMESTAMP)");
-    query.bindValue(":data", response.toJsonByteArray());
+    query.bindValue(":data", response.toCbor());
     query.bindValue(":survey_id", survey.id);
     execQuery(query);
+
+    QMutexLocker locker(&stateMutex);
+    if (const auto record = surveyRecords.value(survey.id))
+        cacheSurveyRecord(withResponse(*record, true));
 }
 
 std::optional<SurveyResponseRecord> SqliteStorage::findSurveyResponseFor(
     const QString& surveyId) const
 {
-    QSqlQuery query;
-    query.prepare(R"(
+    auto& query = preparedQuery(R"(
         SELECT data, created_at
         FROM survey_response_record
         WHERE survey_id = :survey_id
@@ -180,34 +741,21 @@ std::optional<SurveyResponseRecord> SqliteStorage::findSurveyResponseFor(
 
 QList<SurveyRecord> SqliteStorage::listSurveyRecords() const
 {
-    QList<SurveyRecord> survey_records;
-    QSqlQuery query;
-    query.prepare("SELECT survey_data, client_id, public_key, "
-                  "delegate_public_key, aggregation_public_key, group_size "
-                  "FROM survey_record");
-    if (!execQuery(query))
-        return survey_records;
-
-    while (query.next()) {
-        const auto surveyResult
-            = Survey::fromByteArray(query.value(0).toByteArray());
-        Q_ASSERT(surveyResult.isSuccess());
-        const auto clientId = query.value(1).toString();
-        const auto publicKey = query.value(2).toString();
-        const auto delegatePublicKey = query.value(3).toString();
-        std::optional<QString> aggregationPublicKey;
-        if (const QVariant value = query.value(4); !value.isNull()) {
-            aggregationPublicKey = value.toString();
-        }
-        const auto groupSize = query.value(5).toInt();
-        const auto hasResponse
-            = findSurveyResponseFor(surveyResult.getValue()->id).has_value();
-        survey_records.push_back(SurveyRecord(surveyResult.getValue(), clientId,
-            publicKey, delegatePublicKey, aggregationPublicKey, groupSize,
-            hasResponse));
-    }
+    QMutexLocker locker(&stateMutex);
+    QList<SurveyRecord> records;
+    for (const auto& record : surveyRecords)
+        records.append(*record);
+    return records;
+}
 
-    return survey_records;
+QList<SurveyRecord> SqliteStorage::listSurveyRecords(
+    const SurveyState& state) const
+{
+    QMutexLocker locker(&stateMutex);
+    QList<SurveyRecord> records;
+    for (const auto& surveyId : surveyRecordsByState.value(state))
+        records.append(*surveyRecords.value(surveyId));
+    return records;
 }
 
 void SqliteStorage::addSurveyRecord(const Survey& survey,
@@ -216,8 +764,7 @@ void SqliteStorage::addSurveyRecord(const Survey& survey,
     const std::optional<QString>& aggregationPublicKey,
     const std::optional<int>& groupSize)
 {
-    QSqlQuery query;
-    query.prepare(R"(
+    auto& query = preparedQuery(R"(
         INSERT INTO survey_record (
             survey_id,
             survey_data,
@@ -238,7 +785,7 @@ void SqliteStorage::addSurveyRecord(const Survey& survey,
         )
     )");
     query.bindValue(":survey_id", survey.id);
-    query.bindValue(":survey_data", survey.toByteArray());
+    query.bindValue(":survey_data", survey.toCbor());
     query.bindValue(":client_id", clientId);
     query.bindValue(":public_key", publicKey);
     query.bindValue(":delegate_public_key", delegatePublicKey);
@@ -246,73 +793,406 @@ void SqliteStorage::addSurveyRecord(const Survey& survey,
         ":aggregation_public_key", optionalToQVariant(aggregationPublicKey));
     query.bindValue(":group_size", optionalToQVariant(groupSize));
     execQuery(query);
+
+    QMutexLocker locker(&stateMutex);
+    surveyCache.remove(survey.id);
+    cacheSurveyRecord(SurveyRecord(QSharedPointer<Survey>::create(survey),
+        clientId, publicKey, delegatePublicKey, aggregationPublicKey,
+        groupSize));
 }
 
 void SqliteStorage::saveSurveyRecord(const SurveyRecord& record)
 {
-    QSqlQuery query;
-    query.prepare(R"(
-        UPDATE survey_record
-        SET client_id = :client_id,
-            delegate_public_key = :delegate_public_key,
-            aggregation_public_key = :aggregation_public_key,
-            group_size = :group_size
-        WHERE survey_id = :survey_id
-    )");
-    query.bindValue(":survey_id", record.survey->id);
-    query.bindValue(":client_id", record.clientId);
-    query.bindValue(":delegate_public_key", record.delegatePublicKey);
-    query.bindValue(":aggregation_public_key",
-        optionalToQVariant(record.aggregationPublicKey));
-    query.bindValue(":group_size", optionalToQVariant(record.groupSize));
-    execQuery(query);
+    {
+        QMutexLocker locker(&stateMutex);
+        const auto cachedRecord = surveyRecords.value(record.survey->id);
+        if (cachedRecord.isNull()
+            || hasSameSavedFields(*cachedRecord, record))
+            return;
+        // Whether there's a response isn't up to the caller.
+        cacheSurveyRecord(
+            withResponse(record, cachedRecord->getState() == Done));
+        dirtySurveyRecords.localData().insert(record.survey->id);
+    }
+    if (transactionDepths.localData() == 0)
+        writeSurveyRecords();
 }
 
 QSharedPointer<SurveyRecord> SqliteStorage::findSurveyRecordById(
     const QString& surveyId) const
 {
-    QSqlQuery query;
-    query.prepare(
-        R"(SELECT survey_data,
-                        client_id,
-                        public_key,
-                        delegate_public_key,
-                        aggregation_public_key,
-                        group_size
-                     FROM survey_record
-                     WHERE survey_id = :survey_id)");
-    query.bindValue(":survey_id", surveyId);
-    if (!execQuery(query)) {
+    QMutexLocker locker(&stateMutex);
+    const auto record = surveyRecords.value(surveyId);
+    if (record.isNull())
         return nullptr;
+    return QSharedPointer<SurveyRecord>::create(*record);
+}
+
+DelegateAggregation SqliteStorage::findDelegateAggregation(
+    const QString& surveyId) const
+{
+    auto& query = preparedQuery(R"(
+        SELECT position, count, aggregate
+        FROM delegate_aggregation
+        WHERE survey_id = :survey_id
+    )");
+    query.bindValue(":survey_id", surveyId);
+    if (!execQuery(query) || !query.next())
+        return {};
+    return { .position = query.value(0).toLongLong(),
+        .count = query.value(1).toInt(),
+        .aggregate = query.value(2).toByteArray() };
+}
+
+bool SqliteStorage::checkIfDelegateMessageFolded(
+    const QString& surveyId, const QByteArray& digest) const
+{
+    auto& query = preparedQuery(R"(
+        SELECT 1
+        FROM delegate_folded_message
+        WHERE survey_id = :survey_id AND digest = :digest
+    )");
+    query.bindValue(":survey_id", surveyId);
+    query.bindValue(":digest", digest);
+    return execQuery(query) && query.next();
+}
+
+void SqliteStorage::foldDelegateMessages(const QString& surveyId,
+    const QList<QByteArray>& digests, const QByteArray& aggregate,
+    qint64 position)
+{
+    transaction();
+    auto& insert = preparedQuery(
+        "INSERT OR IGNORE INTO delegate_folded_message (survey_id, digest)"
+        "    VALUES (:survey_id, :digest)");
+    for (const auto& digest : digests) {
+        insert.bindValue(":survey_id", surveyId);
+        insert.bindValue(":digest", digest);
+        execQuery(insert);
     }
 
-    if (!query.next())
-        return nullptr;
+    auto& upsert = preparedQuery(R"(
+        INSERT INTO delegate_aggregation
+            (survey_id, position, count, aggregate)
+        VALUES (:survey_id, :position, :count, :aggregate)
+        ON CONFLICT (survey_id) DO UPDATE
+        SET position = excluded.position,
+            count = count + excluded.count,
+            aggregate = excluded.aggregate
+    )");
+    upsert.bindValue(":survey_id", surveyId);
+    upsert.bindValue(":position", position);
+    upsert.bindValue(":count", digests.count());
+    upsert.bindValue(":aggregate", aggregate);
+    execQuery(upsert);
+    commit();
+}
 
-    const auto surveyParsingResult
-        = Survey::fromByteArray(query.value(0).toByteArray());
-    Q_ASSERT(surveyParsingResult.isSuccess());
-    const auto clientId = query.value(1).toString();
-    const auto publicKey = query.value(2).toString();
-    const auto delegatePublicKey = query.value(3).toString();
-    std::optional<QString> aggregationPublicKey;
-    if (const QVariant value = query.value(4); !value.isNull()) {
-        aggregationPublicKey = value.toString();
+void SqliteStorage::removeDelegateAggregation(const QString& surveyId)
+{
+    transaction();
+    for (const auto& table :
+        { "delegate_aggregation", "delegate_folded_message" }) {
+        auto& query = preparedQuery(
+            QString("DELETE FROM %1 WHERE survey_id = :survey_id").arg(table));
+        query.bindValue(":survey_id", surveyId);
+        execQuery(query);
+    }
+    commit();
+}
+
+void SqliteStorage::transaction()
+{
+    // Nested transactions are savepoints, which only the outermost commit
+    // makes durable.
+    auto& depth = transactionDepths.localData();
+    if (depth == 0)
+        database().transaction();
+    else {
+        QSqlQuery query(database());
+        query.prepare(QString("SAVEPOINT level_%1").arg(depth));
+        execQuery(query);
+    }
+    depth++;
+}
+
+void SqliteStorage::commit() { tryCommit(); }
+
+bool SqliteStorage::tryCommit()
+{
+    auto& depth = transactionDepths.localData();
+    Q_ASSERT(depth > 0);
+    depth--;
+    if (depth > 0) {
+        QSqlQuery query(database());
+        query.prepare(QString("RELEASE level_%1").arg(depth));
+        return execQuery(query);
+    }
+
+    writeSurveyRecords();
+    auto db = database();
+    if (db.commit())
+        return true;
+    qDebug() << db.lastError();
+    db.rollback();
+    dirtySurveyRecords.localData().clear();
+    loadSurveyRecords();
+    return false;
+}
+
+void SqliteStorage::rollback()
+{
+    auto& depth = transactionDepths.localData();
+    Q_ASSERT(depth > 0);
+    depth--;
+    if (depth == 0) {
+        database().rollback();
+        // Drop the changes made to cached survey records as well.
+        dirtySurveyRecords.localData().clear();
+        loadSurveyRecords();
+        return;
+    }
+    QSqlQuery query(database());
+    query.prepare(QString("ROLLBACK TO level_%1").arg(depth));
+    execQuery(query);
+    query.prepare(QString("RELEASE level_%1").arg(depth));
+    execQuery(query);
+}
+
+QSqlDatabase SqliteStorage::database() const { return pool.connection(); }
+
+QSqlQuery& SqliteStorage::preparedQuery(const QString& statement) const
+{
+    return pool.preparedQuery(statement);
+}
+
+QSharedPointer<Survey> SqliteStorage::parseSurvey(
+    const QString& surveyId, const QByteArray& data) const
+{
+    QMutexLocker locker(&stateMutex);
+    if (const auto survey = surveyCache.constFind(surveyId);
+        survey != surveyCache.constEnd())
+        return survey.value();
+
+    const auto surveyResult = decodeSurvey(data);
+    Q_ASSERT(surveyResult.isSuccess());
+    surveyCache.insert(surveyId, surveyResult.getValue());
+    return surveyResult.getValue();
+}
+
+void SqliteStorage::loadSurveyRecords()
+{
+    auto& query = preparedQuery(R"(
+        SELECT survey_record.survey_id,
+            survey_data,
+            client_id,
+            public_key,
+            delegate_public_key,
+            aggregation_public_key,
+            group_size,
+            EXISTS(SELECT 1 FROM survey_response_record
+                WHERE survey_response_record.survey_id
+                    = survey_record.survey_id)
+        FROM survey_record
+    )");
+    if (!execQuery(query))
+        return;
+
+    QList<SurveyRecord> records;
+    while (query.next()) {
+        const auto survey = parseSurvey(
+            query.value(0).toString(), query.value(1).toByteArray());
+        const auto clientId = query.value(2).toString();
+        const auto publicKey = query.value(3).toString();
+        const auto delegatePublicKey = query.value(4).toString();
+        std::optional<QString> aggregationPublicKey;
+        if (const QVariant value = query.value(5); !value.isNull()) {
+            aggregationPublicKey = value.toString();
+        }
+        const auto groupSize = query.value(6).toInt();
+        const auto hasResponse = query.value(7).toBool();
+        records.append(SurveyRecord(survey, clientId, publicKey,
+            delegatePublicKey, aggregationPublicKey, groupSize, hasResponse));
+    }
+
+    QMutexLocker locker(&stateMutex);
+    surveyRecords.clear();
+    surveyRecordsByState.clear();
+    for (const auto& record : records)
+        cacheSurveyRecord(record);
+}
+
+void SqliteStorage::cacheSurveyRecord(const SurveyRecord& record)
+{
+    const auto& surveyId = record.survey->id;
+    if (const auto cachedRecord = surveyRecords.value(surveyId))
+        surveyRecordsByState[cachedRecord->getState()].remove(surveyId);
+    surveyRecords.insert(
+        surveyId, QSharedPointer<SurveyRecord>::create(record));
+    surveyRecordsByState[record.getState()].insert(surveyId);
+}
+
+void SqliteStorage::writeSurveyRecords()
+{
+    auto& dirtyIds = dirtySurveyRecords.localData();
+    for (const auto& surveyId : std::exchange(dirtyIds, {})) {
+        const auto record = findSurveyRecordById(surveyId);
+        if (record.isNull())
+            continue;
+
+        auto& query = preparedQuery(R"(
+            UPDATE survey_record
+            SET client_id = :client_id,
+                delegate_public_key = :delegate_public_key,
+                aggregation_public_key = :aggregation_public_key,
+                group_size = :group_size
+            WHERE survey_id = :survey_id
+        )");
+        query.bindValue(":survey_id", surveyId);
+        query.bindValue(":client_id", record->clientId);
+        query.bindValue(":delegate_public_key", record->delegatePublicKey);
+        query.bindValue(":aggregation_public_key",
+            optionalToQVariant(record->aggregationPublicKey));
+        query.bindValue(":group_size", optionalToQVariant(record->groupSize));
+        execQuery(query);
+    }
+}
+
+void SqliteStorage::loadKnownKeys()
+{
+    // Has a row for every key, sketched or not.
+    QSqlQuery query(database());
+    query.prepare("SELECT key FROM latest_data_point");
+    if (!execQuery(query))
+        return;
+
+    while (query.next())
+        knownKeys.insert(query.value(0).toString());
+}
+
+void SqliteStorage::loadSketches()
+{
+    QSqlQuery query(database());
+    query.prepare("SELECT key, data FROM data_sketch");
+    if (!execQuery(query))
+        return;
+
+    while (query.next()) {
+        const auto key = query.value(0).toString();
+        const auto result
+            = DataSketch::fromByteArray(query.value(1).toByteArray());
+        if (!result.isSuccess()) {
+            qDebug() << "Error: Unable to load sketch for" << key << ":"
+                     << result.getErrorMessage();
+            continue;
+        }
+        sketches.insert(key, result.getValue());
     }
-    const auto groupSize = query.value(5).toInt();
-    return QSharedPointer<SurveyRecord>::create(surveyParsingResult.getValue(),
-        clientId, publicKey, delegatePublicKey, aggregationPublicKey,
-        groupSize);
+}
+
+bool SqliteStorage::saveSketch(const QString& key, const QByteArray& data)
+{
+    auto& query = preparedQuery(
+        "INSERT OR REPLACE INTO data_sketch (key, data) VALUES (:key, :data)");
+    query.bindValue(":key", key);
+    query.bindValue(":data", data);
+    return execQuery(query);
 }
 
 SurveyResponseRecord SqliteStorage::createSurveyResponseRecord(
     const QByteArray& data, const QString& surveyId,
     const QDateTime& createdAt) const
 {
-    auto responseResult = SurveyResponse::fromJsonByteArray(data);
+    auto responseResult = decodeSurveyResponse(data);
     Q_ASSERT(responseResult.isSuccess());
     const auto surveyRecord = findSurveyRecordById(surveyId);
     return { .response = responseResult.getValue(),
         .surveyRecord = surveyRecord,
         .createdAt = createdAt };
 }
+
+void SqliteStorage::startLegacyBlobMigration()
+{
+    if (blobMigration)
+        return;
+    QSqlQuery query(database());
+    query.prepare(
+        "SELECT EXISTS(SELECT 1 FROM completed_task WHERE name = :name)");
+    query.bindValue(":name", blobMigrationTask);
+    if (!execQuery(query) || !query.next() || query.value(0).toBool())
+        return;
+
+    blobMigration.reset(QThread::create([this]() { migrateLegacyBlobs(); }));
+    blobMigration->start();
+}
+
+void SqliteStorage::migrateLegacyBlobs()
+{
+    if (!migrateLegacyBlobs("survey_record", "survey_data",
+            [](const QByteArray& data) {
+                return convertLegacyJson(Survey::fromByteArray(data));
+            }))
+        return;
+    if (!migrateLegacyBlobs("survey_response_record", "data",
+            [](const QByteArray& data) {
+                return convertLegacyJson(
+                    SurveyResponse::fromJsonByteArray(data));
+            }))
+        return;
+
+    QSqlQuery query(database());
+    query.prepare("INSERT OR IGNORE INTO completed_task (name) VALUES (:name)");
+    query.bindValue(":name", blobMigrationTask);
+    execQuery(query);
+}
+
+bool SqliteStorage::migrateLegacyBlobs(const QString& table,
+    const QString& column,
+    const std::function<std::optional<QByteArray>(const QByteArray&)>&
+        convert)
+{
+    // Rows are only ever inserted with these blobs, so they can be read
+    // outside of the transaction updating them.
+    QSqlQuery selectQuery(database());
+    selectQuery.prepare(QString(R"(
+        SELECT rowid, %2
+        FROM %1
+        WHERE rowid > :after AND CAST(substr(%2, 1, 1) AS TEXT) = '{'
+        ORDER BY rowid
+        LIMIT %3
+    )")
+                            .arg(table, column)
+                            .arg(blobMigrationBatchSize));
+    QSqlQuery updateQuery(database());
+    updateQuery.prepare(QString("UPDATE %1 SET %2 = :data WHERE rowid = :rowid")
+                            .arg(table, column));
+
+    qint64 after = 0;
+    while (!stopping) {
+        selectQuery.bindValue(":after", after);
+        if (!execQuery(selectQuery))
+            return false;
+        int rowCount = 0;
+        QList<QPair<qint64, QByteArray>> rows;
+        while (selectQuery.next()) {
+            rowCount++;
+            after = selectQuery.value(0).toLongLong();
+            // Rows that can't be read are left as they are.
+            if (const auto data = convert(selectQuery.value(1).toByteArray()))
+                rows.append({ after, data.value() });
+        }
+        selectQuery.finish();
+
+        transaction();
+        for (const auto& [rowId, data] : rows) {
+            updateQuery.bindValue(":data", data);
+            updateQuery.bindValue(":rowid", rowId);
+            execQuery(updateQuery);
+        }
+        commit();
+
+        if (rowCount < blobMigrationBatchSize)
+            return true;
+    }
+    return false;
+}
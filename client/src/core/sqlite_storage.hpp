@@ -1,23 +1,36 @@
 #pragma once
 
+#include "data_sketch.hpp"
+#include "sqlite_connection_pool.hpp"
 #include "storage.hpp"
-#include <QSqlDatabase>
 #include <QtCore>
+#include <atomic>
 
 class SqliteStorage : public Storage {
 public:
     explicit SqliteStorage(const QString& databasePath);
     SqliteStorage();
+    ~SqliteStorage();
 
     QList<DataPoint> listDataPoints(const QString& key = "") const;
+    void forEachDataPoint(const QString& key,
+        const std::function<bool(const DataPoint&)>& callback) const;
     void addDataPoint(const QString& key, const QString& value);
+    bool addDataPoints(const QList<DataPoint>& dataPoints);
+    std::optional<DataPoint> findLatestDataPoint(const QString& key) const;
     bool checkIfDataPointPresent(const QString& key) const;
+    bool enableSketch(const QString& key);
+    QHash<QString, QMap<QString, int>> countCohorts(const QString& key,
+        const QList<QSharedPointer<Query>>& queries) const;
     QList<SurveyResponseRecord> listSurveyResponses() const;
+    void forEachSurveyResponse(
+        const std::function<bool(const SurveyResponseRecord&)>& callback) const;
     void addSurveyResponse(
         const SurveyResponse& response, const Survey& survey);
     std::optional<SurveyResponseRecord> findSurveyResponseFor(
         const QString& surveyId) const;
     QList<SurveyRecord> listSurveyRecords() const;
+    QList<SurveyRecord> listSurveyRecords(const SurveyState& state) const;
     void addSurveyRecord(const Survey& survey, const QString& clientId,
         const QString& publicKey, const QString& delegatePublicKey,
         const std::optional<QString>& dataPublicKey,
@@ -25,9 +38,61 @@ public:
     void saveSurveyRecord(const SurveyRecord& record);
     QSharedPointer<SurveyRecord> findSurveyRecordById(
         const QString& surveyId) const;
+    DelegateAggregation findDelegateAggregation(const QString& surveyId) const;
+    bool checkIfDelegateMessageFolded(
+        const QString& surveyId, const QByteArray& digest) const;
+    void foldDelegateMessages(const QString& surveyId,
+        const QList<QByteArray>& digests, const QByteArray& aggregate,
+        qint64 position);
+    void removeDelegateAggregation(const QString& surveyId);
+    void transaction();
+    void commit();
+    void rollback();
+    // Converts survey data and responses stored as JSON by earlier versions
+    // in the background, until that has finished once. Only the daemon does
+    // this, so it doesn't compete with the UI for writes.
+    void startLegacyBlobMigration();
 
 private:
-    QSqlDatabase db;
+    mutable SqliteConnectionPool pool;
+    QThreadStorage<int> transactionDepths;
+    // Guards the in-memory state below, which all threads share.
+    mutable QMutex stateMutex;
+    // By data key, for the keys that are sketched instead of stored.
+    QHash<QString, DataSketch> sketches;
+    // Every key with data points, so checking for one doesn't need a query.
+    // May include keys whose insert was rolled back later.
+    QSet<QString> knownKeys;
+    // Parsed survey_data by survey ID, it doesn't change once stored.
+    mutable QHash<QString, QSharedPointer<Survey>> surveyCache;
+    // All survey records by survey ID. Changes are written back on commit.
+    QHash<QString, QSharedPointer<SurveyRecord>> surveyRecords;
+    QMap<SurveyState, QSet<QString>> surveyRecordsByState;
+    // IDs of the survey records changed in the current transaction.
+    QThreadStorage<QSet<QString>> dirtySurveyRecords;
+    QScopedPointer<QThread> blobMigration;
+    std::atomic<bool> stopping { false };
+
+    QSqlDatabase database() const;
+    QSqlQuery& preparedQuery(const QString& statement) const;
+    // Like commit(), but reports whether the changes were stored. A failed
+    // outermost commit is rolled back.
+    bool tryCommit();
+    // Adds the key's data points of a batch, writing the sketch once.
+    bool addToSketch(const QString& key, const QList<DataPoint>& dataPoints);
+    QSharedPointer<Survey> parseSurvey(
+        const QString& surveyId, const QByteArray& data) const;
+    void loadSurveyRecords();
+    void cacheSurveyRecord(const SurveyRecord& record);
+    void writeSurveyRecords();
+    void loadKnownKeys();
+    void loadSketches();
+    bool saveSketch(const QString& key, const QByteArray& data);
+    void migrateLegacyBlobs();
+    // Returns whether all rows were converted, rather than stopped early.
+    bool migrateLegacyBlobs(const QString& table, const QString& column,
+        const std::function<std::optional<QByteArray>(const QByteArray&)>&
+            convert);
     SurveyResponseRecord createSurveyResponseRecord(const QByteArray& data,
         const QString& surveyId, const QDateTime& createdAt) const;
 };
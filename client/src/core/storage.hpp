@@ -1,6 +1,7 @@
 #pragma once
 
 #include <QtCore>
+#include <functional>
 #include <core/survey.hpp>
 
 #include "survey_record.hpp"
@@ -19,19 +20,57 @@ struct SurveyResponseRecord {
     QDateTime createdAt;
 };
 
+// Where a delegate stands with the messages of the other group members.
+struct DelegateAggregation {
+    // The server's cursor after the last message received, 0 before the first.
+    qint64 position = 0;
+    // Messages folded into the aggregate so far.
+    int count = 0;
+    // Their encrypted sum as EncryptedSurveyResponse JSON, empty before the
+    // first.
+    QByteArray aggregate;
+};
+
 class Storage {
 public:
     virtual ~Storage() {};
     virtual QList<DataPoint> listDataPoints(const QString& key = "") const = 0;
+    // Calls the callback with the data points for the key, or all of them for
+    // an empty key, one row at a time instead of building a list. Stops when
+    // the callback returns false.
+    virtual void forEachDataPoint(const QString& key,
+        const std::function<bool(const DataPoint&)>& callback) const = 0;
     virtual void addDataPoint(const QString& key, const QString& value) = 0;
+    // Adds all data points in one transaction. Safe to call from any thread.
+    // Returns false if they couldn't be stored, then none of them are.
+    virtual bool addDataPoints(const QList<DataPoint>& dataPoints) = 0;
+    virtual std::optional<DataPoint> findLatestDataPoint(
+        const QString& key) const = 0;
+    // Keys are case-sensitive here like everywhere else, so a survey is only
+    // signed up for when its cohorts can actually be counted.
     virtual bool checkIfDataPointPresent(const QString& key) const = 0;
+    // Keeps a DataSketch for the key from now on instead of its data points,
+    // folding in the ones stored so far. Can't be undone. Returns false if
+    // that failed, the data points are kept as they were then.
+    virtual bool enableSketch(const QString& key) = 0;
+    // Counts the data points matching each cohort of the given queries, which
+    // all have to refer to key, by query ID. Returns an empty hash if there
+    // are no data points for the key at all.
+    virtual QHash<QString, QMap<QString, int>> countCohorts(const QString& key,
+        const QList<QSharedPointer<Query>>& queries) const = 0;
     virtual QList<SurveyResponseRecord> listSurveyResponses() const = 0;
+    // Like forEachDataPoint, for all survey responses.
+    virtual void forEachSurveyResponse(
+        const std::function<bool(const SurveyResponseRecord&)>& callback) const
+        = 0;
     virtual void addSurveyResponse(
         const SurveyResponse& response, const Survey& survey)
         = 0;
     virtual std::optional<SurveyResponseRecord> findSurveyResponseFor(
         const QString& surveyId) const = 0;
     virtual QList<SurveyRecord> listSurveyRecords() const = 0;
+    virtual QList<SurveyRecord> listSurveyRecords(
+        const SurveyState& state) const = 0;
     virtual void addSurveyRecord(const Survey& survey, const QString& clientId,
         const QString& publicKey, const QString& delegatePublicKey,
         const std::optional<QString>& aggregationPublicKey,
@@ -40,4 +79,24 @@ public:
     virtual void saveSurveyRecord(const SurveyRecord& record) = 0;
     virtual QSharedPointer<SurveyRecord> findSurveyRecordById(
         const QString& survey_id) const = 0;
+    // Delegates fold the messages they receive for a survey into a partial
+    // aggregate, kept until they posted the aggregation, so each message is
+    // fetched and folded once.
+    virtual DelegateAggregation findDelegateAggregation(
+        const QString& surveyId) const = 0;
+    // Whether the message with this digest was folded in already.
+    virtual bool checkIfDelegateMessageFolded(
+        const QString& surveyId, const QByteArray& digest) const = 0;
+    // Records the messages with these digests as folded in, replaces the
+    // aggregate and moves the cursor to position.
+    virtual void foldDelegateMessages(const QString& surveyId,
+        const QList<QByteArray>& digests, const QByteArray& aggregate,
+        qint64 position)
+        = 0;
+    virtual void removeDelegateAggregation(const QString& surveyId) = 0;
+    // Groups the following changes until the matching commit or rollback.
+    // Transactions can be nested.
+    virtual void transaction() = 0;
+    virtual void commit() = 0;
+    virtual void rollback() = 0;
 };
@@ -1,14 +1,78 @@
 #include "survey.hpp"
 
+#include "interval.hpp"
+
+namespace {
+// First element of the CBOR array, increased for incompatible changes.
+const int cborFormatVersion = 1;
+
+// Bounded before narrowing to int, so huge counts can't wrap into valid ones
+// and are rejected by Histogram.
+int toBucketCount(qint64 value)
+{
+    return static_cast<int>(
+        qBound<qint64>(0, value, Histogram::maxBucketCount + 1));
+}
+
+Histogram histogramFromJsonObject(const QJsonObject& object)
+{
+    return Histogram(object["start"].toDouble(), object["width"].toDouble(),
+        toBucketCount(object["bucket_count"].toInteger()));
+}
+
+QJsonObject histogramToJsonObject(const Histogram& histogram)
+{
+    QJsonObject object;
+    object["start"] = histogram.getStart();
+    object["width"] = histogram.getWidth();
+    object["bucket_count"] = histogram.getBucketCount();
+    return object;
+}
+}
+
 Query::Query(const QString& id, const QString& dataKey,
-    const QList<QString>& cohorts, const bool& discrete)
+    const QList<QString>& cohorts, const bool& discrete, const bool& latest)
     : id(id)
     , dataKey(dataKey)
     , cohorts(cohorts)
     , discrete(discrete)
+    , latest(latest)
 {
 }
 
+Query::Query(const QString& id, const QString& dataKey,
+    const Histogram& histogram, const bool& latest)
+    : id(id)
+    , dataKey(dataKey)
+    , cohorts(histogram.getCohorts())
+    , discrete(false)
+    , histogram(histogram)
+    , latest(latest)
+{
+}
+
+QList<QString> Query::matchingCohorts(const QString& value) const
+{
+    if (histogram.has_value())
+        return { cohorts[histogram->bucketOf(value.toDouble()) + 1] };
+
+    QList<QString> matching;
+    for (const auto& cohort : cohorts) {
+        if (discrete) {
+            if (cohort == value)
+                matching.append(cohort);
+            continue;
+        }
+        try {
+            if (Interval(cohort).isInInterval(value.toDouble()))
+                matching.append(cohort);
+        } catch (const std::invalid_argument&) {
+            // Invalid cohorts just don't match anything.
+        }
+    }
+    return matching;
+}
+
 Survey::Survey(const QString& id, const QString& name)
     : id(id)
     , name(name)
@@ -32,6 +96,16 @@ Result<QSharedPointer<Survey>> Survey::fromByteArray(const QByteArray& data)
             const auto queryObject = item.toObject();
             const auto queryId = queryObject["id"].toString();
             const auto dataKey = queryObject["data_key"].toString();
+            const auto latest = queryObject["latest"].toBool();
+
+            if (const auto histogramValue = queryObject["histogram"];
+                histogramValue.isObject()) {
+                const auto histogram
+                    = histogramFromJsonObject(histogramValue.toObject());
+                survey->queries.push_back(QSharedPointer<Query>::create(
+                    queryId, dataKey, histogram, latest));
+                continue;
+            }
 
             QList<QString> cohorts;
             for (const auto& cohortItem : queryObject["cohorts"].toArray()) {
@@ -40,11 +114,13 @@ Result<QSharedPointer<Survey>> Survey::fromByteArray(const QByteArray& data)
 
             const auto discrete = queryObject["discrete"].toBool();
             survey->queries.push_back(QSharedPointer<Query>::create(
-                queryId, dataKey, cohorts, discrete));
+                queryId, dataKey, cohorts, discrete, latest));
         }
         return Result(survey);
     } catch (const QJsonParseError& error) {
         return Result<QSharedPointer<Survey>>::Failure(error.errorString());
+    } catch (const std::invalid_argument& error) {
+        return Result<QSharedPointer<Survey>>::Failure(error.what());
     }
 }
 
@@ -83,6 +159,14 @@ QByteArray Survey::toByteArray() const
         QJsonObject queryObject;
         queryObject["id"] = query->id;
         queryObject["data_key"] = query->dataKey;
+        queryObject["latest"] = query->latest;
+
+        if (query->histogram.has_value()) {
+            queryObject["histogram"]
+                = histogramToJsonObject(query->histogram.value());
+            queriesArray.append(queryObject);
+            continue;
+        }
 
         QJsonArray cohortsArray;
         for (const auto& cohort : query->cohorts) {
@@ -99,3 +183,77 @@ QByteArray Survey::toByteArray() const
     const QJsonDocument doc(object);
     return doc.toJson(QJsonDocument::Compact);
 }
+
+Result<QSharedPointer<Survey>> Survey::fromCbor(const QByteArray& data)
+{
+    QCborParserError error;
+    const auto array = QCborValue::fromCbor(data, &error).toArray();
+    if (error.error != QCborError::NoError)
+        return Result<QSharedPointer<Survey>>::Failure(error.errorString());
+    if (array.at(0).toInteger() != cborFormatVersion)
+        return Result<QSharedPointer<Survey>>::Failure(
+            "Unsupported survey format version");
+
+    try {
+        auto survey = QSharedPointer<Survey>::create(
+            array.at(1).toString(), array.at(2).toString());
+        // Like the JSON format, a survey without commissioner keeps none.
+        if (const auto commissioner = array.at(3); commissioner.isString())
+            survey->commissioner
+                = QSharedPointer<Commissioner>::create(commissioner.toString());
+
+        for (const auto& item : array.at(4).toArray()) {
+            const auto queryArray = item.toArray();
+            const auto queryId = queryArray.at(0).toString();
+            const auto dataKey = queryArray.at(1).toString();
+            const auto discrete = queryArray.at(2).toBool();
+            const auto latest = queryArray.at(3).toBool();
+
+            if (const auto histogramValue = queryArray.at(5);
+                histogramValue.isArray()) {
+                const auto histogramArray = histogramValue.toArray();
+                const Histogram histogram(histogramArray.at(0).toDouble(),
+                    histogramArray.at(1).toDouble(),
+                    toBucketCount(histogramArray.at(2).toInteger()));
+                survey->queries.push_back(QSharedPointer<Query>::create(
+                    queryId, dataKey, histogram, latest));
+                continue;
+            }
+
+            QList<QString> cohorts;
+            for (const auto& cohortItem : queryArray.at(4).toArray())
+                cohorts.append(cohortItem.toString());
+            survey->queries.push_back(QSharedPointer<Query>::create(
+                queryId, dataKey, cohorts, discrete, latest));
+        }
+        return Result(survey);
+    } catch (const std::invalid_argument& error) {
+        return Result<QSharedPointer<Survey>>::Failure(error.what());
+    }
+}
+
+QByteArray Survey::toCbor() const
+{
+    QCborArray queriesArray;
+    for (const auto& query : queries) {
+        // Histogram cohorts are derived, only the histogram is stored.
+        QCborArray cohortsArray;
+        QCborValue histogramValue(QCborValue::Null);
+        if (query->histogram.has_value()) {
+            const auto& histogram = query->histogram.value();
+            histogramValue = QCborArray { histogram.getStart(),
+                histogram.getWidth(), histogram.getBucketCount() };
+        } else {
+            for (const auto& cohort : query->cohorts)
+                cohortsArray.append(cohort);
+        }
+        queriesArray.append(QCborArray { query->id, query->dataKey,
+            query->discrete, query->latest, cohortsArray, histogramValue });
+    }
+
+    const QCborArray array { cborFormatVersion, id, name,
+        commissioner ? QCborValue(commissioner->name)
+                     : QCborValue(QCborValue::Null),
+        queriesArray };
+    return QCborValue(array).toCbor();
+}
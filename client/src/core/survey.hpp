@@ -5,6 +5,7 @@
 #include <QtCore>
 
 #include <core/commissioner.hpp>
+#include <core/histogram.hpp>
 
 class Query {
 public:
@@ -12,9 +13,20 @@ public:
     const QString dataKey;
     const QList<QString> cohorts;
     const bool discrete;
+    // If set, cohorts are derived from it.
+    const std::optional<Histogram> histogram;
+    // Whether only the most recent data point for the key counts, e.g. for
+    // keys describing the current state of the system.
+    const bool latest;
 
     explicit Query(const QString& id, const QString& dataKey,
-        const QList<QString>& cohorts, const bool& discrete);
+        const QList<QString>& cohorts, const bool& discrete,
+        const bool& latest = false);
+
+    Query(const QString& id, const QString& dataKey,
+        const Histogram& histogram, const bool& latest = false);
+
+    QList<QString> matchingCohorts(const QString& value) const;
 };
 
 class Survey {
@@ -32,4 +44,15 @@ public:
     static Result<QSharedPointer<Survey>> fromByteArray(const QByteArray& data);
 
     QByteArray toByteArray() const;
+
+    /**
+     * Reads the compact binary form written by toCbor.
+     */
+    static Result<QSharedPointer<Survey>> fromCbor(const QByteArray& data);
+
+    /**
+     * Returns the survey as a versioned CBOR array, for storage. Much smaller
+     * and faster to read than the JSON form.
+     */
+    QByteArray toCbor() const;
 };
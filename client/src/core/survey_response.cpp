@@ -2,6 +2,11 @@
 
 #include "result.hpp"
 
+namespace {
+// First element of the CBOR array, increased for incompatible changes.
+const int cborFormatVersion = 1;
+}
+
 QueryResponse::QueryResponse(
     const QString& queryId, const QMap<QString, int>& cohortData)
     : queryId(queryId)
@@ -135,6 +140,49 @@ QByteArray SurveyResponse::toJsonByteArray() const
     return root.toJson();
 }
 
+Result<QSharedPointer<SurveyResponse>> SurveyResponse::fromCbor(
+    const QByteArray& data)
+{
+    QCborParserError error;
+    const auto array = QCborValue::fromCbor(data, &error).toArray();
+    if (error.error != QCborError::NoError)
+        return Result<QSharedPointer<SurveyResponse>>::Failure(
+            error.errorString());
+    if (array.at(0).toInteger() != cborFormatVersion)
+        return Result<QSharedPointer<SurveyResponse>>::Failure(
+            "Unsupported survey response format version");
+
+    auto response
+        = QSharedPointer<SurveyResponse>::create(array.at(1).toString());
+    for (const auto& item : array.at(2).toArray()) {
+        const auto queryResponseArray = item.toArray();
+        const auto cohortMap = queryResponseArray.at(1).toMap();
+        QMap<QString, int> cohortData;
+        for (auto it = cohortMap.constBegin(); it != cohortMap.constEnd(); ++it)
+            cohortData.insert(it.key().toString(),
+                static_cast<int>(it.value().toInteger()));
+        response->queryResponses.append(QSharedPointer<QueryResponse>::create(
+            queryResponseArray.at(0).toString(), cohortData));
+    }
+    return Result(response);
+}
+
+QByteArray SurveyResponse::toCbor() const
+{
+    QCborArray queryResponsesArray;
+    for (const auto& queryResponse : queryResponses) {
+        QCborMap cohortMap;
+        for (auto it = queryResponse->cohortData.constBegin();
+             it != queryResponse->cohortData.constEnd(); ++it)
+            cohortMap.insert(it.key(), it.value());
+        queryResponsesArray.append(
+            QCborArray { queryResponse->queryId, cohortMap });
+    }
+    return QCborValue(
+        QCborArray { cborFormatVersion, surveyId, queryResponsesArray })
+        .toCbor();
+}
+
 QSharedPointer<EncryptedSurveyResponse> SurveyResponse::encrypt(
     const QSharedPointer<HomomorphicEncryptor>& encryptor) const
 {
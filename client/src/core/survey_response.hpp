@@ -39,6 +39,17 @@ public:
 
     QByteArray toJsonByteArray() const;
 
+    /**
+     * Reads the compact binary form written by toCbor.
+     */
+    static Result<QSharedPointer<SurveyResponse>> fromCbor(
+        const QByteArray& data);
+
+    /**
+     * Returns the response as a versioned CBOR array, for storage.
+     */
+    QByteArray toCbor() const;
+
     QSharedPointer<EncryptedSurveyResponse> encrypt(
         const QSharedPointer<HomomorphicEncryptor>& encryptor) const;
 
@@ -0,0 +1,18 @@
+#include "async_tasks.hpp"
+
+Completion createCompletion()
+{
+    auto completion
+        = Completion(new QPromise<void>, [](QPromise<void>* promise) {
+              promise->finish();
+              delete promise;
+          });
+    completion->start();
+    return completion;
+}
+
+void holdUntilFinished(const Completion& completion, QFuture<void> future)
+{
+    // Only releases the completion, which is fine on any thread.
+    future.then([completion]() {}).onCanceled([completion]() {});
+}
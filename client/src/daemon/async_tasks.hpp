@@ -0,0 +1,21 @@
+#pragma once
+
+#include <QtCore>
+#include <functional>
+
+using Completion = QSharedPointer<QPromise<void>>;
+using AsyncTask = std::function<QFuture<void>()>;
+
+/**
+ * Creates a promise whose future finishes once the last copy of the returned
+ * pointer is gone. Each step of an asynchronous pipeline holds a copy in its
+ * continuation, so the pipeline is done as soon as no step is pending anymore,
+ * however it ended. Stands in for unwrapping nested futures, which Qt 6.2
+ * can't do yet.
+ */
+Completion createCompletion();
+
+/**
+ * Keeps the completion from finishing before the future has, however it ends.
+ */
+void holdUntilFinished(const Completion& completion, QFuture<void> future);
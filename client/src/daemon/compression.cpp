@@ -0,0 +1,62 @@
+#include <zlib.h>
+
+#include "compression.hpp"
+
+namespace {
+// Tells zlib to write and read gzip headers instead of zlib ones.
+const int gzipWindowBits = MAX_WBITS + 16;
+const qsizetype chunkSize = 16384;
+}
+
+QByteArray gzip(const QByteArray& data)
+{
+    z_stream stream {};
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+            gzipWindowBits, 8, Z_DEFAULT_STRATEGY)
+        != Z_OK)
+        return {};
+
+    QByteArray compressed(
+        deflateBound(&stream, data.size()), Qt::Uninitialized);
+    stream.next_in
+        = reinterpret_cast<Bytef*>(const_cast<char*>(data.constData()));
+    stream.avail_in = data.size();
+    stream.next_out = reinterpret_cast<Bytef*>(compressed.data());
+    stream.avail_out = compressed.size();
+    // The output buffer is large enough to finish in one call.
+    const auto result = deflate(&stream, Z_FINISH);
+    compressed.resize(stream.total_out);
+    deflateEnd(&stream);
+    if (result != Z_STREAM_END)
+        return {};
+    return compressed;
+}
+
+std::optional<QByteArray> gunzip(const QByteArray& data, qsizetype maxSize)
+{
+    z_stream stream {};
+    if (inflateInit2(&stream, gzipWindowBits) != Z_OK)
+        return std::nullopt;
+
+    QByteArray decompressed;
+    stream.next_in
+        = reinterpret_cast<Bytef*>(const_cast<char*>(data.constData()));
+    stream.avail_in = data.size();
+    int result = Z_OK;
+    while (result == Z_OK) {
+        const auto offset = decompressed.size();
+        const auto available = qMin(chunkSize, maxSize + 1 - offset);
+        if (available <= 0)
+            break;
+        decompressed.resize(offset + available);
+        stream.next_out
+            = reinterpret_cast<Bytef*>(decompressed.data() + offset);
+        stream.avail_out = available;
+        result = inflate(&stream, Z_NO_FLUSH);
+        decompressed.resize(stream.total_out);
+    }
+    inflateEnd(&stream);
+    if (result != Z_STREAM_END || decompressed.size() > maxSize)
+        return std::nullopt;
+    return decompressed;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <QtCore>
+#include <optional>
+
+/**
+ * Compresses the data in the gzip format, as sent with
+ * "Content-Encoding: gzip".
+ */
+QByteArray gzip(const QByteArray& data);
+
+/**
+ * Decompresses gzip data. Returns nothing if the data is corrupt, truncated or
+ * would decompress to more than maxSize bytes.
+ */
+std::optional<QByteArray> gunzip(const QByteArray& data, qsizetype maxSize);
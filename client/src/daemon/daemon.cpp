@@ -2,7 +2,6 @@
 #include <QRegularExpression>
 #include <QTextStream>
 
-#include "core/interval.hpp"
 #include "core/storage.hpp"
 #include "core/survey_response.hpp"
 #include "daemon.hpp"
@@ -10,36 +9,112 @@
 #include "encryption.hpp"
 
 Daemon::Daemon(QObject* parent, QSharedPointer<Storage> storage,
-    QSharedPointer<Network> network, QSharedPointer<Encryption> encryption)
+    QSharedPointer<Network> network, QSharedPointer<Encryption> encryption,
+    int maxInFlight)
     : QObject(parent)
     , storage(storage)
     , network(network)
     , encryption(encryption)
-    , dbusService(storage)
+    , ingestionQueue(storage)
+    , dbusService(ingestionQueue)
+    , planner(storage)
+    , tasks(this, maxInFlight)
+    , signupEvents(network)
 {
     if (auto object = dynamic_cast<QObject*>(network.get()))
         object->setParent(this);
+    connect(&signupEvents, &SignupEventChannel::changed, this, &Daemon::wake);
 }
 
 void Daemon::run()
 {
     qDebug() << "Processing started.";
 
-    qDebug() << "Stored datapoints:";
-    for (const auto& dataPoint : storage->listDataPoints())
-        qDebug() << "-" << dataPoint.value;
+    // Work with everything submitted so far, once the writer has caught up.
+    // Waiting would block D-Bus calls, which are served on this thread too.
+    ingestionQueue.flush().then(this, [this](bool stored) {
+        if (!stored)
+            qDebug() << "Error: Unable to store submitted data points, "
+                        "working with the ones stored.";
+        process();
+    });
+}
+
+void Daemon::process()
+{
+    for (const auto& key : ingestionQueue.takeStoredKeys())
+        planner.invalidate(key);
+    const auto stats = ingestionQueue.stats();
+    qDebug() << "Ingestion queue: depth" << stats.depth << "max depth"
+             << stats.maxDepth << "stored" << stats.stored << "rejected"
+             << stats.rejected << "failures" << stats.failures
+             << "average latency" << stats.averageLatencyMs
+             << "ms, max latency" << stats.maxLatencyMs << "ms";
 
     qDebug() << "Survey signups:";
     for (const auto& record : storage->listSurveyRecords())
         qDebug() << "-" << record.survey->id << "as" << record.clientId
                  << "state:" << record.getState();
 
-    qDebug() << "Processing surveys ...";
-    processSurveys();
-    qDebug() << "Processing signups ...";
-    processSignups();
-    qDebug() << "Processing finished.";
-    emit finished();
+    const auto now = QDateTime::currentDateTimeUtc();
+    const auto retryAfter = network->retryAfter();
+    scheduler.notBefore(retryAfter);
+    // Everything shares the task queue, which puts the signups first.
+    const auto completion = createCompletion();
+    holdUntilFinished(completion, processSignups());
+    if ((!surveysDue.isValid() || surveysDue <= now)
+        && (!retryAfter.isValid() || retryAfter <= now)) {
+        surveysDue = now.addMSecs(surveysInterval.count());
+        holdUntilFinished(completion, processSurveys());
+    }
+    completion->future().then(this, [this]() {
+        const auto queueStats = tasks.stats();
+        for (auto it = queueStats.cbegin(); it != queueStats.cend(); ++it) {
+            qDebug() << "Task queue:" << static_cast<TaskPriority>(it.key())
+                     << "started" << it->started << "average delay"
+                     << it->averageDelayMs << "ms, max delay"
+                     << it->maxDelayMs << "ms";
+        }
+        qDebug() << "Processing finished.";
+        emit finished();
+    });
+}
+
+std::chrono::milliseconds Daemon::nextRunDelay() const
+{
+    auto next = surveysDue;
+    const auto signupsDue = scheduler.nextDue();
+    if (signupsDue.isValid() && (!next.isValid() || signupsDue < next))
+        next = signupsDue;
+    const auto retryAfter = network->retryAfter();
+    if (retryAfter.isValid() && (!next.isValid() || retryAfter > next))
+        next = retryAfter;
+    if (!next.isValid())
+        return minRunDelay;
+
+    const std::chrono::milliseconds delay(
+        QDateTime::currentDateTimeUtc().msecsTo(next));
+    return std::max(delay, minRunDelay);
+}
+
+QMap<int, TaskQueue::Stats> Daemon::taskQueueStats() const
+{
+    return tasks.stats();
+}
+
+void Daemon::listenForSignupEvents()
+{
+    signupEvents.start();
+}
+
+void Daemon::wake(const QString& clientId)
+{
+    const auto surveyId = watchedSurveyIds.value(clientId);
+    if (surveyId.isEmpty())
+        return;
+    qDebug() << "Signup event for survey" << surveyId;
+    scheduler.wake(surveyId, QDateTime::currentDateTimeUtc());
+    emit woken();
 }
 
 bool Daemon::checkIfAllDataKeysArePresent(
@@ -52,27 +127,40 @@ bool Daemon::checkIfAllDataKeysArePresent(
     return true;
 }
 
-void Daemon::handleSurveysResponse(const QByteArray& data)
+void Daemon::handleSurveysResponse(
+    const ConditionalReply& reply, const Completion& completion)
 {
     using Qt::endl;
 
     QTextStream cout(stdout);
-    const auto surveysParsingResult = Survey::listFromByteArray(data);
-
-    if (!surveysParsingResult.isSuccess()) {
-        qWarning() << "Error occured while parsing surveys:"
-                   << surveysParsingResult.getErrorMessage();
-        return;
+    QList<QSharedPointer<Survey>> surveys;
+    if (reply.modified) {
+        const auto updateResult = catalog.update(reply.data, reply.etag);
+        if (!updateResult.isSuccess()) {
+            qWarning() << "Error occured while parsing surveys:"
+                       << updateResult.getErrorMessage();
+            return;
+        }
+        surveys = updateResult.getValue();
+        qDebug() << "Fetched surveys:" << catalog.count()
+                 << "changed:" << surveys.count();
     }
 
-    auto surveys = surveysParsingResult.getValue();
-
-    qDebug() << "Fetched surveys:" << surveys.count();
+    // Surveys that were left out before may qualify by now.
+    QSet<QString> surveyIds;
+    for (const auto& survey : std::as_const(surveys))
+        surveyIds.insert(survey->id);
+    for (const auto& surveyId : std::exchange(pendingSurveyIds, {})) {
+        const auto survey = catalog.find(surveyId);
+        if (!survey.isNull() && !surveyIds.contains(surveyId))
+            surveys.append(survey);
+    }
 
     QSet<QString> signedUpSurveys;
     for (const auto& record : storage->listSurveyRecords())
         signedUpSurveys.insert(record.survey->id);
 
+    QList<QSharedPointer<const Survey>> newSurveys;
     for (const auto& survey : surveys) {
         if (signedUpSurveys.contains(survey->id))
             continue;
@@ -82,39 +170,109 @@ void Daemon::handleSurveysResponse(const QByteArray& data)
         if (survey->commissioner->name != kdeName)
             continue;
 
-        if (!checkIfAllDataKeysArePresent(survey))
+        if (!checkIfAllDataKeysArePresent(survey)) {
+            pendingSurveyIds.insert(survey->id);
             continue;
+        }
+
+        newSurveys.append(survey);
+    }
 
-        signUpForSurvey(survey);
+    for (qsizetype i = 0; i < newSurveys.count(); i += Network::maxBatchSize) {
+        const auto batch = newSurveys.mid(i, Network::maxBatchSize);
+        const auto signup = tasks.enqueue(
+            Discovery, [this, batch]() { return signUpForSurveys(batch); });
+        holdUntilFinished(completion, signup);
     }
 }
 
-void Daemon::processSurveys()
+QFuture<void> Daemon::processSurveys()
 {
-    auto data = network->listSurveys();
-    handleSurveysResponse(data);
+    // Done once the signups are, which are queued separately so they don't
+    // wait for the slot of this task.
+    const auto completion = createCompletion();
+    const auto listing = tasks.enqueue(Discovery, [this, completion]() {
+        qDebug() << "Processing surveys ...";
+        return network->listSurveys(catalog.etag())
+            .then(this, [this, completion](const ConditionalReply& reply) {
+                handleSurveysResponse(reply, completion);
+            });
+    });
+    holdUntilFinished(completion, listing);
+    return completion->future();
 }
 
-void Daemon::signUpForSurvey(const QSharedPointer<const Survey> survey)
+QFuture<void> Daemon::signUpForSurveys(
+    const QList<QSharedPointer<const Survey>>& surveys)
 {
-    qDebug() << "Signing up for survey" << survey->id;
-    auto publicKey = encryption->generateKeyPair();
-    auto data = network->surveySignup(survey->id, publicKey);
-    const auto responseObject = QJsonDocument::fromJson(data).object();
-    const auto clientId = responseObject["client_id"].toString();
-    storage->addSurveyRecord(
-        *survey, clientId, publicKey, "", std::nullopt, std::nullopt);
+    QHash<QString, QString> publicKeys;
+    for (const auto& survey : surveys) {
+        qDebug() << "Signing up for survey" << survey->id;
+        publicKeys.insert(survey->id, encryption->generateKeyPair());
+    }
+    return network->surveySignups(publicKeys).then(
+        this, [this, surveys, publicKeys](const QByteArray& data) {
+            const auto responseObject = QJsonDocument::fromJson(data).object();
+            const auto clientIds = responseObject["client_ids"].toObject();
+            storage->transaction();
+            for (const auto& survey : surveys) {
+                // Left out by the server for surveys it doesn't know anymore,
+                // or missing on errors. Tried again while they're listed.
+                const auto clientId = clientIds[survey->id].toString();
+                if (clientId.isEmpty()) {
+                    pendingSurveyIds.insert(survey->id);
+                    continue;
+                }
+                storage->addSurveyRecord(*survey, clientId,
+                    publicKeys.value(survey->id), "", std::nullopt,
+                    std::nullopt);
+            }
+            storage->commit();
+        });
 }
 
-void Daemon::processInitialSignup(SurveyRecord& record)
+QFuture<void> Daemon::processSignupStates(
+    const QList<SurveyRecord>& records, const Completion& completion)
 {
-    auto data = network->getSignupState(record.clientId);
-    const auto responseDocument = QJsonDocument::fromJson(data);
-    const auto responseObject = responseDocument.object();
-    if (!responseObject["aggregation_started"].toBool()) {
-        return;
-    }
+    QStringList clientIds;
+    for (const auto& record : records)
+        clientIds.append(record.clientId);
+    return network->getSignupStates(clientIds).then(
+        this, [this, records, completion](const QByteArray& data) {
+            const auto responseObject = QJsonDocument::fromJson(data).object();
+            const auto states = responseObject["states"].toObject();
+            const auto now = QDateTime::currentDateTimeUtc();
+            for (const auto& record : records) {
+                const auto state = states[record.clientId].toObject();
+                if (!state["aggregation_started"].toBool()) {
+                    scheduler.polled(
+                        record.survey->id, PollScheduler::Unchanged, now);
+                    continue;
+                }
+                scheduler.polled(
+                    record.survey->id, PollScheduler::Changed, now);
+
+                // Each record goes on in a task of its own, so its requests
+                // count against the limit like any other.
+                const auto delegatePublicKey
+                    = state["delegate_public_key"].toString();
+                const auto priority = record.publicKey == delegatePublicKey
+                    ? DelegateWork
+                    : MemberWork;
+                const auto next
+                    = tasks.enqueue(priority, [this, record, state]() {
+                          const auto recordCompletion = createCompletion();
+                          handleSignupState(record, state, recordCompletion);
+                          return recordCompletion->future();
+                      });
+                holdUntilFinished(completion, next);
+            }
+        });
+}
 
+void Daemon::handleSignupState(SurveyRecord record,
+    const QJsonObject& responseObject, const Completion& completion)
+{
     record.delegatePublicKey = responseObject["delegate_public_key"].toString();
     record.aggregationPublicKey
         = responseObject["aggregation_public_key_n"].toString();
@@ -128,40 +286,99 @@ void Daemon::processInitialSignup(SurveyRecord& record)
             qDebug() << "Directly posting data to server as groupSize "
                         "is 1";
             auto surveyResponse = createSurveyResponse(record.survey);
-            auto success = network->postAggregationResult(
-                record.clientId, surveyResponse->toJsonByteArray());
-            if (success) {
-                storage->addSurveyResponse(*surveyResponse, *record.survey);
-                storage->saveSurveyRecord(record);
-            }
+            network
+                ->postAggregationResult(
+                    record.clientId, surveyResponse->toJsonByteArray())
+                .then(this,
+                    [this, record, surveyResponse, completion](bool success) {
+                        if (!success)
+                            return;
+                        storage->transaction();
+                        storage->addSurveyResponse(
+                            *surveyResponse, *record.survey);
+                        storage->saveSurveyRecord(record);
+                        storage->commit();
+                        scheduler.remove(record.survey->id);
+                    });
             return;
         }
 
-        processMessagesForDelegate(record);
+        storage->saveSurveyRecord(record);
+        processMessagesForDelegate(record, completion);
     } else {
+        storage->saveSurveyRecord(record);
         qDebug() << "Sending data to delegate";
-        postMessageToDelegate(record);
+        postMessageToDelegate(record, completion);
     }
-
-    storage->saveSurveyRecord(record);
 }
 
-void Daemon::processSignups()
+QFuture<void> Daemon::processSignups()
 {
-    auto surveyRecords = storage->listSurveyRecords();
-    for (auto surveyRecord : surveyRecords) {
-        if (surveyRecord.getState() == Initial) {
-            processInitialSignup(surveyRecord);
+    // Records that are done need nothing anymore.
+    const auto now = QDateTime::currentDateTimeUtc();
+    QList<SurveyRecord> surveyRecords;
+    watchedSurveyIds.clear();
+    for (const auto& surveyRecord : storage->listSurveyRecords(Initial)
+            + storage->listSurveyRecords(Processing)) {
+        if (!surveyRecord.clientId.isEmpty())
+            watchedSurveyIds.insert(
+                surveyRecord.clientId, surveyRecord.survey->id);
+        if (scheduler.isDue(surveyRecord.survey->id, now))
+            surveyRecords.append(surveyRecord);
+    }
+    const auto clientIds = watchedSurveyIds.keys();
+    signupEvents.watch({ clientIds.cbegin(), clientIds.cend() });
+
+    QList<QSharedPointer<Survey>> pendingSurveys;
+    for (const auto& surveyRecord : surveyRecords)
+        pendingSurveys.append(surveyRecord.survey);
+    planner.plan(pendingSurveys);
+
+    qDebug() << "Processing signups ...";
+    const auto completion = createCompletion();
+    QList<SurveyRecord> initialRecords;
+    for (const auto& surveyRecord : surveyRecords) {
+        // Delegates the rest of the group waits for.
+        if (surveyRecord.getState() == Processing
+            && surveyRecord.publicKey == surveyRecord.delegatePublicKey) {
+            const auto signup = tasks.enqueue(DelegateWork,
+                [this, surveyRecord]() { return processSignup(surveyRecord); });
+            holdUntilFinished(completion, signup);
             continue;
         }
-        if (surveyRecord.getState() != Processing
-            || surveyRecord.publicKey != surveyRecord.delegatePublicKey)
-            continue;
-        processMessagesForDelegate(surveyRecord);
+        // Without a client ID there's no state to ask for.
+        if (!surveyRecord.clientId.isEmpty())
+            initialRecords.append(surveyRecord);
     }
+    // The others only learn whether their aggregation started, which is asked
+    // for in batches. That includes members whose message to the delegate
+    // didn't get through, they post it again then.
+    for (qsizetype i = 0; i < initialRecords.count();
+         i += Network::maxBatchSize) {
+        const auto batch = initialRecords.mid(i, Network::maxBatchSize);
+        const auto states
+            = tasks.enqueue(MemberWork, [this, batch, completion]() {
+                  return processSignupStates(batch, completion);
+              });
+        holdUntilFinished(completion, states);
+    }
+    return completion->future();
+}
+
+QFuture<void> Daemon::processSignup(const SurveyRecord& record)
+{
+    // The records' steps interleave on this thread, and transactions are per
+    // thread, so every step stores its changes in a transaction of its own
+    // instead of holding one open across requests.
+    const auto completion = createCompletion();
+    if (record.getState() == Processing
+        && record.publicKey == record.delegatePublicKey)
+        processMessagesForDelegate(record, completion);
+    return completion->future();
 }
 
-void Daemon::postMessageToDelegate(SurveyRecord& record) const
+void Daemon::postMessageToDelegate(
+    const SurveyRecord& record, const Completion& completion)
 {
     if (!record.aggregationPublicKey.has_value()) {
         qWarning() << "AggregationKey is null, posting message failed.";
@@ -185,70 +402,92 @@ void Daemon::postMessageToDelegate(SurveyRecord& record) const
         dataEncryptedResponse->toJsonByteArray().toBase64());
     auto encryptedResponseString
         = encryption->encrypt(responseString, record.delegatePublicKey);
-    auto success = network->postMessageToDelegate(
-        record.delegatePublicKey, encryptedResponseString);
-    // TODO do we need to copy everything?
-    if (!success)
-        return;
-
-    // implicitely this will set the state to __Done__
-    storage->addSurveyResponse(*response, *record.survey);
+    network
+        ->postMessageToDelegate(
+            record.delegatePublicKey, encryptedResponseString)
+        .then(this, [this, record, response, completion](bool success) {
+            // TODO do we need to copy everything?
+            if (!success)
+                return;
+
+            // implicitely this will set the state to __Done__
+            storage->addSurveyResponse(*response, *record.survey);
+            scheduler.remove(record.survey->id);
+        });
 }
 
-void Daemon::processMessagesForDelegate(SurveyRecord& record)
+void Daemon::processMessagesForDelegate(
+    const SurveyRecord& record, const Completion& completion)
 {
     qDebug() << "ClientId:" << record.clientId;
-    auto data = network->getMessagesForDelegate(record.clientId);
-    if (!record.groupSize.has_value()) {
-        return;
-    }
-
-    const auto responsesParsingResult
-        = parseResponseMessages(data, record.groupSize.value());
-
-    if (!responsesParsingResult.isSuccess()) {
-        qWarning() << "Error parsing other clients responses"
-                   << responsesParsingResult.getErrorMessage();
-        return;
-    }
-
-    // TODO: The empty response returned in responsesParsingResult for a
-    // mismatch between group size and the amount of messages leads to a
-    // successful result without value. We should probably handle that
-    // differently, but this at least prevents a crash.
-    if (!responsesParsingResult.hasValue()) {
-        qWarning() << "Waiting for remaining messages...";
-        return;
-    }
-
-    auto responses = responsesParsingResult.getValue();
+    const auto since
+        = storage->findDelegateAggregation(record.survey->id).position;
+    network->getMessagesForDelegate(record.clientId, since)
+        .then(this, [this, record, completion](const QByteArray& data) {
+            handleMessagesForDelegate(record, data, completion);
+        });
+}
 
-    if (responses.count() < (record.groupSize.value() - 1)) {
-        qDebug() << "Waiting for remaining messages...";
+void Daemon::handleMessagesForDelegate(const SurveyRecord& record,
+    const QByteArray& data, const Completion& completion)
+{
+    if (!record.groupSize.has_value()) {
+        scheduler.polled(record.survey->id, PollScheduler::Unchanged,
+            QDateTime::currentDateTimeUtc());
         return;
     }
 
     if (!record.aggregationPublicKey.has_value()) {
         qWarning() << "AggregationKey is null, processing messages failed.";
+        scheduler.polled(record.survey->id, PollScheduler::Unchanged,
+            QDateTime::currentDateTimeUtc());
         return;
     }
     const auto encryptorResult = PaillierEncryptor::createPaillierEncryptor(
         record.aggregationPublicKey.value());
     if (!encryptorResult.isSuccess()) {
-        qWarning() << "Posting message failed:"
+        qWarning() << "Processing messages failed:"
                    << encryptorResult.getErrorMessage();
+        scheduler.polled(record.survey->id, PollScheduler::Unchanged,
+            QDateTime::currentDateTimeUtc());
+        return;
+    }
+    const auto& encryptor = encryptorResult.getValue();
+
+    const auto& surveyId = record.survey->id;
+    // Empty when there's nothing new since the cursor or the request failed.
+    if (!data.isEmpty())
+        foldDelegateMessages(
+            surveyId, QJsonDocument::fromJson(data).object(), encryptor);
+    const auto aggregation = storage->findDelegateAggregation(surveyId);
+    scheduleMessagesPoll(record, aggregation.count);
+
+    if (aggregation.count < (record.groupSize.value() - 1)) {
+        qDebug() << "Waiting for remaining messages...";
         return;
     }
 
+    // The personal response is only computed once the group is complete, so
+    // it reflects the latest data.
     auto personalResponse = createSurveyResponse(record.survey);
-    auto encryptedPersonalResponse
-        = personalResponse->encrypt(encryptorResult.getValue());
-    responses.append(encryptedPersonalResponse);
+    QList<QSharedPointer<EncryptedSurveyResponse>> responses {
+        personalResponse->encrypt(encryptor)
+    };
+    if (!aggregation.aggregate.isEmpty()) {
+        const auto partialResult
+            = EncryptedSurveyResponse::fromJsonByteArray(aggregation.aggregate);
+        if (!partialResult.isSuccess()) {
+            qWarning() << "Error parsing the partial aggregate"
+                       << partialResult.getErrorMessage();
+            return;
+        }
+        responses.append(partialResult.getValue());
+    }
 
     qDebug() << "Personal response:" << personalResponse->toJsonByteArray();
     auto aggregationResult
         = EncryptedSurveyResponse::aggregateEncryptedSurveyResponses(
-            responses, encryptorResult.getValue());
+            responses, encryptor);
 
     if (!aggregationResult.isSuccess()) {
         qDebug() << "Aggregation unsuccessful:"
@@ -258,92 +497,101 @@ void Daemon::processMessagesForDelegate(SurveyRecord& record)
     const auto& aggregatedResponse = aggregationResult.getValue();
 
     qDebug() << "Aggregated Response:" << aggregatedResponse->toJsonByteArray();
-    auto success = network->postAggregationResult(
-        record.clientId, aggregatedResponse->toJsonByteArray());
-    if (!success)
-        return;
-    storage->addSurveyResponse(*personalResponse, *record.survey);
-    storage->saveSurveyRecord(record);
+    network
+        ->postAggregationResult(
+            record.clientId, aggregatedResponse->toJsonByteArray())
+        .then(this,
+            [this, record, personalResponse, completion](bool success) {
+                if (!success)
+                    return;
+                storage->transaction();
+                storage->addSurveyResponse(*personalResponse, *record.survey);
+                storage->saveSurveyRecord(record);
+                storage->removeDelegateAggregation(record.survey->id);
+                storage->commit();
+                scheduler.remove(record.survey->id);
+                receivedMessages.remove(record.survey->id);
+            });
 }
 
-Result<QList<QSharedPointer<EncryptedSurveyResponse>>>
-Daemon::parseResponseMessages(const QByteArray& data, int groupSize) const
+void Daemon::scheduleMessagesPoll(const SurveyRecord& record, int received)
 {
-    QList<QSharedPointer<EncryptedSurveyResponse>> responses {};
-    auto jsonDoc = QJsonDocument::fromJson(data);
+    // Delegates poll fast once only a few messages are missing, and back off
+    // while no new ones arrive.
+    const auto& surveyId = record.survey->id;
+    const auto expected = record.groupSize.value_or(1) - 1;
+    auto result = PollScheduler::Unchanged;
+    if (expected - received <= std::max(1, expected / 4))
+        result = PollScheduler::NearlyDone;
+    else if (received > receivedMessages.value(surveyId))
+        result = PollScheduler::Changed;
+    receivedMessages.insert(surveyId, received);
+    scheduler.polled(surveyId, result, QDateTime::currentDateTimeUtc());
+}
 
-    auto jsonObj = jsonDoc.object();
-    auto jsonArray = jsonObj["messages"].toArray();
-    if (jsonArray.count() < groupSize - 1)
-        return {};
+void Daemon::foldDelegateMessages(const QString& surveyId,
+    const QJsonObject& response,
+    const QSharedPointer<HomomorphicEncryptor>& encryptor)
+{
+    const auto aggregation = storage->findDelegateAggregation(surveyId);
+    QSharedPointer<EncryptedSurveyResponse> aggregate;
+    if (!aggregation.aggregate.isEmpty()) {
+        const auto parsingResult
+            = EncryptedSurveyResponse::fromJsonByteArray(aggregation.aggregate);
+        if (!parsingResult.isSuccess()) {
+            qWarning() << "Error parsing the partial aggregate"
+                       << parsingResult.getErrorMessage();
+            return;
+        }
+        aggregate = parsingResult.getValue();
+    }
 
-    for (const QJsonValue& value : jsonArray) {
-        auto encryptedString = value.toString();
+    QList<QByteArray> digests;
+    for (const QJsonValue& value : response["messages"].toArray()) {
         // TODO: We need the proper private key here
-        QString decryptedResponseString
-            = encryption->decrypt(encryptedString, "");
-        QByteArray jsonByteArray
+        const auto decryptedResponseString
+            = encryption->decrypt(value.toString(), "");
+        const auto jsonByteArray
             = QByteArray::fromBase64(decryptedResponseString.toLatin1());
-        auto parsingResult
+        // Messages sent again, e.g. by servers without cursors, are only
+        // folded in once.
+        const auto digest = QCryptographicHash::hash(
+            jsonByteArray, QCryptographicHash::Sha256);
+        if (digests.contains(digest)
+            || storage->checkIfDelegateMessageFolded(surveyId, digest))
+            continue;
+
+        // Skipped instead of folded in, the cursor moves past them either way.
+        const auto parsingResult
             = EncryptedSurveyResponse::fromJsonByteArray(jsonByteArray);
         if (!parsingResult.isSuccess()) {
-            return Result<QList<QSharedPointer<EncryptedSurveyResponse>>>::
-                Failure(parsingResult.getErrorMessage());
+            qWarning() << "Skipping invalid message:"
+                       << parsingResult.getErrorMessage();
+            continue;
         }
-        responses.append(parsingResult.getValue());
+        if (aggregate.isNull()) {
+            aggregate = parsingResult.getValue();
+        } else {
+            const auto foldResult
+                = EncryptedSurveyResponse::aggregateEncryptedSurveyResponses(
+                    { aggregate, parsingResult.getValue() }, encryptor);
+            if (!foldResult.isSuccess()) {
+                qWarning() << "Skipping message:"
+                           << foldResult.getErrorMessage();
+                continue;
+            }
+            aggregate = foldResult.getValue();
+        }
+        digests.append(digest);
     }
-    return Result(responses);
+
+    storage->foldDelegateMessages(surveyId, digests,
+        aggregate.isNull() ? QByteArray() : aggregate->toJsonByteArray(),
+        response["cursor"].toInteger());
 }
 
 QSharedPointer<SurveyResponse> Daemon::createSurveyResponse(
     const QSharedPointer<Survey>& survey) const
 {
-    auto surveyResponse = QSharedPointer<SurveyResponse>::create(survey->id);
-
-    for (const auto& query : survey->queries) {
-        auto queryResponse = createQueryResponse(query);
-        if (queryResponse == nullptr)
-            continue;
-        surveyResponse->queryResponses.append(queryResponse);
-    }
-    return surveyResponse;
-}
-
-QSharedPointer<QueryResponse> Daemon::createQueryResponse(
-    const QSharedPointer<Query>& query) const
-{
-    const auto dataPoints = storage->listDataPoints(query->dataKey);
-
-    qDebug() << "Datakey" << query->dataKey;
-
-    if (dataPoints.count() == 0)
-        return nullptr;
-
-    qDebug() << "Found dataPoints:" << dataPoints.count();
-
-    QMap<QString, int> cohortData;
-
-    for (const QString& cohort : query->cohorts) {
-        cohortData[cohort] = 0;
-
-        for (const DataPoint& dataPoint : dataPoints) {
-            if (query->discrete) {
-                if (cohort == dataPoint.value) {
-                    cohortData[cohort]++;
-                }
-                continue;
-            }
-            try {
-                auto interval = Interval(cohort);
-
-                if (interval.isInInterval(dataPoint.value.toDouble())) {
-                    cohortData[cohort]++;
-                }
-            } catch (std::invalid_argument) {
-                // Error handling here
-            }
-        }
-    }
-
-    return QSharedPointer<QueryResponse>::create(query->id, cohortData);
+    return planner.createSurveyResponse(survey);
 }
@@ -5,10 +5,17 @@
 #include <core/storage.hpp>
 #include <core/survey_response.hpp>
 
+#include "async_tasks.hpp"
 #include "core/survey.hpp"
 #include "dbus_service.hpp"
 #include "encryption.hpp"
+#include "ingestion_queue.hpp"
 #include "network.hpp"
+#include "poll_scheduler.hpp"
+#include "response_planner.hpp"
+#include "signup_event_channel.hpp"
+#include "survey_catalog.hpp"
+#include "task_queue.hpp"
 
 class Daemon : public QObject {
     Q_OBJECT
@@ -16,34 +23,102 @@ class Daemon : public QObject {
     friend class DaemonTest;
 
 public:
+    // Tasks are started in this order, by how much of a group waits for them.
+    enum TaskPriority { DelegateWork, MemberWork, Discovery };
+    Q_ENUM(TaskPriority)
+
+    static constexpr int defaultMaxInFlight = 4;
+    // New surveys are looked for at a fixed interval, survey records are
+    // polled when their schedule says so.
+    static constexpr std::chrono::milliseconds surveysInterval { 60000 };
+    // Runs aren't started closer together than this.
+    static constexpr std::chrono::milliseconds minRunDelay { 1000 };
+
+    /**
+     * Works on up to maxInFlight survey records at the same time, each of them
+     * waiting for its own requests.
+     */
     Daemon(QObject* parent, QSharedPointer<Storage> storage,
-        QSharedPointer<Network> network, QSharedPointer<Encryption> encryption);
+        QSharedPointer<Network> network, QSharedPointer<Encryption> encryption,
+        int maxInFlight = defaultMaxInFlight);
+
+    /**
+     * Returns how long to wait after a run before the next one has anything
+     * to do.
+     */
+    std::chrono::milliseconds nextRunDelay() const;
+
+    /**
+     * Returns how long tasks waited for one of the maxInFlight slots so far,
+     * by TaskPriority.
+     */
+    QMap<int, TaskQueue::Stats> taskQueueStats() const;
+
+    /**
+     * Starts listening for signup events, which make the affected records
+     * due right away.
+     */
+    void listenForSignupEvents();
 
 public slots:
     void run();
 
 signals:
     void finished();
+    // A record became due before the time nextRunDelay() returned.
+    void woken();
 
 private:
     QSharedPointer<Storage> storage;
     QSharedPointer<Network> network;
     QSharedPointer<Encryption> encryption;
+    IngestionQueue ingestionQueue;
     DBusService dbusService;
+    mutable ResponsePlanner planner;
+    TaskQueue tasks;
+    PollScheduler scheduler;
+    QDateTime surveysDue;
+    SurveyCatalog catalog;
+    // Listed surveys that weren't signed up for yet, for lack of data or a
+    // failed signup. They're looked at again on every run, even if the
+    // catalog didn't change.
+    QSet<QString> pendingSurveyIds;
+    // Messages the delegate records had on their last poll, by survey ID.
+    QHash<QString, int> receivedMessages;
+    SignupEventChannel signupEvents;
+    // Survey IDs of the records waiting for signup events, by client ID.
+    QHash<QString, QString> watchedSurveyIds;
 
+    // The rest of run(), once the submitted data points are stored.
+    void process();
     bool checkIfAllDataKeysArePresent(
         const QSharedPointer<Survey>& survey) const;
-    void handleSurveysResponse(const QByteArray& data);
-    void processSurveys();
-    void processInitialSignup(SurveyRecord& record);
-    void processSignups();
-    void postMessageToDelegate(SurveyRecord& record) const;
-    void processMessagesForDelegate(SurveyRecord& record);
+    void handleSurveysResponse(
+        const ConditionalReply& reply, const Completion& completion);
+    QFuture<void> processSurveys();
+    QFuture<void> processSignups();
+    QFuture<void> processSignup(const SurveyRecord& record);
+    // Fetches the states of the records in one request. Records whose
+    // aggregation started go on in tasks held by the completion.
+    QFuture<void> processSignupStates(
+        const QList<SurveyRecord>& records, const Completion& completion);
+    void handleSignupState(SurveyRecord record,
+        const QJsonObject& responseObject, const Completion& completion);
+    void postMessageToDelegate(
+        const SurveyRecord& record, const Completion& completion);
+    void processMessagesForDelegate(
+        const SurveyRecord& record, const Completion& completion);
+    void handleMessagesForDelegate(const SurveyRecord& record,
+        const QByteArray& data, const Completion& completion);
+    void scheduleMessagesPoll(const SurveyRecord& record, int received);
+    // Decrypts the new messages of a delegate poll and folds them into the
+    // stored partial aggregate.
+    void foldDelegateMessages(const QString& surveyId,
+        const QJsonObject& response,
+        const QSharedPointer<HomomorphicEncryptor>& encryptor);
+    void wake(const QString& clientId);
     QSharedPointer<SurveyResponse> createSurveyResponse(
         const QSharedPointer<Survey>&) const;
-    QSharedPointer<QueryResponse> createQueryResponse(
-        const QSharedPointer<Query>& query) const;
-    Result<QList<QSharedPointer<EncryptedSurveyResponse>>>
-    parseResponseMessages(const QByteArray& data, int groupSize) const;
-    void signUpForSurvey(const QSharedPointer<const Survey> survey);
+    QFuture<void> signUpForSurveys(
+        const QList<QSharedPointer<const Survey>>& surveys);
 };
@@ -1,10 +1,10 @@
 #include <QtDBus>
-#include <core/storage.hpp>
 
 #include "dbus_service.hpp"
+#include "ingestion_queue.hpp"
 
-detail::Data::Data(QSharedPointer<Storage> storage)
-    : storage(storage)
+detail::Data::Data(IngestionQueue& ingestionQueue)
+    : ingestionQueue(ingestionQueue)
 {
 }
 
@@ -12,12 +12,13 @@ QString detail::Data::submit_data_point(
     const QString& key, const QString& value)
 {
     qDebug() << "Received data point:" << key << "=" << value;
-    storage->addDataPoint(key, value);
+    if (!ingestionQueue.enqueue(key, value))
+        return "Too many data points, try again later";
     return "OK";
 }
 
-DBusService::DBusService(QSharedPointer<Storage> storage)
-    : data(storage)
+DBusService::DBusService(IngestionQueue& ingestionQueue)
+    : data(ingestionQueue)
 {
     auto connection = QDBusConnection::sessionBus();
 
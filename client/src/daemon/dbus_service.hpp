@@ -2,26 +2,26 @@
 
 #include <QtCore>
 
-class Storage;
+class IngestionQueue;
 
 namespace detail {
 class Data : public QObject {
     Q_OBJECT
 
 public:
-    Data(QSharedPointer<Storage> storage);
+    Data(IngestionQueue& ingestionQueue);
 
 public slots:
     QString submit_data_point(const QString& key, const QString& value);
 
 private:
-    QSharedPointer<Storage> storage;
+    IngestionQueue& ingestionQueue;
 };
 };
 
 class DBusService {
 public:
-    DBusService(QSharedPointer<Storage> storage);
+    DBusService(IngestionQueue& ingestionQueue);
 
 private:
     detail::Data data;
@@ -0,0 +1,193 @@
+#include "ingestion_queue.hpp"
+
+namespace {
+// How long the writer sleeps without submissions before checking again.
+const int idleTimeout = 1000;
+// Backoff between attempts to store a batch that failed, in milliseconds.
+const int minRetryDelay = 10;
+const int maxRetryDelay = 1000;
+// Consecutive failures after which the writer gives up while stopping.
+const int maxFailuresWhenStopping = 3;
+
+quint64 roundUpToPowerOfTwo(int value)
+{
+    quint64 result = 1;
+    while (result < static_cast<quint64>(value))
+        result <<= 1;
+    return result;
+}
+}
+
+IngestionQueue::IngestionQueue(QSharedPointer<Storage> storage, int capacity)
+    : storage(storage)
+    , entries(roundUpToPowerOfTwo(capacity))
+    , mask(entries.size() - 1)
+{
+    clock.start();
+    writer.reset(QThread::create([this]() { run(); }));
+    writer->start();
+}
+
+IngestionQueue::~IngestionQueue()
+{
+    // The writer drains the queue before it stops.
+    stopping = true;
+    pending.release();
+    writer->wait();
+    // Only left if the writer gave up.
+    QMutexLocker locker(&flushMutex);
+    finishFlushes(true);
+}
+
+bool IngestionQueue::enqueue(const QString& key, const QString& value)
+{
+    const auto currentHead = head.load(std::memory_order_relaxed);
+    const auto depth = currentHead - tail.load(std::memory_order_acquire);
+    if (depth >= entries.size()) {
+        rejected++;
+        return false;
+    }
+
+    auto& entry = entries[currentHead & mask];
+    entry.dataPoint = { .key = key,
+        .value = value,
+        .createdAt = QDateTime::currentDateTimeUtc() };
+    entry.enqueuedAt = clock.nsecsElapsed();
+    head.store(currentHead + 1, std::memory_order_release);
+
+    if (depth + 1 > maxDepth.load(std::memory_order_relaxed))
+        maxDepth.store(depth + 1, std::memory_order_relaxed);
+    pending.release();
+    return true;
+}
+
+QFuture<bool> IngestionQueue::flush()
+{
+    auto promise = QSharedPointer<QPromise<bool>>::create();
+    promise->start();
+    const auto target = head.load(std::memory_order_acquire);
+    {
+        QMutexLocker locker(&flushMutex);
+        flushes.append({ .target = target, .promise = promise });
+        finishFlushes(false);
+    }
+    pending.release();
+    return promise->future();
+}
+
+QSet<QString> IngestionQueue::takeStoredKeys()
+{
+    QMutexLocker locker(&flushMutex);
+    return std::exchange(storedKeys, {});
+}
+
+IngestionQueue::Stats IngestionQueue::stats() const
+{
+    const auto currentTail = tail.load(std::memory_order_acquire);
+    const auto stored = currentTail;
+    return { .depth = head.load(std::memory_order_acquire) - currentTail,
+        .maxDepth = maxDepth.load(std::memory_order_relaxed),
+        .stored = stored,
+        .rejected = rejected.load(std::memory_order_relaxed),
+        .failures = failures.load(std::memory_order_relaxed),
+        .averageLatencyMs = stored == 0
+            ? 0
+            : latencySum.load(std::memory_order_relaxed) / 1e6 / stored,
+        .maxLatencyMs = maxLatency.load(std::memory_order_relaxed) / 1e6 };
+}
+
+void IngestionQueue::run()
+{
+    int retryDelay = 0;
+    int failedAttempts = 0;
+    while (true) {
+        // Submissions don't cut the backoff short.
+        if (retryDelay > 0)
+            QThread::msleep(retryDelay);
+        else
+            pending.tryAcquire(1, idleTimeout);
+        auto result = storeBatch();
+        while (result == BatchResult::Stored)
+            result = storeBatch();
+        if (result == BatchResult::Failed) {
+            failedAttempts++;
+            retryDelay = qBound(minRetryDelay, retryDelay * 2, maxRetryDelay);
+        } else {
+            failedAttempts = 0;
+            retryDelay = 0;
+        }
+        // Everything signalled so far has been handled.
+        pending.tryAcquire(pending.available());
+        if (!stopping)
+            continue;
+        const auto left = head.load(std::memory_order_acquire)
+            - tail.load(std::memory_order_relaxed);
+        if (left == 0)
+            return;
+        if (failedAttempts >= maxFailuresWhenStopping) {
+            qDebug() << "Error: Dropping" << left
+                     << "data points that could not be stored.";
+            return;
+        }
+    }
+}
+
+IngestionQueue::BatchResult IngestionQueue::storeBatch()
+{
+    const auto currentTail = tail.load(std::memory_order_relaxed);
+    const auto available = head.load(std::memory_order_acquire) - currentTail;
+    if (available == 0)
+        return BatchResult::Empty;
+
+    const auto count = std::min<quint64>(available, maxBatchSize);
+    QList<DataPoint> dataPoints;
+    QList<qint64> enqueuedAt;
+    QSet<QString> keys;
+    dataPoints.reserve(count);
+    for (quint64 i = 0; i < count; i++) {
+        const auto& entry = entries[(currentTail + i) & mask];
+        keys.insert(entry.dataPoint.key);
+        dataPoints.append(entry.dataPoint);
+        enqueuedAt.append(entry.enqueuedAt);
+    }
+    // The slots are only released after the commit, so a full queue rejects
+    // submissions until the disk has caught up. They keep their data points
+    // for the next attempt if storing fails.
+    if (!storage->addDataPoints(dataPoints)) {
+        QMutexLocker locker(&flushMutex);
+        failures++;
+        finishFlushes(true);
+        return BatchResult::Failed;
+    }
+
+    const auto now = clock.nsecsElapsed();
+    for (const auto time : enqueuedAt) {
+        const auto latency = now - time;
+        latencySum += latency;
+        if (latency > maxLatency.load(std::memory_order_relaxed))
+            maxLatency.store(latency, std::memory_order_relaxed);
+    }
+
+    {
+        QMutexLocker locker(&flushMutex);
+        tail.store(currentTail + count, std::memory_order_release);
+        storedKeys.unite(keys);
+        finishFlushes(false);
+    }
+    return BatchResult::Stored;
+}
+
+void IngestionQueue::finishFlushes(bool failed)
+{
+    const auto currentTail = tail.load(std::memory_order_acquire);
+    for (auto it = flushes.begin(); it != flushes.end();) {
+        const auto stored = it->target <= currentTail;
+        if (!stored && !failed) {
+            ++it;
+            continue;
+        }
+        it->promise->addResult(stored);
+        it->promise->finish();
+        it = flushes.erase(it);
+    }
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <QtCore>
+#include <atomic>
+#include <vector>
+
+#include <core/storage.hpp>
+
+/**
+ * Buffers submitted data points and stores them on a background thread, in
+ * batches of one transaction each, so submitters never wait for the disk.
+ *
+ * The buffer is a bounded lock-free ring for a single producer, the thread
+ * handling D-Bus calls, and the writer thread as single consumer. Everything
+ * enqueued is stored before flush() finishes or the destructor returns.
+ * Batches that fail to store stay queued and are retried with backoff.
+ */
+class IngestionQueue {
+public:
+    struct Stats {
+        // Data points waiting to be stored.
+        quint64 depth;
+        quint64 maxDepth;
+        quint64 stored;
+        // Data points refused because the queue was full.
+        quint64 rejected;
+        // Batches that failed to store and were retried.
+        quint64 failures;
+        // Time from enqueueing until the batch was committed.
+        double averageLatencyMs;
+        double maxLatencyMs;
+    };
+
+    static constexpr int defaultCapacity = 4096;
+    static constexpr int maxBatchSize = 512;
+
+    explicit IngestionQueue(
+        QSharedPointer<Storage> storage, int capacity = defaultCapacity);
+    ~IngestionQueue();
+
+    /**
+     * Queues a data point for storage. Returns false if the queue is full, in
+     * which case the data point is dropped.
+     */
+    bool enqueue(const QString& key, const QString& value);
+
+    /**
+     * Finishes once everything enqueued so far has been stored, without
+     * blocking. Finishes with false early if storing fails, the data points
+     * stay queued then.
+     */
+    QFuture<bool> flush();
+
+    /**
+     * Returns the keys of the data points stored since the last call.
+     */
+    QSet<QString> takeStoredKeys();
+
+    Stats stats() const;
+
+private:
+    struct Entry {
+        DataPoint dataPoint;
+        qint64 enqueuedAt;
+    };
+
+    QSharedPointer<Storage> storage;
+    std::vector<Entry> entries;
+    const quint64 mask;
+    // Only written by the producer and the consumer respectively.
+    std::atomic<quint64> head { 0 };
+    std::atomic<quint64> tail { 0 };
+    QSemaphore pending;
+    std::atomic<bool> stopping { false };
+    QScopedPointer<QThread> writer;
+    QElapsedTimer clock;
+
+    std::atomic<quint64> maxDepth { 0 };
+    std::atomic<quint64> rejected { 0 };
+    std::atomic<quint64> failures { 0 };
+    std::atomic<qint64> latencySum { 0 };
+    std::atomic<qint64> maxLatency { 0 };
+
+    struct Flush {
+        // Finished once tail reaches this.
+        quint64 target;
+        QSharedPointer<QPromise<bool>> promise;
+    };
+
+    // Guards storedKeys and flushes.
+    QMutex flushMutex;
+    QSet<QString> storedKeys;
+    QList<Flush> flushes;
+
+    enum class BatchResult { Empty, Stored, Failed };
+
+    void run();
+    BatchResult storeBatch();
+    // Finishes the flushes that are done, or all of them when storing failed.
+    // Needs flushMutex.
+    void finishFlushes(bool failed);
+};
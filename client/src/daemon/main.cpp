@@ -1,3 +1,4 @@
+#include <core/in_memory_storage.hpp>
 #include <core/sqlite_storage.hpp>
 
 #include "daemon.hpp"
@@ -7,7 +8,6 @@
 #include "server_network.hpp"
 
 const int initialDelay = 1000;
-const int interval = 60000;
 
 QSharedPointer<Encryption> createEncryption()
 {
@@ -19,13 +19,74 @@ QSharedPointer<Encryption> createEncryption()
     return QSharedPointer<IdentityEncryption>::create();
 }
 
+QSharedPointer<Storage> createStorage()
+{
+    // For clients that don't need their data to outlive them, e.g. in
+    // containers and simulations.
+    if (qgetenv("PRIVACT_CLIENT_STORAGE") == "memory") {
+        const QString snapshotPath = qgetenv("PRIVACT_CLIENT_SNAPSHOT_PATH");
+        qDebug() << "Keeping data in memory, snapshot:"
+                 << (snapshotPath.isEmpty() ? "none" : snapshotPath);
+        return QSharedPointer<InMemoryStorage>::create(snapshotPath);
+    }
+    auto storage = QSharedPointer<SqliteStorage>::create();
+    storage->startLegacyBlobMigration();
+    return storage;
+}
+
+void enableSketches(Storage& storage)
+{
+    // Comma separated data keys that receive too many data points to store
+    // them all, see DataSketch for the error bounds.
+    const auto keys = QString(qgetenv("PRIVACT_CLIENT_SKETCH_KEYS"))
+                          .split(',', Qt::SkipEmptyParts);
+    for (const auto& key : keys) {
+        qDebug() << "Sketching data points for" << key.trimmed();
+        if (!storage.enableSketch(key.trimmed()))
+            qDebug() << "Error: Unable to sketch" << key.trimmed();
+    }
+}
+
+int maxInFlight()
+{
+    // How many survey records are worked on at the same time.
+    bool ok = false;
+    const auto limit
+        = qEnvironmentVariableIntValue("PRIVACT_CLIENT_MAX_IN_FLIGHT", &ok);
+    return ok && limit > 0 ? limit : Daemon::defaultMaxInFlight;
+}
+
+std::chrono::milliseconds requestTimeout()
+{
+    // Seconds after which requests to the server are given up.
+    bool ok = false;
+    const auto seconds
+        = qEnvironmentVariableIntValue("PRIVACT_CLIENT_REQUEST_TIMEOUT", &ok);
+    if (!ok || seconds <= 0)
+        return ServerNetwork::defaultTimeout;
+    return std::chrono::seconds(seconds);
+}
+
+qsizetype compressionThreshold()
+{
+    // Bytes from which request bodies are compressed.
+    bool ok = false;
+    const auto bytes = qEnvironmentVariableIntValue(
+        "PRIVACT_CLIENT_COMPRESSION_THRESHOLD", &ok);
+    if (!ok || bytes < 0)
+        return ServerNetwork::defaultCompressionThreshold;
+    return bytes;
+}
+
 int main(int argc, char* argv[])
 {
     QCoreApplication app(argc, argv);
-    auto storage = QSharedPointer<SqliteStorage>::create();
-    auto network = QSharedPointer<ServerNetwork>::create();
+    auto storage = createStorage();
+    enableSketches(*storage);
+    auto network = QSharedPointer<ServerNetwork>::create(
+        requestTimeout(), compressionThreshold());
     auto encryption = createEncryption();
-    Daemon daemon(&app, storage, network, encryption);
+    Daemon daemon(&app, storage, network, encryption, maxInFlight());
     QTimer timer(&app);
 
     QObject::connect(&timer, &QTimer::timeout, &app, [&]() {
@@ -33,8 +94,25 @@ int main(int argc, char* argv[])
         daemon.run();
     });
 
-    QObject::connect(
-        &daemon, &Daemon::finished, &app, [&]() { timer.start(interval); });
+    QObject::connect(&daemon, &Daemon::finished, &app, [&]() {
+        const auto stats = network->stats();
+        const auto newConnections = stats.newConnections.has_value()
+            ? QString::number(stats.newConnections.value())
+            : QString("unknown");
+        qDebug() << "Network: requests" << stats.requests << "new connections"
+                 << newConnections << "HTTP/2" << stats.http2
+                 << "timeouts" << stats.timeouts << "canceled"
+                 << stats.canceled << "compressed" << stats.compressedRequests
+                 << "bytes sent" << stats.bytesSent << "received"
+                 << stats.bytesReceived << "saved" << stats.bytesSaved;
+        timer.start(daemon.nextRunDelay());
+    });
+    // Runs in progress pick up woken records when they're done.
+    QObject::connect(&daemon, &Daemon::woken, &app, [&]() {
+        if (timer.isActive())
+            timer.start(Daemon::minRunDelay);
+    });
+    daemon.listenForSignupEvents();
 
     timer.start(initialDelay);
     return app.exec();
@@ -2,46 +2,65 @@
 
 #include <QtCore>
 
-// We're making synchronous network requests here - not particularly future
-// proof. We've considered two alternatives, which would both bleed quite
-// heavily into any code using this:
+// Requests are asynchronous: every call returns right away with a future,
+// which finishes on the thread owning the network once the reply is there.
+// Continuations should be attached with a context object, e.g.
+// future.then(this, ...), so they run on that object's thread and are dropped
+// with it.
 //
-// 1. Using futures and promises: Unfortunately, the Qt version we use at the
-//    time of writing - 6.2 - doesn't really provide the primitives we need to
-//    write proper asynchronous code that's not error-prone and hard to read
-//    (with home grown workardounds). The kind of things we'd need seem to be in
-//    place since Qt 6.4, so upgrading to that version would probably make this
-//    approach feasible, but since that version isn't in the package
-//    repositories of popular distributions, it seems a bit too bleeding edge
-//    for solid KDE compatibility.
+// Qt 6.2 can't unwrap nested futures or wait for several of them yet, so
+// multi-step pipelines chain their steps inside the continuations, see
+// async_tasks.hpp for the helpers.
 //
-// 2. Use signals and slots for a more traditional Qt approach. QStateMachine
-//    seems like it would be quite helpful, but at the end of the day, this
-//    rewrite would add quite a bit of boilerplate and make the logic more
-//    tedious to change. It could be a good option once we've got the logic
-//    nailed down.
-//
-// For the time being, we've decided to stick to synchronous requests. Firstly,
-// our logic is - at the time of writing - strictly serial and sequential
-// anyway. Secondly, this makes it quite a bit easier to prototype the logic we
-// need quickly, and it also makes it easier to understand. By the time anyone
-// other than the original authors reads this, we'd probably be happy to accept
-// patches and/or guidance to make this properly asynchronous.
+// Signups and their states are requested in batches of up to maxBatchSize
+// surveys, so their number of requests doesn't grow with every survey.
+
+// A reply to a request with the ETag of a version the client already has.
+struct ConditionalReply {
+    // False if the server answered 304 Not Modified, or on errors.
+    bool modified = false;
+    QByteArray etag;
+    QByteArray data;
+};
 
 class Network {
 public:
+    // The server rejects larger batches.
+    static constexpr int maxBatchSize = 100;
+
     virtual ~Network() = default;
 
-    virtual QByteArray listSurveys() const = 0;
-    virtual QByteArray surveySignup(
-        const QString& surveyId, const QString& publicKey)
+    // Only sends the list if it changed since the version with the ETag.
+    virtual QFuture<ConditionalReply> listSurveys(
+        const QByteArray& etag) const = 0;
+    // Signs up for several surveys in one request, with a public key per
+    // survey ID. Replies with the client IDs by survey ID.
+    virtual QFuture<QByteArray> surveySignups(
+        const QHash<QString, QString>& publicKeys)
         = 0;
-    virtual QByteArray getSignupState(const QString& clientId) const = 0;
-    virtual bool postMessageToDelegate(
+    // Replies with the states of several signups by client ID.
+    virtual QFuture<QByteArray> getSignupStates(
+        const QStringList& clientIds) const = 0;
+    virtual QFuture<bool> postMessageToDelegate(
         const QString& delegatePublicKey, const QString& message) const = 0;
-    virtual QByteArray getMessagesForDelegate(
-        const QString& delegateId) const = 0;
-    virtual bool postAggregationResult(
+    // Only the messages after the since cursor, 0 for all of them.
+    virtual QFuture<QByteArray> getMessagesForDelegate(
+        const QString& delegateId, qint64 since) const = 0;
+    virtual QFuture<bool> postAggregationResult(
         const QString& delegateId, const QByteArray& data)
         = 0;
+
+    /**
+     * Long polls for signup events. Finishes once the event token of one of
+     * the supplied client IDs differs from the supplied one, or after the
+     * server's timeout, with the changed tokens.
+     */
+    virtual QFuture<QByteArray> waitForSignupEvents(
+        const QHash<QString, QString>& tokens) const = 0;
+
+    /**
+     * Returns the earliest time the server asked to be contacted again with a
+     * Retry-After header, invalid if it didn't.
+     */
+    virtual QDateTime retryAfter() const = 0;
 };
@@ -0,0 +1,87 @@
+#include <QRandomGenerator>
+
+#include "poll_scheduler.hpp"
+
+namespace {
+const double jitter = 0.2;
+}
+
+PollScheduler::PollScheduler()
+    : PollScheduler(PollIntervals())
+{
+}
+
+PollScheduler::PollScheduler(const PollIntervals& intervals)
+    : intervals(intervals)
+{
+}
+
+bool PollScheduler::isDue(const QString& surveyId, const QDateTime& now) const
+{
+    if (retryAfter.isValid() && retryAfter > now)
+        return false;
+    const auto entry = entries.constFind(surveyId);
+    return entry == entries.constEnd() || entry->due <= now;
+}
+
+void PollScheduler::polled(
+    const QString& surveyId, Result result, const QDateTime& now)
+{
+    const auto interval = nextInterval(surveyId, result);
+    const auto spread
+        = QRandomGenerator::global()->bounded(2 * jitter) - jitter;
+    auto due = now.addMSecs(qRound64(interval.count() * (1 + spread)));
+    if (retryAfter.isValid() && retryAfter > due)
+        due = retryAfter;
+    entries.insert(surveyId, { .due = due, .interval = interval });
+}
+
+void PollScheduler::remove(const QString& surveyId)
+{
+    entries.remove(surveyId);
+}
+
+void PollScheduler::wake(const QString& surveyId, const QDateTime& now)
+{
+    const auto entry = entries.find(surveyId);
+    if (entry != entries.end() && entry->due > now)
+        entry->due = now;
+}
+
+void PollScheduler::notBefore(const QDateTime& time)
+{
+    if (!time.isValid())
+        return;
+    if (!retryAfter.isValid() || time > retryAfter)
+        retryAfter = time;
+}
+
+QDateTime PollScheduler::nextDue() const
+{
+    QDateTime next;
+    for (const auto& entry : entries) {
+        if (!next.isValid() || entry.due < next)
+            next = entry.due;
+    }
+    if (next.isValid() && retryAfter.isValid() && retryAfter > next)
+        return retryAfter;
+    return next;
+}
+
+std::chrono::milliseconds PollScheduler::nextInterval(
+    const QString& surveyId, Result result) const
+{
+    switch (result) {
+    case NearlyDone:
+        return intervals.nearlyDone;
+    case Changed:
+        return intervals.changed;
+    case Unchanged:
+        break;
+    }
+    const auto entry = entries.constFind(surveyId);
+    if (entry == entries.constEnd())
+        return intervals.changed;
+    return std::min(std::max(entry->interval * 2, intervals.changed),
+        intervals.max);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <QtCore>
+#include <chrono>
+
+struct PollIntervals {
+    // For records that only wait for a few more messages.
+    std::chrono::milliseconds nearlyDone { 5000 };
+    // For records that changed on their last poll, and new ones.
+    std::chrono::milliseconds changed { 30000 };
+    // Backing off stops here.
+    std::chrono::milliseconds max { 30 * 60000 };
+};
+
+/**
+ * Keeps the time each survey record is due to be polled next. Records that
+ * are close to completing are polled fast, and the interval doubles every time
+ * a poll changes nothing. Due times are moved randomly by up to a fifth of the
+ * interval, so clients that signed up together don't poll in lockstep.
+ *
+ * Records that were never polled are due right away. No record is due before
+ * the time the server asked to be contacted again.
+ */
+class PollScheduler {
+public:
+    enum Result { Unchanged, Changed, NearlyDone };
+
+    PollScheduler();
+    explicit PollScheduler(const PollIntervals& intervals);
+
+    bool isDue(const QString& surveyId, const QDateTime& now) const;
+
+    /**
+     * Schedules the next poll of the record, replacing an earlier schedule
+     * from the same poll.
+     */
+    void polled(const QString& surveyId, Result result, const QDateTime& now);
+
+    /**
+     * Forgets the record, for records that don't need polling anymore.
+     */
+    void remove(const QString& surveyId);
+
+    /**
+     * Makes the record due right away, keeping its backoff.
+     */
+    void wake(const QString& surveyId, const QDateTime& now);
+
+    /**
+     * Holds back all polls until the supplied time, ignoring invalid ones.
+     */
+    void notBefore(const QDateTime& time);
+
+    /**
+     * Returns the earliest due time of the scheduled records, invalid if
+     * there are none.
+     */
+    QDateTime nextDue() const;
+
+private:
+    struct Entry {
+        QDateTime due;
+        std::chrono::milliseconds interval;
+    };
+
+    const PollIntervals intervals;
+    QHash<QString, Entry> entries;
+    QDateTime retryAfter;
+
+    std::chrono::milliseconds nextInterval(
+        const QString& surveyId, Result result) const;
+};
@@ -0,0 +1,71 @@
+#include "response_planner.hpp"
+
+ResponsePlanner::ResponsePlanner(QSharedPointer<Storage> storage)
+    : storage(storage)
+{
+}
+
+void ResponsePlanner::plan(const QList<QSharedPointer<Survey>>& surveys)
+{
+    plannedQueries.clear();
+    for (const auto& survey : surveys)
+        for (const auto& query : survey->queries)
+            plannedQueries[query->dataKey].append(query);
+}
+
+void ResponsePlanner::invalidate(const QString& key) { counts.remove(key); }
+
+QSharedPointer<SurveyResponse> ResponsePlanner::createSurveyResponse(
+    const QSharedPointer<Survey>& survey)
+{
+    auto surveyResponse = QSharedPointer<SurveyResponse>::create(survey->id);
+
+    for (const auto& query : survey->queries) {
+        auto queryResponse = createQueryResponse(query);
+        if (queryResponse == nullptr)
+            continue;
+        surveyResponse->queryResponses.append(queryResponse);
+    }
+    return surveyResponse;
+}
+
+void ResponsePlanner::countQueries(
+    const QString& key, const QSharedPointer<Query>& query)
+{
+    auto& keyCounts = counts[key];
+
+    // Count everything planned for this key that isn't counted yet along with
+    // the requested query, so the key's data points are only scanned once.
+    QList<QSharedPointer<Query>> queries { query };
+    QSet<QString> queryIds { query->id };
+    for (const auto& plannedQuery : plannedQueries.value(key)) {
+        if (keyCounts.contains(plannedQuery->id)
+            || queryIds.contains(plannedQuery->id))
+            continue;
+        queries.append(plannedQuery);
+        queryIds.insert(plannedQuery->id);
+    }
+
+    const auto cohortCounts = storage->countCohorts(key, queries);
+    for (const auto& countedQuery : queries) {
+        if (cohortCounts.contains(countedQuery->id))
+            keyCounts[countedQuery->id] = cohortCounts.value(countedQuery->id);
+        else
+            keyCounts[countedQuery->id] = std::nullopt;
+    }
+}
+
+QSharedPointer<QueryResponse> ResponsePlanner::createQueryResponse(
+    const QSharedPointer<Query>& query)
+{
+    qDebug() << "Datakey" << query->dataKey;
+
+    if (!counts.value(query->dataKey).contains(query->id))
+        countQueries(query->dataKey, query);
+
+    const auto cohortData = counts[query->dataKey][query->id];
+    if (!cohortData.has_value())
+        return nullptr;
+
+    return QSharedPointer<QueryResponse>::create(query->id, cohortData.value());
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QtCore>
+
+#include <core/storage.hpp>
+#include <core/survey.hpp>
+#include <core/survey_response.hpp>
+
+/**
+ * Creates survey responses, counting all planned queries that share a data key
+ * in a single pass over that key's data points. The counts are kept until new
+ * data points arrive for the key.
+ */
+class ResponsePlanner {
+public:
+    explicit ResponsePlanner(QSharedPointer<Storage> storage);
+
+    /**
+     * Registers the queries of all surveys that might need a response this
+     * tick, replacing the previously planned ones.
+     */
+    void plan(const QList<QSharedPointer<Survey>>& surveys);
+
+    /**
+     * Drops the counts kept for the supplied data key.
+     */
+    void invalidate(const QString& key);
+
+    QSharedPointer<SurveyResponse> createSurveyResponse(
+        const QSharedPointer<Survey>& survey);
+
+private:
+    QSharedPointer<Storage> storage;
+    QHash<QString, QList<QSharedPointer<Query>>> plannedQueries;
+    // By data key, then by query ID. No value means there are no data points.
+    QHash<QString, QHash<QString, std::optional<QMap<QString, int>>>> counts;
+
+    void countQueries(const QString& key, const QSharedPointer<Query>& query);
+    QSharedPointer<QueryResponse> createQueryResponse(
+        const QSharedPointer<Query>& query);
+};
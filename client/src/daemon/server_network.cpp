@@ -1,9 +1,14 @@
 #include <QtNetwork>
 
+#include "compression.hpp"
 #include "server_network.hpp"
 
 namespace {
 const QString defaultBaseUrl = "http://localhost:8000";
+// Decompressed responses larger than this are dropped.
+const qsizetype maxBodySize = 64 * 1024 * 1024;
+// The response body as decompressed by decodeBody().
+const char* const bodyProperty = "body";
 
 QString getBaseUrl()
 {
@@ -12,53 +17,118 @@ QString getBaseUrl()
         return defaultBaseUrl;
     return userBaseUrl;
 }
+
+// Returns the body of a finished reply, which can't be read anymore itself.
+QByteArray body(QNetworkReply* reply)
+{
+    return reply->property(bodyProperty).toByteArray();
 }
 
-ServerNetwork::ServerNetwork()
-    : manager(new QNetworkAccessManager(this))
-    , baseUrl(getBaseUrl())
+// Completes the returned future with what read() takes from the reply once it
+// finished, then releases the reply. Canceling the future aborts the reply.
+template <typename T>
+QFuture<T> toFuture(QNetworkReply* reply,
+    const std::function<T(QNetworkReply* reply)>& read)
 {
-    qDebug() << "Working with server" << baseUrl;
+    auto promise = QSharedPointer<QPromise<T>>::create();
+    promise->start();
+    QObject::connect(
+        reply, &QNetworkReply::finished, reply, [reply, promise, read]() {
+            promise->addResult(read(reply));
+            promise->finish();
+            reply->deleteLater();
+        });
+    auto* watcher = new QFutureWatcher<T>(reply);
+    QObject::connect(watcher, &QFutureWatcherBase::canceled, reply,
+        &QNetworkReply::abort);
+    watcher->setFuture(promise->future());
+    return promise->future();
 }
 
-QByteArray ServerNetwork::listSurveys() const
+QByteArray readBody(QNetworkReply* reply)
 {
-    auto reply = getRequest(baseUrl + "/api/surveys/");
     if (reply->error() != QNetworkReply::NoError) {
         qCritical() << "Error:" << reply->errorString();
         return {};
     }
-    return reply->readAll();
+    return body(reply);
 }
 
-QByteArray ServerNetwork::surveySignup(
-    const QString& surveyId, const QString& publicKey)
+bool succeeded(QNetworkReply* reply)
 {
-    auto url = QString(baseUrl + "/api/survey-signup/");
-    QJsonObject jsonObjData;
-    jsonObjData["survey_id"] = surveyId;
-    jsonObjData["public_key"] = publicKey;
-    const QJsonDocument jsonDocData(jsonObjData);
-    auto reply = postRequest(url, jsonDocData.toJson());
     if (reply->error() != QNetworkReply::NoError) {
         qCritical() << "Error:" << reply->errorString();
-        return {};
+        return false;
     }
-    return reply->readAll();
+    return true;
+}
 }
 
-QByteArray ServerNetwork::getSignupState(const QString& clientId) const
+ServerNetwork::ServerNetwork(
+    std::chrono::milliseconds timeout, qsizetype compressionThreshold)
+    : manager(new QNetworkAccessManager(this))
+    , baseUrl(getBaseUrl())
+    , timeout(timeout)
+    , compressionThreshold(compressionThreshold)
 {
-    const auto url = QString(baseUrl + "/api/signup-state/%1/").arg(clientId);
-    auto reply = getRequest(url);
-    if (reply->error() != QNetworkReply::NoError) {
-        qCritical() << "Error:" << reply->errorString();
-        return {};
-    }
-    return reply->readAll();
+    qDebug() << "Working with server" << baseUrl;
+#if QT_VERSION >= QT_VERSION_CHECK(6, 3, 0)
+    counters.newConnections = 0;
+#endif
+}
+
+ServerNetwork::~ServerNetwork()
+{
+    // So the futures of pending requests finish instead of waiting forever.
+    cancelPendingRequests();
+}
+
+QFuture<ConditionalReply> ServerNetwork::listSurveys(
+    const QByteArray& etag) const
+{
+    auto request = createRequest(baseUrl + "/api/surveys/");
+    if (!etag.isEmpty())
+        request.setRawHeader("If-None-Match", etag);
+    return toFuture<ConditionalReply>(
+        getRequest(request), [](QNetworkReply* reply) -> ConditionalReply {
+            // Qt leaves 304 replies to the application, without an error.
+            const auto status
+                = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+            if (reply->error() != QNetworkReply::NoError || status != 200) {
+                if (reply->error() != QNetworkReply::NoError)
+                    qCritical() << "Error:" << reply->errorString();
+                return {};
+            }
+            return { .modified = true,
+                .etag = reply->rawHeader("ETag"),
+                .data = body(reply) };
+        });
 }
 
-bool ServerNetwork::postMessageToDelegate(
+QFuture<QByteArray> ServerNetwork::surveySignups(
+    const QHash<QString, QString>& publicKeys)
+{
+    auto url = QString(baseUrl + "/api/survey-signups/");
+    QJsonObject publicKeysObject;
+    for (auto it = publicKeys.cbegin(); it != publicKeys.cend(); ++it)
+        publicKeysObject[it.key()] = it.value();
+    const QJsonDocument jsonDocData(
+        QJsonObject { { "public_keys", publicKeysObject } });
+    return toFuture<QByteArray>(
+        postRequest(url, jsonDocData.toJson()), readBody);
+}
+
+QFuture<QByteArray> ServerNetwork::getSignupStates(
+    const QStringList& clientIds) const
+{
+    auto url = QString(baseUrl + "/api/signup-states/");
+    const QJsonDocument jsonDocData(QJsonObject {
+        { "client_ids", QJsonArray::fromStringList(clientIds) } });
+    return toFuture<QByteArray>(
+        postRequest(url, jsonDocData.toJson()), readBody);
+}
+
+QFuture<bool> ServerNetwork::postMessageToDelegate(
     const QString& delegatePublicKey, const QString& message) const
 {
     QJsonObject jsonObjData;
@@ -66,70 +136,217 @@ bool ServerNetwork::postMessageToDelegate(
     jsonObjData["public_key"] = delegatePublicKey;
     const QJsonDocument jsonDocData(jsonObjData);
     auto url = QString(baseUrl + "/api/message-to-delegate/");
-    auto reply = postRequest(url, jsonDocData.toJson());
-    if (reply->error() != QNetworkReply::NoError) {
-        qCritical() << "Error:" << reply->errorString();
-        return false;
-    }
-    return true;
+    return toFuture<bool>(postRequest(url, jsonDocData.toJson()), succeeded);
 }
 
-QByteArray ServerNetwork::getMessagesForDelegate(
-    const QString& delegateId) const
+QFuture<QByteArray> ServerNetwork::getMessagesForDelegate(
+    const QString& delegateId, qint64 since) const
 {
     const auto url
-        = QString(baseUrl + "/api/messages-for-delegate/%1/").arg(delegateId);
-    auto reply = getRequest(url);
-    if (reply->error() != QNetworkReply::NoError) {
-        qCritical() << "Error:" << reply->errorString();
-        return {};
-    }
+        = QString(baseUrl + "/api/messages-for-delegate/%1/?since=%2")
+              .arg(delegateId)
+              .arg(since);
+    return toFuture<QByteArray>(getRequest(url), [](QNetworkReply* reply) {
+        if (reply->error() != QNetworkReply::NoError) {
+            qCritical() << "Error:" << reply->errorString();
+            return QByteArray();
+        }
 
-    auto status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
-    if (status != 200) {
-        return {};
-    }
+        auto status
+            = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+        if (status != 200) {
+            return QByteArray();
+        }
 
-    return reply->readAll();
+        return body(reply);
+    });
 }
 
 // TODO: May be better to return a proper result type with success and result
 // instead of a bool
-bool ServerNetwork::postAggregationResult(
+QFuture<bool> ServerNetwork::postAggregationResult(
     const QString& delegateId, const QByteArray& data)
 {
     auto url
         = QString(baseUrl + "/api/post-aggregation-result/%1/").arg(delegateId);
-    auto reply = postRequest(url, data);
-    if (reply->error() != QNetworkReply::NoError) {
-        qCritical() << "Error:" << reply->errorString();
-        return false;
-    }
-    return true;
+    return toFuture<bool>(postRequest(url, data), succeeded);
 }
 
-QNetworkReply* ServerNetwork::getRequest(const QString& url) const
+QFuture<QByteArray> ServerNetwork::waitForSignupEvents(
+    const QHash<QString, QString>& tokens) const
+{
+    QJsonObject clientIds;
+    for (auto it = tokens.cbegin(); it != tokens.cend(); ++it)
+        clientIds[it.key()] = it.value();
+    QJsonObject jsonObjData;
+    jsonObjData["client_ids"] = clientIds;
+    const QJsonDocument jsonDocData(jsonObjData);
+    auto url = QString(baseUrl + "/api/signup-events/");
+    return toFuture<QByteArray>(
+        postRequest(url, jsonDocData.toJson(), longPollDuration + timeout),
+        readBody);
+}
+
+QDateTime ServerNetwork::retryAfter() const
+{
+    return retryAfterTime;
+}
+
+void ServerNetwork::cancelPendingRequests()
+{
+    // Aborting finishes the reply right away, which removes it from the set.
+    for (auto* reply : QSet<QNetworkReply*>(pendingReplies))
+        reply->abort();
+}
+
+ServerNetwork::Stats ServerNetwork::stats() const
+{
+    return counters;
+}
+
+QNetworkRequest ServerNetwork::createRequest(const QString& url) const
 {
     QNetworkRequest request(url);
-    auto reply = manager->get(request);
-    QEventLoop eventLoop;
-    QObject::connect(
-        reply, &QNetworkReply::finished, &eventLoop, &QEventLoop::quit);
-    eventLoop.exec();
-    // TODO: Ensure the reply gets destroyed.
-    return reply;
+    // Negotiated with TLS servers, others stay on HTTP/1.1 with keep-alive.
+    request.setAttribute(QNetworkRequest::Http2AllowedAttribute, true);
+    // Also keeps Qt from decompressing responses itself, so decodeBody() can
+    // count the bytes.
+    request.setRawHeader("Accept-Encoding", "gzip");
+    return request;
+}
+
+QNetworkReply* ServerNetwork::getRequest(const QString& url) const
+{
+    return getRequest(createRequest(url));
+}
+
+QNetworkReply* ServerNetwork::getRequest(const QNetworkRequest& request) const
+{
+    return track(manager->get(request), timeout);
 }
 
 QNetworkReply* ServerNetwork::postRequest(
     const QString& url, const QByteArray& data) const
 {
-    QNetworkRequest request(url);
+    return postRequest(url, data, timeout);
+}
+
+QNetworkReply* ServerNetwork::postRequest(const QString& url,
+    const QByteArray& data, std::chrono::milliseconds timeout) const
+{
+    auto request = createRequest(url);
     request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
-    auto reply = manager->post(request, data);
-    QEventLoop eventLoop;
+    const auto body = encodeBody(request, data);
+    return track(manager->post(request, body), timeout);
+}
+
+QNetworkReply* ServerNetwork::track(
+    QNetworkReply* reply, std::chrono::milliseconds timeout) const
+{
+    counters.requests++;
+    pendingReplies.insert(reply);
+#if QT_VERSION >= QT_VERSION_CHECK(6, 3, 0)
+    QObject::connect(reply, &QNetworkReply::socketStartedConnecting, this,
+        [this]() { (*counters.newConnections)++; });
+#endif
+
+    // Released with the reply.
+    auto* deadline = new QTimer(reply);
+    deadline->setSingleShot(true);
+    QObject::connect(deadline, &QTimer::timeout, reply, [this, reply]() {
+        qWarning() << "Request timed out:" << reply->url().toString();
+        counters.timeouts++;
+        reply->setProperty("timedOut", true);
+        reply->abort();
+    });
+    deadline->start(timeout);
+
+    // Connected before the reply is read, so everything is up to date by then.
+    watchRetryAfter(reply);
     QObject::connect(
-        reply, &QNetworkReply::finished, &eventLoop, &QEventLoop::quit);
-    eventLoop.exec();
-    // TODO: Ensure the reply gets destroyed.
+        reply, &QNetworkReply::finished, this, [this, reply, deadline]() {
+            deadline->stop();
+            pendingReplies.remove(reply);
+            decodeBody(reply);
+            if (reply->attribute(QNetworkRequest::Http2WasUsedAttribute)
+                    .toBool())
+                counters.http2++;
+            if (reply->error() == QNetworkReply::OperationCanceledError
+                && !reply->property("timedOut").toBool())
+                counters.canceled++;
+        });
     return reply;
 }
+
+QByteArray ServerNetwork::encodeBody(
+    QNetworkRequest& request, const QByteArray& data) const
+{
+    if (!gzipAccepted || data.size() < compressionThreshold) {
+        counters.bytesSent += data.size();
+        return data;
+    }
+
+    const auto compressed = gzip(data);
+    // Data that doesn't compress, like random bytes, may even grow.
+    if (compressed.isEmpty() || compressed.size() >= data.size()) {
+        counters.bytesSent += data.size();
+        return data;
+    }
+
+    request.setRawHeader("Content-Encoding", "gzip");
+    counters.compressedRequests++;
+    counters.bytesSent += compressed.size();
+    counters.bytesSaved += data.size() - compressed.size();
+    return compressed;
+}
+
+void ServerNetwork::decodeBody(QNetworkReply* reply) const
+{
+    auto data = reply->readAll();
+    counters.bytesReceived += data.size();
+    const auto encoding = reply->rawHeader("Content-Encoding").trimmed();
+    if (!data.isEmpty() && encoding.compare("gzip", Qt::CaseInsensitive) == 0) {
+        if (const auto decompressed = gunzip(data, maxBodySize)) {
+            counters.bytesSaved += decompressed->size() - data.size();
+            data = *decompressed;
+        } else {
+            qCritical() << "Error: Invalid gzip response from"
+                        << reply->url().toString();
+            data.clear();
+        }
+    }
+    reply->setProperty(bodyProperty, data);
+
+    // Servers that don't list what they accept may still turn compressed
+    // requests down.
+    const auto accepted = reply->rawHeader("Accept-Encoding");
+    const auto status
+        = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (!accepted.isEmpty())
+        gzipAccepted = accepted.toLower().contains("gzip");
+    else if (status == 415 && reply->request().hasRawHeader("Content-Encoding"))
+        gzipAccepted = false;
+}
+
+void ServerNetwork::watchRetryAfter(QNetworkReply* reply) const
+{
+    QObject::connect(reply, &QNetworkReply::finished, this, [this, reply]() {
+        const auto value = reply->rawHeader("Retry-After").trimmed();
+        if (value.isEmpty())
+            return;
+
+        // Either a number of seconds or an HTTP date.
+        bool isSeconds = false;
+        const auto seconds = value.toLongLong(&isSeconds);
+        const auto time = isSeconds
+            ? QDateTime::currentDateTimeUtc().addSecs(seconds)
+            : QDateTime::fromString(
+                QString::fromLatin1(value), Qt::RFC2822Date);
+        if (!time.isValid())
+            return;
+
+        qDebug() << "Server asked to retry after" << time;
+        if (!retryAfterTime.isValid() || time > retryAfterTime)
+            retryAfterTime = time;
+    });
+}
@@ -1,30 +1,102 @@
 #pragma once
 
+#include <chrono>
+#include <optional>
+
 #include "network.hpp"
 
 class QNetworkAccessManager;
 class QNetworkReply;
+class QNetworkRequest;
 
+/**
+ * Talks to the server over one QNetworkAccessManager, which keeps connections
+ * open between requests and uses HTTP/2 where the server negotiates it.
+ *
+ * Every reply is released once it finished. Requests are aborted when they
+ * take longer than the timeout, when the caller cancels the returned future,
+ * on cancelPendingRequests() and on destruction. Their futures finish with the
+ * same empty results as failed requests then.
+ *
+ * Response bodies are accepted gzip compressed. Request bodies are sent gzip
+ * compressed from the compression threshold on, once a response listed gzip in
+ * its Accept-Encoding header (RFC 7694), until one doesn't anymore.
+ */
 class ServerNetwork : public QObject, public Network {
     Q_OBJECT
 
 public:
-    ServerNetwork();
+    struct Stats {
+        int requests = 0;
+        // Requests that opened a connection instead of reusing one. Unknown
+        // before Qt 6.3, which doesn't tell when replies connect.
+        std::optional<int> newConnections;
+        int http2 = 0;
+        int timeouts = 0;
+        int canceled = 0;
+        int compressedRequests = 0;
+        // Body bytes as they went over the wire, and how many fewer that were
+        // than without compression.
+        qint64 bytesSent = 0;
+        qint64 bytesReceived = 0;
+        qint64 bytesSaved = 0;
+    };
+
+    static constexpr std::chrono::milliseconds defaultTimeout { 30000 };
+    // How long the server holds long polls at most, they get this on top of
+    // the timeout.
+    static constexpr std::chrono::milliseconds longPollDuration { 25000 };
+    // Smaller bodies hardly shrink, and aren't worth the time.
+    static constexpr qsizetype defaultCompressionThreshold = 1024;
+
+    explicit ServerNetwork(std::chrono::milliseconds timeout = defaultTimeout,
+        qsizetype compressionThreshold = defaultCompressionThreshold);
+    ~ServerNetwork();
 
-    QByteArray listSurveys() const;
-    QByteArray surveySignup(const QString& surveyId, const QString& publicKey);
-    QByteArray getSignupState(const QString& clientId) const;
-    bool postMessageToDelegate(
+    QFuture<ConditionalReply> listSurveys(const QByteArray& etag) const;
+    QFuture<QByteArray> surveySignups(
+        const QHash<QString, QString>& publicKeys);
+    QFuture<QByteArray> getSignupStates(const QStringList& clientIds) const;
+    QFuture<bool> postMessageToDelegate(
         const QString& delegatePublicKey, const QString& message) const;
-    QByteArray getMessagesForDelegate(const QString& delegateId) const;
-    bool postAggregationResult(
+    QFuture<QByteArray> getMessagesForDelegate(
+        const QString& delegateId, qint64 since) const;
+    QFuture<bool> postAggregationResult(
         const QString& delegateId, const QByteArray& data);
+    QFuture<QByteArray> waitForSignupEvents(
+        const QHash<QString, QString>& tokens) const;
+    QDateTime retryAfter() const;
+
+    /**
+     * Aborts all requests that haven't finished yet.
+     */
+    void cancelPendingRequests();
+
+    Stats stats() const;
 
 private:
     QNetworkAccessManager* manager;
     QString baseUrl;
+    const std::chrono::milliseconds timeout;
+    const qsizetype compressionThreshold;
+    // Updated by the const requests as their replies arrive.
+    mutable QDateTime retryAfterTime;
+    mutable QSet<QNetworkReply*> pendingReplies;
+    mutable Stats counters;
+    // Whether the server said it takes gzip compressed request bodies.
+    mutable bool gzipAccepted = false;
 
+    QNetworkRequest createRequest(const QString& url) const;
     QNetworkReply* getRequest(const QString& url) const;
+    QNetworkReply* getRequest(const QNetworkRequest& request) const;
     QNetworkReply* postRequest(
         const QString& url, const QByteArray& data) const;
+    QNetworkReply* postRequest(const QString& url, const QByteArray& data,
+        std::chrono::milliseconds timeout) const;
+    QNetworkReply* track(
+        QNetworkReply* reply, std::chrono::milliseconds timeout) const;
+    QByteArray encodeBody(
+        QNetworkRequest& request, const QByteArray& data) const;
+    void decodeBody(QNetworkReply* reply) const;
+    void watchRetryAfter(QNetworkReply* reply) const;
 };
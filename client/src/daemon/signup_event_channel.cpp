@@ -0,0 +1,87 @@
+#include <QRandomGenerator>
+
+#include "signup_event_channel.hpp"
+
+SignupEventChannel::SignupEventChannel(
+    QSharedPointer<Network> network, std::chrono::milliseconds minBackoff)
+    : network(network)
+    , minBackoff(minBackoff)
+    , backoff(minBackoff)
+{
+    retryTimer.setSingleShot(true);
+    connect(&retryTimer, &QTimer::timeout, this, &SignupEventChannel::poll);
+}
+
+void SignupEventChannel::watch(const QSet<QString>& clientIds)
+{
+    QHash<QString, QString> watched;
+    const auto add = [&](const QString& clientId) {
+        if (!watched.contains(clientId)
+            && watched.count() < Network::maxBatchSize)
+            watched.insert(clientId, tokens.value(clientId));
+    };
+    // The ones watched already first, so they keep their tokens.
+    for (const auto& clientId : clientIds) {
+        if (tokens.contains(clientId))
+            add(clientId);
+    }
+    for (const auto& clientId : clientIds)
+        add(clientId);
+    tokens = watched;
+    if (started && !polling && !retryTimer.isActive())
+        poll();
+}
+
+void SignupEventChannel::start()
+{
+    started = true;
+    if (!polling && !retryTimer.isActive())
+        poll();
+}
+
+void SignupEventChannel::poll()
+{
+    // Resumed by watch() once there's something to watch.
+    if (tokens.isEmpty())
+        return;
+
+    polling = true;
+    network->waitForSignupEvents(tokens).then(
+        this, [this](const QByteArray& data) {
+            polling = false;
+            handleEvents(data);
+        });
+}
+
+void SignupEventChannel::handleEvents(const QByteArray& data)
+{
+    const auto responseObject = QJsonDocument::fromJson(data).object();
+    if (!responseObject["events"].isObject()) {
+        retryLater();
+        return;
+    }
+    backoff = minBackoff;
+
+    const auto events = responseObject["events"].toObject();
+    for (auto it = events.constBegin(); it != events.constEnd(); ++it) {
+        const auto token = tokens.find(it.key());
+        if (token == tokens.end())
+            continue;
+        const auto previous = std::exchange(*token, it.value().toString());
+        // The first token of a client ID only tells where it stands.
+        if (!previous.isEmpty() && previous != *token)
+            emit changed(it.key());
+    }
+    poll();
+}
+
+void SignupEventChannel::retryLater()
+{
+    // Spread out, so clients don't all reconnect at once after an outage.
+    const std::chrono::milliseconds delay(backoff.count() / 2
+        + QRandomGenerator::global()->bounded(backoff.count() / 2 + 1));
+    qDebug() << "Waiting for signup events failed, retrying in"
+             << delay.count() << "ms";
+    retryTimer.start(delay);
+    backoff = std::min(backoff * 2, maxBackoff);
+}
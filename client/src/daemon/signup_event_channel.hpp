@@ -0,0 +1,56 @@
+#pragma once
+
+#include <QtCore>
+#include <chrono>
+
+#include "network.hpp"
+
+/**
+ * Keeps a long poll for signup events open, so the daemon hears right away
+ * when an aggregation starts or a delegate receives messages, instead of on
+ * its next poll of the record.
+ *
+ * Changes to the watched client IDs are picked up by the next long poll. At
+ * most Network::maxBatchSize of them are watched, the server turns down
+ * larger polls. The others are left to their poll schedule.
+ * Failed polls are retried after a backoff that doubles up to maxBackoff and
+ * is reset by the next successful one.
+ */
+class SignupEventChannel : public QObject {
+    Q_OBJECT
+
+public:
+    static constexpr std::chrono::milliseconds defaultMinBackoff { 1000 };
+    static constexpr std::chrono::milliseconds maxBackoff { 60000 };
+
+    explicit SignupEventChannel(QSharedPointer<Network> network,
+        std::chrono::milliseconds minBackoff = defaultMinBackoff);
+
+    /**
+     * Replaces the client IDs to watch. Ones that are watched already keep
+     * their place if there are too many.
+     */
+    void watch(const QSet<QString>& clientIds);
+
+    /**
+     * Starts polling whenever there are client IDs to watch.
+     */
+    void start();
+
+signals:
+    void changed(const QString& clientId);
+
+private:
+    QSharedPointer<Network> network;
+    const std::chrono::milliseconds minBackoff;
+    std::chrono::milliseconds backoff;
+    // By client ID, empty until the first poll told the current one.
+    QHash<QString, QString> tokens;
+    bool started = false;
+    bool polling = false;
+    QTimer retryTimer;
+
+    void poll();
+    void handleEvents(const QByteArray& data);
+    void retryLater();
+};
@@ -0,0 +1,50 @@
+#include "survey_catalog.hpp"
+
+QByteArray SurveyCatalog::etag() const
+{
+    return currentEtag;
+}
+
+int SurveyCatalog::count() const
+{
+    return entries.count();
+}
+
+Result<QList<QSharedPointer<Survey>>> SurveyCatalog::update(
+    const QByteArray& data, const QByteArray& etag)
+{
+    using ListResult = Result<QList<QSharedPointer<Survey>>>;
+
+    const auto document = QJsonDocument::fromJson(data);
+    if (!document.isArray())
+        return ListResult::Failure("Survey list is not a JSON array");
+
+    QHash<QString, Entry> updated;
+    QList<QSharedPointer<Survey>> changed;
+    for (const auto& item : document.array()) {
+        const auto object = item.toObject();
+        const auto surveyId = object["id"].toString();
+        const auto known = entries.constFind(surveyId);
+        if (known != entries.constEnd() && known->object == object) {
+            updated.insert(surveyId, *known);
+            continue;
+        }
+
+        auto parsingResult = Survey::fromByteArray(
+            QJsonDocument(object).toJson(QJsonDocument::Compact));
+        if (!parsingResult.isSuccess())
+            return ListResult::Failure(parsingResult.getErrorMessage());
+        const auto survey = parsingResult.getValue();
+        updated.insert(survey->id, { .object = object, .survey = survey });
+        changed.append(survey);
+    }
+
+    entries = updated;
+    currentEtag = etag;
+    return Result(changed);
+}
+
+QSharedPointer<Survey> SurveyCatalog::find(const QString& surveyId) const
+{
+    return entries.value(surveyId).survey;
+}
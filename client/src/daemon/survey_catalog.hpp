@@ -0,0 +1,44 @@
+#pragma once
+
+#include <QtCore>
+
+#include <core/result.hpp>
+#include <core/survey.hpp>
+
+/**
+ * Keeps the last survey list fetched from the server, with its ETag, so only
+ * surveys that are new or changed since then need to be parsed and looked at.
+ */
+class SurveyCatalog {
+public:
+    /**
+     * Returns the ETag of the stored list, empty before the first update.
+     */
+    QByteArray etag() const;
+
+    int count() const;
+
+    /**
+     * Replaces the stored list with a JSON array of surveys, and returns the
+     * surveys that are new or changed. Surveys missing from the list are
+     * dropped. The stored list is kept if the data can't be parsed.
+     */
+    Result<QList<QSharedPointer<Survey>>> update(
+        const QByteArray& data, const QByteArray& etag);
+
+    /**
+     * Returns the survey with the supplied ID, null if it isn't listed.
+     */
+    QSharedPointer<Survey> find(const QString& surveyId) const;
+
+private:
+    struct Entry {
+        // As listed by the server, to tell changed surveys apart.
+        QJsonObject object;
+        QSharedPointer<Survey> survey;
+    };
+
+    QByteArray currentEtag;
+    // By survey ID.
+    QHash<QString, Entry> entries;
+};
@@ -0,0 +1,63 @@
+#include "task_queue.hpp"
+
+TaskQueue::TaskQueue(QObject* context, int limit)
+    : context(context)
+    , limit(qMax(limit, 1))
+{
+    clock.start();
+}
+
+QFuture<void> TaskQueue::enqueue(int priority, const AsyncTask& task)
+{
+    const auto completion = createCompletion();
+    pending[priority].enqueue({ .task = task,
+        .completion = completion,
+        .enqueuedAt = clock.nsecsElapsed() });
+    if (!startScheduled) {
+        startScheduled = true;
+        QMetaObject::invokeMethod(
+            context, [this]() { startPending(); }, Qt::QueuedConnection);
+    }
+    return completion->future();
+}
+
+QMap<int, TaskQueue::Stats> TaskQueue::stats() const
+{
+    QMap<int, Stats> stats;
+    for (auto it = delays.cbegin(); it != delays.cend(); ++it) {
+        const auto& delay = it.value();
+        stats.insert(it.key(),
+            { .started = delay.started,
+                .averageDelayMs = delay.started == 0
+                    ? 0
+                    : delay.sum / 1e6 / delay.started,
+                .maxDelayMs = delay.max / 1e6 });
+    }
+    return stats;
+}
+
+void TaskQueue::startPending()
+{
+    startScheduled = false;
+    while (running < limit && !pending.isEmpty()) {
+        const auto queue = pending.begin();
+        const auto next = queue->dequeue();
+        const auto priority = queue.key();
+        if (queue->isEmpty())
+            pending.erase(queue);
+
+        const auto delay = clock.nsecsElapsed() - next.enqueuedAt;
+        auto& priorityDelays = delays[priority];
+        priorityDelays.started++;
+        priorityDelays.sum += delay;
+        priorityDelays.max = qMax(priorityDelays.max, delay);
+
+        running++;
+        const auto completion = next.completion;
+        const auto finished = [this, completion]() {
+            running--;
+            startPending();
+        };
+        next.task().then(context, finished).onCanceled(context, finished);
+    }
+}
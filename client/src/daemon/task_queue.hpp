@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QtCore>
+
+#include "async_tasks.hpp"
+
+/**
+ * Runs asynchronous tasks with at most a given number of them in flight.
+ * Queued tasks are started by priority, lower values first, and in the order
+ * they were queued within a priority. Starting is deferred to the event loop,
+ * so tasks queued together are ordered before the first of them starts.
+ */
+class TaskQueue {
+public:
+    struct Stats {
+        quint64 started;
+        // Time from queueing until the task was started.
+        double averageDelayMs;
+        double maxDelayMs;
+    };
+
+    /**
+     * Starts and continues the tasks on the thread of context, nothing is
+     * started anymore once it's destroyed.
+     */
+    TaskQueue(QObject* context, int limit);
+
+    /**
+     * Queues the task. The returned future finishes once the task's has.
+     */
+    QFuture<void> enqueue(int priority, const AsyncTask& task);
+
+    /**
+     * Returns the queueing delays so far by priority.
+     */
+    QMap<int, Stats> stats() const;
+
+private:
+    struct Pending {
+        AsyncTask task;
+        Completion completion;
+        qint64 enqueuedAt;
+    };
+
+    struct Delays {
+        quint64 started = 0;
+        qint64 sum = 0;
+        qint64 max = 0;
+    };
+
+    QObject* const context;
+    const int limit;
+    int running = 0;
+    bool startScheduled = false;
+    QMap<int, QQueue<Pending>> pending;
+    QMap<int, Delays> delays;
+    QElapsedTimer clock;
+
+    void startPending();
+};
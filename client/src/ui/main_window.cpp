@@ -5,16 +5,16 @@
 #include <core/survey_response.hpp>
 
 namespace {
-void setupDataPointsTableWidget(QTableWidget& tableWidget)
+void setupDataPointsTableWidget(
+    QTableWidget& tableWidget, const QList<DataPoint>& dataPoints)
 {
     tableWidget.horizontalHeader()->setSectionResizeMode(
         QHeaderView::ResizeToContents);
     tableWidget.verticalHeader()->setSectionResizeMode(
         QHeaderView::ResizeToContents);
 
-    SqliteStorage storage;
     int row = 0;
-    for (const auto& dataPoint : storage.listDataPoints()) {
+    for (const auto& dataPoint : dataPoints) {
         tableWidget.insertRow(row);
 
         auto keyItem = new QTableWidgetItem; // NOLINT
@@ -33,16 +33,16 @@ void setupDataPointsTableWidget(QTableWidget& tableWidget)
     }
 }
 
-void setupResponsesTableWidget(QTableWidget& tableWidget)
+void setupResponsesTableWidget(QTableWidget& tableWidget,
+    const QList<SurveyResponseRecord>& responseRecords)
 {
     tableWidget.horizontalHeader()->setSectionResizeMode(
         QHeaderView::ResizeToContents);
     tableWidget.verticalHeader()->setSectionResizeMode(
         QHeaderView::ResizeToContents);
 
-    SqliteStorage storage;
     int row = 0;
-    for (const auto& responseEntry : storage.listSurveyResponses()) {
+    for (const auto& responseEntry : responseRecords) {
         tableWidget.insertRow(row);
 
         auto createdAtItem = new QTableWidgetItem; // NOLINT
@@ -110,10 +110,47 @@ void setupResponsesTableWidget(QTableWidget& tableWidget)
 
 MainWindow::MainWindow(QWidget* parent)
     : ui(new Ui::MainWindow)
+    , storage(QSharedPointer<SqliteStorage>::create())
 {
     ui->setupUi(this);
-    setupDataPointsTableWidget(*ui->dataPointsTableWidget);
-    setupResponsesTableWidget(*ui->responsesTableWidget);
+
+    // Both tables load at the same time, each thread with its own connection,
+    // and are filled in on the UI thread once their data is there.
+    auto dataPoints = QSharedPointer<QList<DataPoint>>::create();
+    loadInBackground(
+        [storage = storage, dataPoints]() {
+            *dataPoints = storage->listDataPoints();
+        },
+        [this, dataPoints]() {
+            setupDataPointsTableWidget(
+                *ui->dataPointsTableWidget, *dataPoints);
+        });
+
+    auto responseRecords
+        = QSharedPointer<QList<SurveyResponseRecord>>::create();
+    loadInBackground(
+        [storage = storage, responseRecords]() {
+            *responseRecords = storage->listSurveyResponses();
+        },
+        [this, responseRecords]() {
+            setupResponsesTableWidget(
+                *ui->responsesTableWidget, *responseRecords);
+        });
+}
+
+MainWindow::~MainWindow()
+{
+    for (const auto& thread : loaderThreads)
+        thread->wait();
+    delete ui;
 }
 
-MainWindow::~MainWindow() { delete ui; }
+void MainWindow::loadInBackground(
+    std::function<void()> load, std::function<void()> show)
+{
+    auto thread = QSharedPointer<QThread>(QThread::create(std::move(load)));
+    // Queued to the window's thread, and dropped if the window is gone.
+    connect(thread.get(), &QThread::finished, this, std::move(show));
+    loaderThreads.append(thread);
+    thread->start();
+}
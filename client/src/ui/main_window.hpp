@@ -1,4 +1,7 @@
 #include <QMainWindow>
+#include <functional>
+
+#include <core/sqlite_storage.hpp>
 
 namespace Ui {
 class MainWindow;
@@ -13,4 +16,9 @@ public:
 
 private:
     Ui::MainWindow* ui;
+    QSharedPointer<SqliteStorage> storage;
+    QList<QSharedPointer<QThread>> loaderThreads;
+
+    void loadInBackground(
+        std::function<void()> load, std::function<void()> show);
 };
@@ -0,0 +1,102 @@
+#include <QTest>
+
+#include <core/data_sketch.hpp>
+
+#include "data_sketch_test.hpp"
+
+void DataSketchTest::testCountsExactly()
+{
+    DataSketch sketch;
+    QVERIFY(!sketch.countCohorts(Query("1", "a", { "a" }, true)).has_value());
+
+    sketch.add("a");
+    sketch.add("b");
+    sketch.add("a");
+
+    QVERIFY(sketch.isExact());
+    const QMap<QString, int> expected = { { "a", 2 }, { "c", 0 } };
+    QCOMPARE(
+        sketch.countCohorts(Query("1", "a", { "a", "c" }, true)).value(),
+        expected);
+}
+
+void DataSketchTest::testCountsApproximately()
+{
+    DataSketch sketch;
+    for (int i = 1; i <= 1000; i++)
+        sketch.add(QString::number(i));
+    QVERIFY(!sketch.isExact());
+    QCOMPARE(sketch.count(), qint64(1000));
+
+    const auto cohortData
+        = sketch.countCohorts(Query("1", "a", Histogram(0, 100, 10))).value();
+    QCOMPARE(cohortData.value("(-inf, 0)"), 0);
+    // Only the values within 1% of a bound can be off.
+    for (int i = 1; i < 9; i++) {
+        const auto cohort = QString("[%1, %2)").arg(i * 100).arg(i * 100 + 100);
+        QVERIFY(qAbs(cohortData.value(cohort) - 100) <= 2 * (i + 1));
+    }
+    int total = 0;
+    for (const auto& count : cohortData)
+        total += count;
+    QCOMPARE(total, 1000);
+}
+
+void DataSketchTest::testDiscreteQueryNeedsExactCounts()
+{
+    DataSketch sketch;
+    for (int i = 0; i <= DataSketch::maxExactValues; i++)
+        sketch.add(QString::number(i));
+
+    QVERIFY(!sketch.countCohorts(Query("1", "a", { "1" }, true)).has_value());
+    QVERIFY(sketch.countCohorts(Query("1", "a", { "[0, 10)" }, false))
+                .has_value());
+}
+
+void DataSketchTest::testMerge()
+{
+    DataSketch first;
+    first.add("1");
+    DataSketch second;
+    for (int i = 0; i < 100; i++)
+        second.add(QString::number(i + 100));
+
+    first.merge(second);
+
+    QCOMPARE(first.count(), qint64(101));
+    const QMap<QString, int> expected
+        = { { "[0, 50)", 1 }, { "[50, inf)", 100 } };
+    QCOMPARE(
+        first.countCohorts(Query("1", "a", { "[0, 50)", "[50, inf)" }, false))
+            .value(),
+        expected);
+}
+
+void DataSketchTest::testToByteArrayAndBack()
+{
+    DataSketch sketch;
+    for (int i = -100; i < 100; i++)
+        sketch.add(QString::number(i));
+
+    const auto result = DataSketch::fromByteArray(sketch.toByteArray());
+
+    QVERIFY(result.isSuccess());
+    QCOMPARE(result.getValue().toByteArray(), sketch.toByteArray());
+    QVERIFY(!DataSketch::fromByteArray("").isSuccess());
+}
+
+void DataSketchTest::testBoundedSize()
+{
+    DataSketch sketch;
+    for (int i = 0; i < 20000; i++)
+        sketch.add(QString::number(std::pow(1.05, i % 5000 - 2500)));
+    const auto size = sketch.toByteArray().size();
+
+    for (int i = 0; i < 20000; i++)
+        sketch.add(QString::number(std::pow(1.05, i % 5000 - 2500)));
+
+    QCOMPARE(sketch.toByteArray().size(), size);
+    QCOMPARE(sketch.count(), qint64(40000));
+}
+
+QTEST_MAIN(DataSketchTest)
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <QObject>
+
+class DataSketchTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testCountsExactly();
+    void testCountsApproximately();
+    void testDiscreteQueryNeedsExactCounts();
+    void testMerge();
+    void testToByteArrayAndBack();
+    void testBoundedSize();
+};
@@ -0,0 +1,79 @@
+#include <QTest>
+
+#include <core/histogram.hpp>
+
+#include "histogram_test.hpp"
+
+void HistogramTest::testBucketOf()
+{
+    Histogram histogram(0, 10, 3);
+    QCOMPARE(histogram.bucketOf(-0.5), -1);
+    QCOMPARE(histogram.bucketOf(0), 0);
+    QCOMPARE(histogram.bucketOf(9.99), 0);
+    QCOMPARE(histogram.bucketOf(10), 1);
+    QCOMPARE(histogram.bucketOf(29), 2);
+    QCOMPARE(histogram.bucketOf(30), 3);
+    QCOMPARE(histogram.bucketOf(1e300), 3);
+    QCOMPARE(histogram.bucketOf(std::nan("")), 3);
+}
+
+void HistogramTest::testBucketOfFractionalWidth()
+{
+    Histogram histogram(-1, 0.5, 4);
+    QCOMPARE(histogram.bucketOf(-1.5), -1);
+    QCOMPARE(histogram.bucketOf(-1), 0);
+    QCOMPARE(histogram.bucketOf(-0.25), 1);
+    QCOMPARE(histogram.bucketOf(0.75), 3);
+    QCOMPARE(histogram.bucketOf(1), 4);
+}
+
+void HistogramTest::testGetCohorts()
+{
+    const QList<QString> expected
+        = { "(-inf, 0)", "[0, 2.5)", "[2.5, 5)", "[5, inf)" };
+    QCOMPARE(Histogram(0, 2.5, 2).getCohorts(), expected);
+}
+
+// Kept in sync with BOUNDS in the server's test_histogram.py.
+void HistogramTest::testFormatBound_data()
+{
+    QTest::addColumn<double>("bound");
+    QTest::addColumn<QString>("expected");
+
+    QTest::newRow("zero") << 0.0 << "0";
+    QTest::newRow("negative") << -2.5 << "-2.5";
+    QTest::newRow("small") << 0.0001 << "0.0001";
+    QTest::newRow("smaller") << 0.00001 << "1e-05";
+    QTest::newRow("large integer") << 2e15 << "2000000000000000";
+    QTest::newRow("largest exact integer")
+        << 9007199254740992.0 << "9007199254740992";
+    QTest::newRow("inexact integer")
+        << 9007199254740994.0 << "9007199254740994.0";
+    QTest::newRow("large fraction")
+        << 1234567890123456.5 << "1234567890123456.5";
+    QTest::newRow("huge") << 1e16 << "1e+16";
+    QTest::newRow("huge with mantissa") << 1.5e16 << "1.5e+16";
+}
+
+void HistogramTest::testFormatBound()
+{
+    QFETCH(double, bound);
+    QFETCH(QString, expected);
+
+    // The underflow cohort only has the start as bound.
+    QCOMPARE(Histogram(bound, 1, 1).getCohorts().first(),
+        QString("(-inf, %1)").arg(expected));
+}
+
+void HistogramTest::testInvalid()
+{
+    QVERIFY_EXCEPTION_THROWN((Histogram(0, 0, 1)), std::invalid_argument);
+    QVERIFY_EXCEPTION_THROWN((Histogram(0, -1, 1)), std::invalid_argument);
+    QVERIFY_EXCEPTION_THROWN((Histogram(0, 1, 0)), std::invalid_argument);
+    QVERIFY_EXCEPTION_THROWN((Histogram(0, 1, Histogram::maxBucketCount + 1)),
+        std::invalid_argument);
+    QCOMPARE(Histogram(0, 1, Histogram::maxBucketCount).getCohorts().count(),
+        Histogram::maxBucketCount + 2);
+}
+
+QTEST_MAIN(HistogramTest)
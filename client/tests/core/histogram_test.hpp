@@ -0,0 +1,15 @@
+#pragma once
+
+#include <QObject>
+
+class HistogramTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testBucketOf();
+    void testBucketOfFractionalWidth();
+    void testGetCohorts();
+    void testFormatBound_data();
+    void testFormatBound();
+    void testInvalid();
+};
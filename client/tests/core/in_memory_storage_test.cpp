@@ -0,0 +1,62 @@
+#include <QTest>
+
+#include <core/in_memory_storage.hpp>
+#include <core/survey.hpp>
+
+#include "in_memory_storage_test.hpp"
+
+namespace {
+const QString snapshotPath = "test-snapshot.bin";
+}
+
+Storage* InMemoryStorageTest::createStorage()
+{
+    // Only snapshots on destruction, which is all reopening needs.
+    return new InMemoryStorage(snapshotPath, std::chrono::milliseconds::zero());
+}
+
+void InMemoryStorageTest::removeStorageData() { QFile::remove(snapshotPath); }
+
+void InMemoryStorageTest::testWithoutSnapshotPath()
+{
+    {
+        InMemoryStorage other;
+        other.addDataPoint("a", "1");
+        QCOMPARE(other.listDataPoints().count(), 1);
+        QVERIFY(other.saveSnapshot().isSuccess());
+    }
+    InMemoryStorage other;
+    QVERIFY(other.listDataPoints().isEmpty());
+}
+
+void InMemoryStorageTest::testSaveSnapshotPeriodically()
+{
+    delete storage;
+    removeStorageData();
+    storage = new InMemoryStorage(snapshotPath, std::chrono::milliseconds(10));
+    storage->addDataPoint("a", "1");
+
+    QTRY_VERIFY(QFile::exists(snapshotPath));
+    InMemoryStorage recovered(snapshotPath, std::chrono::milliseconds::zero());
+    QCOMPARE(recovered.listDataPoints("a").count(), 1);
+}
+
+void InMemoryStorageTest::testStartEmptyWithCorruptSnapshot()
+{
+    storage->addDataPoint("a", "1");
+    storage->addSurveyRecord(
+        Survey("1", "1"), "1", "", "", std::nullopt, std::nullopt);
+    delete storage;
+    storage = nullptr;
+
+    QFile file(snapshotPath);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QVERIFY(file.resize(file.size() / 2));
+    file.close();
+
+    storage = createStorage();
+    QVERIFY(storage->listDataPoints().isEmpty());
+    QVERIFY(storage->listSurveyRecords().isEmpty());
+}
+
+QTEST_MAIN(InMemoryStorageTest)
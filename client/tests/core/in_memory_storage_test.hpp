@@ -0,0 +1,16 @@
+#pragma once
+
+#include "storage_conformance.hpp"
+
+class InMemoryStorageTest : public StorageConformanceTest {
+    Q_OBJECT
+
+protected:
+    Storage* createStorage();
+    void removeStorageData();
+
+private slots:
+    void testWithoutSnapshotPath();
+    void testSaveSnapshotPeriodically();
+    void testStartEmptyWithCorruptSnapshot();
+};
@@ -1,3 +1,5 @@
+#include <QSqlDatabase>
+#include <QSqlQuery>
 #include <QTest>
 
 #include <core/sqlite_storage.hpp>
@@ -8,137 +10,214 @@
 
 namespace {
 const QString databasePath = "test-db.sqlite3";
-};
 
-void SqliteStorageTest::init() { storage = new SqliteStorage(databasePath); }
+const QString inspectConnectionName = "inspect";
 
-void SqliteStorageTest::cleanup()
+// Runs the statement on a connection of its own and returns the values of the
+// given column, so the storage's connections stay untouched.
+QStringList queryColumn(const QString& statement, int column)
 {
-    delete storage;
-    QFile dbFile(databasePath);
-    dbFile.remove();
+    QStringList values;
+    {
+        auto db = QSqlDatabase::addDatabase("QSQLITE", inspectConnectionName);
+        db.setDatabaseName(databasePath);
+        db.open();
+        QSqlQuery query(db);
+        query.prepare(statement);
+        if (statement.contains('?'))
+            query.bindValue(0, "key");
+        query.exec();
+        while (query.next())
+            values.append(query.value(column).toString());
+    }
+    QSqlDatabase::removeDatabase(inspectConnectionName);
+    return values;
 }
 
-void SqliteStorageTest::testListDataPointsInitiallyEmpty()
+QString queryPlan(const QString& statement)
 {
-    const auto dataPoints = storage->listDataPoints();
-    QCOMPARE(dataPoints.count(), 0);
+    return queryColumn("EXPLAIN QUERY PLAN " + statement, 3).join("\n");
 }
 
-void SqliteStorageTest::testAddAndListDataPoints()
+int schemaVersion()
 {
-    storage->addDataPoint("timestamp", "1337");
-    const auto dataPoints = storage->listDataPoints();
-    QCOMPARE(dataPoints.count(), 1);
-    const auto first = dataPoints.first();
-    QCOMPARE(first.key, "timestamp");
-    QCOMPARE(first.value, "1337");
-    QCOMPARE(first.createdAt.date(), QDate::currentDate());
+    return queryColumn("PRAGMA user_version", 0).value(0).toInt();
 }
 
-void SqliteStorageTest::testListDataPointsByName()
+int legacyBlobCount()
 {
-    storage->addDataPoint("a", "a");
-    storage->addDataPoint("b", "b");
-    QCOMPARE(storage->listDataPoints().size(), 2);
-    QCOMPARE(storage->listDataPoints("a").size(), 1);
+    return queryColumn(R"(
+        SELECT
+            (SELECT COUNT(*) FROM survey_record
+                WHERE substr(survey_data, 1, 1) = '{')
+            + (SELECT COUNT(*) FROM survey_response_record
+                WHERE substr(data, 1, 1) = '{')
+    )",
+        0)
+        .value(0)
+        .toInt();
 }
+};
 
-void SqliteStorageTest::testAddAndListSurveyResponses()
+Storage* SqliteStorageTest::createStorage()
 {
-    QCOMPARE(storage->listSurveyResponses().count(), 0);
-
-    Survey survey("1", "testName");
-    SurveyResponse response("1");
-    storage->addSurveyResponse(response, survey);
-
-    QCOMPARE(storage->listSurveyResponses().count(), 1);
+    return new SqliteStorage(databasePath);
 }
 
-void SqliteStorageTest::testAddAndListSurveyResponseWithSurvey()
+void SqliteStorageTest::removeStorageData()
 {
-    QCOMPARE(storage->listSurveyResponses().count(), 0);
+    for (const auto& suffix : { "", "-wal", "-shm" })
+        QFile::remove(databasePath + suffix);
+}
 
-    auto commissioner
-        = QSharedPointer<Commissioner>::create("testCommissioner");
-    Survey survey("1", "testName");
-    survey.commissioner = commissioner;
-    storage->addSurveyRecord(survey, "", "", "", std::nullopt, std::nullopt);
+void SqliteStorageTest::testMigrateSetsSchemaVersion()
+{
+    QCOMPARE(schemaVersion(), 6);
 
-    SurveyResponse response("1");
-    storage->addSurveyResponse(response, survey);
+    // Opening a current database again doesn't change anything.
+    reopenStorage();
+    QCOMPARE(schemaVersion(), 6);
+}
 
-    QCOMPARE(storage->listSurveyResponses().count(), 1);
+void SqliteStorageTest::testQueryPlansUseIndexes_data()
+{
+    QTest::addColumn<QString>("statement");
+    QTest::addColumn<QString>("expectedPlan");
+
+    QTest::newRow("discrete cohorts")
+        << "SELECT value, COUNT(*) FROM data_point WHERE key = ? GROUP BY "
+           "value"
+        << "USING COVERING INDEX data_point_key_value (key=?)";
+    QTest::newRow("data point present")
+        << "SELECT EXISTS(SELECT 1 FROM data_point WHERE key = ?)"
+        << "USING COVERING INDEX data_point_key_value (key=?)";
+    QTest::newRow("survey response")
+        << "SELECT data, created_at FROM survey_response_record WHERE "
+           "survey_id = ?"
+        << "USING INDEX survey_response_record_survey_id (survey_id=?)";
+    QTest::newRow("survey record")
+        << "SELECT survey_data FROM survey_record WHERE survey_id = ?"
+        << "USING INDEX survey_record_survey_id (survey_id=?)";
+}
 
-    auto surveyResponse = storage->listSurveyResponses().first();
-    QCOMPARE(surveyResponse.response->surveyId, "1");
+void SqliteStorageTest::testQueryPlansUseIndexes()
+{
+    QFETCH(QString, statement);
+    QFETCH(QString, expectedPlan);
 
-    auto surveyRecord = surveyResponse.surveyRecord;
-    QVERIFY(!surveyRecord.isNull());
+    const auto plan = queryPlan(statement);
+    QVERIFY2(plan.contains(expectedPlan), qPrintable(plan));
+}
 
-    auto storedSurvey = surveyRecord->survey;
-    QCOMPARE(storedSurvey->id, "1");
-    QCOMPARE(storedSurvey->commissioner->name, "testCommissioner");
-    QCOMPARE(storedSurvey->name, "testName");
+void SqliteStorageTest::testRemoveConnectionWhenThreadFinishes()
+{
+    const auto connectionCount = QSqlDatabase::connectionNames().count();
+    auto threadConnectionCount = connectionCount;
+    QScopedPointer<QThread> thread(QThread::create([&]() {
+        storage->addDataPoint("a", "1");
+        threadConnectionCount = QSqlDatabase::connectionNames().count();
+    }));
+    thread->start();
+    QVERIFY(thread->wait(5000));
+
+    QCOMPARE(threadConnectionCount, connectionCount + 1);
+    QCOMPARE(QSqlDatabase::connectionNames().count(), connectionCount);
+    QCOMPARE(storage->listDataPoints("a").count(), 1);
 }
 
-void SqliteStorageTest::testAddAndListSurveyRecords()
+void SqliteStorageTest::testSeparateStoragesOnSameThread()
 {
-    QCOMPARE(storage->listSurveyRecords().count(), 0);
+    const QString otherPath = "other-test-db.sqlite3";
+    {
+        SqliteStorage other(otherPath);
+        other.addDataPoint("a", "1");
+
+        QVERIFY(storage->listDataPoints().isEmpty());
+        QCOMPARE(other.listDataPoints().count(), 1);
+    }
+    for (const auto& suffix : { "", "-wal", "-shm" })
+        QFile::remove(otherPath + suffix);
+}
 
+// Stores a survey record and response the way earlier versions did.
+void SqliteStorageTest::storeLegacyJsonBlobs()
+{
     Survey survey("1", "testName");
-    QString state("foo");
-    QString clientId("bar");
-    QString publicKey("");
-    QString delegatePublicKey("");
-    storage->addSurveyRecord(survey, clientId, publicKey, delegatePublicKey,
-        std::nullopt, std::nullopt);
-
-    QCOMPARE(storage->listSurveyRecords().count(), 1);
+    survey.commissioner = QSharedPointer<Commissioner>::create("commissioner");
+    storage->addSurveyRecord(survey, "", "", "", std::nullopt, std::nullopt);
+    SurveyResponse response("1",
+        { QSharedPointer<QueryResponse>::create(
+            "query", QMap<QString, int> { { "a", 1 } }) });
+    storage->addSurveyResponse(response, survey);
+    delete storage;
+    storage = nullptr;
+
+    queryColumn(QString("UPDATE survey_record SET survey_data = '%1'")
+                    .arg(QString::fromUtf8(survey.toByteArray())),
+        0);
+    queryColumn(QString("UPDATE survey_response_record SET data = '%1'")
+                    .arg(QString::fromUtf8(response.toJsonByteArray())),
+        0);
+    QCOMPARE(legacyBlobCount(), 2);
 }
 
-void SqliteStorageTest::testSaveSurveyRecord()
+void SqliteStorageTest::testMigrateLegacyJsonBlobs()
 {
-    storage->addSurveyRecord(
-        Survey("1", "1"), "1", "", "", std::nullopt, std::nullopt);
-    auto modifiedRecord = storage->listSurveyRecords().first();
-    modifiedRecord.delegatePublicKey = "2";
-    modifiedRecord.groupSize = 1337;
-    storage->saveSurveyRecord(modifiedRecord);
-    const auto retrievedRecord = storage->listSurveyRecords().first();
-    QCOMPARE(retrievedRecord.getState(), modifiedRecord.getState());
-    QCOMPARE(
-        retrievedRecord.delegatePublicKey, modifiedRecord.delegatePublicKey);
-    QCOMPARE(retrievedRecord.groupSize, modifiedRecord.groupSize);
+    storeLegacyJsonBlobs();
+
+    auto sqliteStorage = new SqliteStorage(databasePath);
+    storage = sqliteStorage;
+    QCOMPARE(storage->findSurveyRecordById("1")->survey->name, "testName");
+    // Only started explicitly, by the daemon.
+    QTest::qWait(100);
+    QCOMPARE(legacyBlobCount(), 2);
+
+    sqliteStorage->startLegacyBlobMigration();
+    QTRY_COMPARE(legacyBlobCount(), 0);
+
+    reopenStorage();
+    const auto record = storage->findSurveyRecordById("1");
+    QCOMPARE(record->survey->commissioner->name, "commissioner");
+    const auto responses = storage->listSurveyResponses();
+    QCOMPARE(responses.count(), 1);
+    QCOMPARE(responses.first().response->queryResponses.first()->cohortData,
+        QMap<QString, int>({ { "a", 1 } }));
 }
 
-void SqliteStorageTest::testAddSurveyWorksWithValuesPresent()
+void SqliteStorageTest::testMigrateLegacyJsonBlobsOnce()
 {
-    Survey testSurvey("123", "test");
-    testSurvey.queries.append(QSharedPointer<Query>::create(
-        "12345", "testDataKey", QList<QString> { "1", "2", "3" }, true));
-    storage->addSurveyRecord(
-        testSurvey, "", "", "", std::nullopt, std::nullopt);
-
-    auto retrievedSurvey = storage->findSurveyRecordById(testSurvey.id);
-    QVERIFY(!retrievedSurvey.isNull());
-
-    auto retrievedSurveyValue = retrievedSurvey->survey;
-    QCOMPARE(retrievedSurveyValue->id, testSurvey.id);
-    QCOMPARE(retrievedSurveyValue->name, testSurvey.name);
-    QCOMPARE(retrievedSurveyValue->queries.first()->id,
-        testSurvey.queries.first()->id);
-    QCOMPARE(retrievedSurveyValue->queries.first()->dataKey,
-        testSurvey.queries.first()->dataKey);
-    QCOMPARE(retrievedSurveyValue->queries.first()->cohorts,
-        testSurvey.queries.first()->cohorts);
-    QCOMPARE(retrievedSurveyValue->queries.first()->discrete,
-        testSurvey.queries.first()->discrete);
+    auto sqliteStorage = new SqliteStorage(databasePath);
+    storage = sqliteStorage;
+    sqliteStorage->startLegacyBlobMigration();
+    QTRY_COMPARE(queryColumn("SELECT name FROM completed_task", 0),
+        QStringList({ "legacy_blob_migration" }));
+
+    // Later versions never write JSON, so this only shows it didn't run.
+    storeLegacyJsonBlobs();
+    sqliteStorage = new SqliteStorage(databasePath);
+    storage = sqliteStorage;
+    sqliteStorage->startLegacyBlobMigration();
+    QTest::qWait(100);
+    QCOMPARE(legacyBlobCount(), 2);
 }
 
-void SqliteStorageTest::testAddSurveyWorksWithReturningNullWhenNotFound()
+void SqliteStorageTest::testEnableSketchKeepsDataPointsOnFailure()
 {
-    QVERIFY(storage->findSurveyRecordById("123").isNull());
+    storage->addDataPoint("a", "1");
+    queryColumn("CREATE TRIGGER fail_sketch BEFORE INSERT ON data_sketch "
+                "BEGIN SELECT RAISE(ABORT, 'full'); END",
+        0);
+
+    QVERIFY(!storage->enableSketch("a"));
+    QCOMPARE(storage->listDataPoints("a").count(), 1);
+    storage->addDataPoint("a", "2");
+    QCOMPARE(storage->listDataPoints("a").count(), 2);
+
+    queryColumn("DROP TRIGGER fail_sketch", 0);
+    reopenStorage();
+    QCOMPARE(storage->listDataPoints("a").count(), 2);
+    QVERIFY(storage->enableSketch("a"));
+    QCOMPARE(storage->listDataPoints("a").count(), 0);
 }
 
 QTEST_MAIN(SqliteStorageTest)
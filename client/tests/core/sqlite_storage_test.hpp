@@ -1,25 +1,22 @@
 #pragma once
 
-#include <QObject>
+#include "storage_conformance.hpp"
 
-class Storage;
-
-class SqliteStorageTest : public QObject {
+class SqliteStorageTest : public StorageConformanceTest {
     Q_OBJECT
 
-private:
-    Storage* storage;
+protected:
+    Storage* createStorage();
+    void removeStorageData();
+    void storeLegacyJsonBlobs();
 
 private slots:
-    void init();
-    void cleanup();
-    void testListDataPointsInitiallyEmpty();
-    void testAddAndListDataPoints();
-    void testListDataPointsByName();
-    void testAddAndListSurveyResponses();
-    void testAddAndListSurveyResponseWithSurvey();
-    void testAddAndListSurveyRecords();
-    void testSaveSurveyRecord();
-    void testAddSurveyWorksWithValuesPresent();
-    void testAddSurveyWorksWithReturningNullWhenNotFound();
+    void testMigrateSetsSchemaVersion();
+    void testQueryPlansUseIndexes();
+    void testQueryPlansUseIndexes_data();
+    void testRemoveConnectionWhenThreadFinishes();
+    void testSeparateStoragesOnSameThread();
+    void testMigrateLegacyJsonBlobs();
+    void testMigrateLegacyJsonBlobsOnce();
+    void testEnableSketchKeepsDataPointsOnFailure();
 };
@@ -0,0 +1,539 @@
+#include <QTest>
+
+#include <core/storage.hpp>
+#include <core/survey.hpp>
+#include <core/survey_response.hpp>
+
+#include "storage_conformance.hpp"
+
+void StorageConformanceTest::reopenStorage()
+{
+    delete storage;
+    storage = createStorage();
+}
+
+void StorageConformanceTest::init() { storage = createStorage(); }
+
+void StorageConformanceTest::cleanup()
+{
+    delete storage;
+    storage = nullptr;
+    removeStorageData();
+}
+
+void StorageConformanceTest::testListDataPointsInitiallyEmpty()
+{
+    const auto dataPoints = storage->listDataPoints();
+    QCOMPARE(dataPoints.count(), 0);
+}
+
+void StorageConformanceTest::testAddAndListDataPoints()
+{
+    storage->addDataPoint("timestamp", "1337");
+    const auto dataPoints = storage->listDataPoints();
+    QCOMPARE(dataPoints.count(), 1);
+    const auto first = dataPoints.first();
+    QCOMPARE(first.key, "timestamp");
+    QCOMPARE(first.value, "1337");
+    QCOMPARE(first.createdAt.date(), QDate::currentDate());
+}
+
+void StorageConformanceTest::testListDataPointsByName()
+{
+    storage->addDataPoint("a", "a");
+    storage->addDataPoint("b", "b");
+    QCOMPARE(storage->listDataPoints().size(), 2);
+    QCOMPARE(storage->listDataPoints("a").size(), 1);
+}
+
+void StorageConformanceTest::testForEachDataPoint()
+{
+    storage->addDataPoint("a", "1");
+    storage->addDataPoint("b", "2");
+    storage->addDataPoint("a", "3");
+
+    QStringList values;
+    storage->forEachDataPoint("a", [&values](const DataPoint& dataPoint) {
+        values.append(dataPoint.value);
+        return true;
+    });
+    QCOMPARE(values, QStringList({ "1", "3" }));
+}
+
+void StorageConformanceTest::testForEachDataPointStopsEarly()
+{
+    storage->addDataPoint("a", "1");
+    storage->addDataPoint("a", "2");
+
+    int calls = 0;
+    storage->forEachDataPoint("", [&calls](const DataPoint&) {
+        calls++;
+        return false;
+    });
+    QCOMPARE(calls, 1);
+}
+
+void StorageConformanceTest::testAddDataPoints()
+{
+    QList<DataPoint> dataPoints;
+    const auto createdAt = QDateTime::currentDateTimeUtc();
+    for (int i = 0; i < 250; i++)
+        dataPoints.append({ .key = "a",
+            .value = QString::number(i),
+            .createdAt = createdAt });
+
+    QVERIFY(storage->addDataPoints(dataPoints));
+
+    const auto storedDataPoints = storage->listDataPoints("a");
+    QCOMPARE(storedDataPoints.count(), 250);
+    QCOMPARE(storedDataPoints.last().value, "249");
+    QCOMPARE(storage->findLatestDataPoint("a")->value, "249");
+}
+
+void StorageConformanceTest::testCheckIfDataPointPresent()
+{
+    QVERIFY(!storage->checkIfDataPointPresent("a"));
+
+    storage->addDataPoint("a", "1");
+    QVERIFY(storage->checkIfDataPointPresent("a"));
+    QVERIFY(!storage->checkIfDataPointPresent("b"));
+
+    // The known keys are loaded again on start.
+    reopenStorage();
+    QVERIFY(storage->checkIfDataPointPresent("a"));
+}
+
+void StorageConformanceTest::testCheckIfDataPointPresentIsCaseSensitive()
+{
+    storage->addDataPoint("Key", "1");
+
+    // Matches what countCohorts finds for the key.
+    QVERIFY(storage->checkIfDataPointPresent("Key"));
+    QVERIFY(!storage->checkIfDataPointPresent("key"));
+    QVERIFY(!storage->checkIfDataPointPresent("KEY"));
+    const auto query = QSharedPointer<Query>::create(
+        "1", "key", QList<QString> { "1" }, true);
+    QVERIFY(storage->countCohorts("key", { query }).isEmpty());
+}
+
+void StorageConformanceTest::testAddDataPointsFromOtherThread()
+{
+    QScopedPointer<QThread> thread(QThread::create([this]() {
+        storage->addDataPoints({ { .key = "a",
+            .value = "1",
+            .createdAt = QDateTime::currentDateTimeUtc() } });
+    }));
+    thread->start();
+    QVERIFY(thread->wait(5000));
+
+    QCOMPARE(storage->listDataPoints("a").count(), 1);
+}
+
+void StorageConformanceTest::testCountCohortsWithoutDataPoints()
+{
+    storage->addDataPoint("b", "1");
+    const auto query = QSharedPointer<Query>::create(
+        "1", "a", QList<QString> { "1", "2" }, true);
+    QVERIFY(storage->countCohorts("a", { query }).isEmpty());
+}
+
+void StorageConformanceTest::testCountDiscreteCohorts()
+{
+    storage->addDataPoint("a", "1");
+    storage->addDataPoint("a", "2");
+    storage->addDataPoint("a", "2");
+    storage->addDataPoint("a", "4");
+    storage->addDataPoint("b", "1");
+    const auto query = QSharedPointer<Query>::create(
+        "1", "a", QList<QString> { "1", "2", "3" }, true);
+
+    const QMap<QString, int> expected = { { "1", 1 }, { "2", 2 }, { "3", 0 } };
+    QCOMPARE(storage->countCohorts("a", { query }).value("1"), expected);
+}
+
+void StorageConformanceTest::testCountIntervalCohorts()
+{
+    storage->addDataPoint("a", "8");
+    storage->addDataPoint("a", "16");
+    storage->addDataPoint("a", "31");
+    storage->addDataPoint("a", "10000.23");
+    storage->addDataPoint("b", "20");
+    const auto query = QSharedPointer<Query>::create("1", "a",
+        QList<QString> { "(-inf, 16)", "[16, 32)", "(16, 32]", "[32, inf)" },
+        false);
+
+    const QMap<QString, int> expected = { { "(-inf, 16)", 1 },
+        { "[16, 32)", 2 }, { "(16, 32]", 1 }, { "[32, inf)", 1 } };
+    QCOMPARE(storage->countCohorts("a", { query }).value("1"), expected);
+}
+
+void StorageConformanceTest::testCountCohortsOfSeveralQueries()
+{
+    storage->addDataPoint("a", "8");
+    storage->addDataPoint("a", "16");
+    storage->addDataPoint("a", "16");
+    const auto discreteQuery = QSharedPointer<Query>::create(
+        "1", "a", QList<QString> { "8", "16" }, true);
+    const auto intervalQuery = QSharedPointer<Query>::create(
+        "2", "a", QList<QString> { "[0, 10)", "[10, 20)" }, false);
+
+    const auto cohortCounts
+        = storage->countCohorts("a", { discreteQuery, intervalQuery });
+
+    const QMap<QString, int> expectedDiscrete = { { "8", 1 }, { "16", 2 } };
+    const QMap<QString, int> expectedInterval
+        = { { "[0, 10)", 1 }, { "[10, 20)", 2 } };
+    QCOMPARE(cohortCounts.count(), 2);
+    QCOMPARE(cohortCounts.value("1"), expectedDiscrete);
+    QCOMPARE(cohortCounts.value("2"), expectedInterval);
+}
+
+void StorageConformanceTest::testCountHistogramCohorts()
+{
+    storage->addDataPoint("a", "-1");
+    storage->addDataPoint("a", "0");
+    storage->addDataPoint("a", "9.5");
+    storage->addDataPoint("a", "15");
+    storage->addDataPoint("a", "20");
+    const auto query
+        = QSharedPointer<Query>::create("1", "a", Histogram(0, 10, 2));
+
+    const QMap<QString, int> expected = { { "(-inf, 0)", 1 },
+        { "[0, 10)", 2 }, { "[10, 20)", 1 }, { "[20, inf)", 1 } };
+    QCOMPARE(storage->countCohorts("a", { query }).value("1"), expected);
+}
+
+void StorageConformanceTest::testCountHistogramWithOtherQueries()
+{
+    storage->addDataPoint("a", "-1");
+    storage->addDataPoint("a", "5");
+    storage->addDataPoint("a", "15");
+    const auto firstHistogram
+        = QSharedPointer<Query>::create("1", "a", Histogram(0, 10, 1));
+    const auto secondHistogram
+        = QSharedPointer<Query>::create("2", "a", Histogram(-5, 5, 2));
+    const auto intervalQuery = QSharedPointer<Query>::create(
+        "3", "a", QList<QString> { "[0, 10)", "[10, 20)" }, false);
+
+    const auto cohortCounts = storage->countCohorts(
+        "a", { firstHistogram, intervalQuery, secondHistogram });
+
+    const QMap<QString, int> expectedFirst
+        = { { "(-inf, 0)", 1 }, { "[0, 10)", 1 }, { "[10, inf)", 1 } };
+    const QMap<QString, int> expectedSecond = { { "(-inf, -5)", 0 },
+        { "[-5, 0)", 1 }, { "[0, 5)", 0 }, { "[5, inf)", 2 } };
+    const QMap<QString, int> expectedInterval
+        = { { "[0, 10)", 1 }, { "[10, 20)", 1 } };
+    QCOMPARE(cohortCounts.count(), 3);
+    QCOMPARE(cohortCounts.value("1"), expectedFirst);
+    QCOMPARE(cohortCounts.value("2"), expectedSecond);
+    QCOMPARE(cohortCounts.value("3"), expectedInterval);
+}
+
+void StorageConformanceTest::testCountManyCohorts()
+{
+    for (int i = 0; i < 10; i++)
+        storage->addDataPoint("a", QString::number(i));
+    // More columns and bound values than SQLite takes in one statement.
+    QList<QString> cohorts;
+    for (int i = 0; i < 1500; i++)
+        cohorts.append(QString("[%1, %2)").arg(i).arg(i + 1));
+    const auto intervalQuery
+        = QSharedPointer<Query>::create("1", "a", cohorts, false);
+    const auto histogramQuery
+        = QSharedPointer<Query>::create(
+            "2", "a", Histogram(0, 1, Histogram::maxBucketCount));
+
+    const auto cohortCounts
+        = storage->countCohorts("a", { intervalQuery, histogramQuery });
+
+    const auto intervalCounts = cohortCounts.value("1");
+    QCOMPARE(intervalCounts.count(), 1500);
+    QCOMPARE(intervalCounts.value("[9, 10)"), 1);
+    QCOMPARE(intervalCounts.value("[10, 11)"), 0);
+    QCOMPARE(intervalCounts.value("[1499, 1500)"), 0);
+    const auto histogramCounts = cohortCounts.value("2");
+    QCOMPARE(histogramCounts.count(), Histogram::maxBucketCount + 2);
+    QCOMPARE(histogramCounts.value("(-inf, 0)"), 0);
+    QCOMPARE(histogramCounts.value("[0, 1)"), 1);
+    QCOMPARE(histogramCounts.value("[9, 10)"), 1);
+    QCOMPARE(histogramCounts.value("[999, 1000)"), 0);
+    QCOMPARE(histogramCounts.value("[1000, inf)"), 0);
+}
+
+void StorageConformanceTest::testFindLatestDataPoint()
+{
+    QVERIFY(!storage->findLatestDataPoint("a").has_value());
+
+    storage->addDataPoint("a", "1");
+    storage->addDataPoint("a", "2");
+    storage->addDataPoint("b", "3");
+
+    QCOMPARE(storage->findLatestDataPoint("a")->value, "2");
+    QCOMPARE(storage->findLatestDataPoint("b")->value, "3");
+}
+
+void StorageConformanceTest::testCountLatestCohorts()
+{
+    storage->addDataPoint("a", "1");
+    storage->addDataPoint("a", "2");
+    const auto query = QSharedPointer<Query>::create(
+        "1", "a", QList<QString> { "1", "2" }, true, true);
+
+    const QMap<QString, int> expected = { { "1", 0 }, { "2", 1 } };
+    QCOMPARE(storage->countCohorts("a", { query }).value("1"), expected);
+}
+
+void StorageConformanceTest::testCountSketchedCohorts()
+{
+    storage->addDataPoint("a", "1");
+    storage->enableSketch("a");
+    storage->addDataPoint("a", "2");
+    storage->addDataPoint("a", "2");
+    QCOMPARE(storage->listDataPoints("a").count(), 0);
+
+    // The sketch has to survive a restart.
+    reopenStorage();
+
+    const auto query = QSharedPointer<Query>::create(
+        "1", "a", QList<QString> { "1", "2" }, true);
+    const QMap<QString, int> expected = { { "1", 1 }, { "2", 2 } };
+    QCOMPARE(storage->countCohorts("a", { query }).value("1"), expected);
+    QVERIFY(storage->checkIfDataPointPresent("a"));
+    QCOMPARE(storage->findLatestDataPoint("a")->value, "2");
+}
+
+void StorageConformanceTest::testAddSketchedDataPointsInBatch()
+{
+    storage->enableSketch("a");
+    const auto createdAt = QDateTime::currentDateTimeUtc();
+    QList<DataPoint> dataPoints;
+    for (const auto& value : { "1", "2", "2", "3" })
+        dataPoints.append(
+            { .key = "a", .value = value, .createdAt = createdAt });
+    dataPoints.insert(2, { .key = "b", .value = "1", .createdAt = createdAt });
+    QVERIFY(storage->addDataPoints(dataPoints));
+
+    reopenStorage();
+
+    const auto query = QSharedPointer<Query>::create(
+        "1", "a", QList<QString> { "1", "2", "3" }, true);
+    const QMap<QString, int> expected = { { "1", 1 }, { "2", 2 }, { "3", 1 } };
+    QCOMPARE(storage->countCohorts("a", { query }).value("1"), expected);
+    QCOMPARE(storage->findLatestDataPoint("a")->value, "3");
+    QCOMPARE(storage->listDataPoints("b").count(), 1);
+}
+
+void StorageConformanceTest::testAddAndListSurveyResponses()
+{
+    QCOMPARE(storage->listSurveyResponses().count(), 0);
+
+    Survey survey("1", "testName");
+    SurveyResponse response("1");
+    storage->addSurveyResponse(response, survey);
+
+    QCOMPARE(storage->listSurveyResponses().count(), 1);
+}
+
+void StorageConformanceTest::testAddAndListSurveyResponseWithSurvey()
+{
+    QCOMPARE(storage->listSurveyResponses().count(), 0);
+
+    auto commissioner
+        = QSharedPointer<Commissioner>::create("testCommissioner");
+    Survey survey("1", "testName");
+    survey.commissioner = commissioner;
+    storage->addSurveyRecord(survey, "", "", "", std::nullopt, std::nullopt);
+
+    SurveyResponse response("1");
+    storage->addSurveyResponse(response, survey);
+
+    QCOMPARE(storage->listSurveyResponses().count(), 1);
+
+    auto surveyResponse = storage->listSurveyResponses().first();
+    QCOMPARE(surveyResponse.response->surveyId, "1");
+
+    auto surveyRecord = surveyResponse.surveyRecord;
+    QVERIFY(!surveyRecord.isNull());
+
+    auto storedSurvey = surveyRecord->survey;
+    QCOMPARE(storedSurvey->id, "1");
+    QCOMPARE(storedSurvey->commissioner->name, "testCommissioner");
+    QCOMPARE(storedSurvey->name, "testName");
+}
+
+void StorageConformanceTest::testAddAndListSurveyRecords()
+{
+    QCOMPARE(storage->listSurveyRecords().count(), 0);
+
+    Survey survey("1", "testName");
+    QString state("foo");
+    QString clientId("bar");
+    QString publicKey("");
+    QString delegatePublicKey("");
+    storage->addSurveyRecord(survey, clientId, publicKey, delegatePublicKey,
+        std::nullopt, std::nullopt);
+
+    QCOMPARE(storage->listSurveyRecords().count(), 1);
+}
+
+void StorageConformanceTest::testListSurveyRecordsWithResponse()
+{
+    Survey survey("1", "testName");
+    storage->addSurveyRecord(survey, "1", "", "", std::nullopt, std::nullopt);
+    storage->addSurveyRecord(
+        Survey("2", "testName"), "2", "", "", std::nullopt, std::nullopt);
+    storage->addSurveyResponse(SurveyResponse("1"), survey);
+
+    const auto records = storage->listSurveyRecords();
+    QCOMPARE(records.count(), 2);
+    for (const auto& record : records)
+        QCOMPARE(record.getState() == Done, record.survey->id == "1");
+}
+
+void StorageConformanceTest::testSaveSurveyRecord()
+{
+    storage->addSurveyRecord(
+        Survey("1", "1"), "1", "", "", std::nullopt, std::nullopt);
+    auto modifiedRecord = storage->listSurveyRecords().first();
+    modifiedRecord.delegatePublicKey = "2";
+    modifiedRecord.groupSize = 1337;
+    storage->saveSurveyRecord(modifiedRecord);
+    const auto retrievedRecord = storage->listSurveyRecords().first();
+    QCOMPARE(retrievedRecord.getState(), modifiedRecord.getState());
+    QCOMPARE(
+        retrievedRecord.delegatePublicKey, modifiedRecord.delegatePublicKey);
+    QCOMPARE(retrievedRecord.groupSize, modifiedRecord.groupSize);
+}
+
+void StorageConformanceTest::testRollback()
+{
+    storage->transaction();
+    storage->addDataPoint("a", "1");
+    storage->rollback();
+
+    QCOMPARE(storage->listDataPoints().count(), 0);
+}
+
+void StorageConformanceTest::testRollbackNestedTransaction()
+{
+    storage->transaction();
+    storage->addDataPoint("a", "1");
+    storage->transaction();
+    storage->addDataPoint("a", "2");
+    storage->rollback();
+    storage->commit();
+
+    const auto dataPoints = storage->listDataPoints();
+    QCOMPARE(dataPoints.count(), 1);
+    QCOMPARE(dataPoints.first().value, "1");
+}
+
+void StorageConformanceTest::testListSurveyRecordsByState()
+{
+    Survey survey("1", "testName");
+    storage->addSurveyRecord(survey, "1", "", "", std::nullopt, std::nullopt);
+    storage->addSurveyRecord(
+        Survey("2", "testName"), "2", "", "", std::nullopt, std::nullopt);
+    storage->addSurveyResponse(SurveyResponse("1"), survey);
+
+    const auto initialRecords = storage->listSurveyRecords(Initial);
+    QCOMPARE(initialRecords.count(), 1);
+    QCOMPARE(initialRecords.first().survey->id, "2");
+    const auto doneRecords = storage->listSurveyRecords(Done);
+    QCOMPARE(doneRecords.count(), 1);
+    QCOMPARE(doneRecords.first().survey->id, "1");
+    QCOMPARE(storage->listSurveyRecords(Processing).count(), 0);
+}
+
+void StorageConformanceTest::testSaveSurveyRecordOnCommit()
+{
+    storage->addSurveyRecord(
+        Survey("1", "1"), "1", "", "", std::nullopt, std::nullopt);
+    auto record = storage->listSurveyRecords().first();
+    record.delegatePublicKey = "2";
+
+    storage->transaction();
+    storage->saveSurveyRecord(record);
+    storage->commit();
+
+    reopenStorage();
+    QCOMPARE(storage->listSurveyRecords().first().delegatePublicKey, "2");
+}
+
+void StorageConformanceTest::testRollbackSaveSurveyRecord()
+{
+    storage->addSurveyRecord(
+        Survey("1", "1"), "1", "", "", std::nullopt, std::nullopt);
+    auto record = storage->listSurveyRecords().first();
+    record.delegatePublicKey = "2";
+
+    storage->transaction();
+    storage->saveSurveyRecord(record);
+    storage->rollback();
+
+    QCOMPARE(storage->listSurveyRecords().first().delegatePublicKey, "");
+}
+
+void StorageConformanceTest::testAddSurveyWorksWithValuesPresent()
+{
+    Survey testSurvey("123", "test");
+    testSurvey.queries.append(QSharedPointer<Query>::create(
+        "12345", "testDataKey", QList<QString> { "1", "2", "3" }, true));
+    storage->addSurveyRecord(
+        testSurvey, "", "", "", std::nullopt, std::nullopt);
+    // Read the record back as after a restart.
+    reopenStorage();
+
+    auto retrievedSurvey = storage->findSurveyRecordById(testSurvey.id);
+    QVERIFY(!retrievedSurvey.isNull());
+
+    auto retrievedSurveyValue = retrievedSurvey->survey;
+    QCOMPARE(retrievedSurveyValue->id, testSurvey.id);
+    QCOMPARE(retrievedSurveyValue->name, testSurvey.name);
+    QCOMPARE(retrievedSurveyValue->queries.first()->id,
+        testSurvey.queries.first()->id);
+    QCOMPARE(retrievedSurveyValue->queries.first()->dataKey,
+        testSurvey.queries.first()->dataKey);
+    QCOMPARE(retrievedSurveyValue->queries.first()->cohorts,
+        testSurvey.queries.first()->cohorts);
+    QCOMPARE(retrievedSurveyValue->queries.first()->discrete,
+        testSurvey.queries.first()->discrete);
+}
+
+void StorageConformanceTest::testAddSurveyWorksWithReturningNullWhenNotFound()
+{
+    QVERIFY(storage->findSurveyRecordById("123").isNull());
+}
+
+void StorageConformanceTest::testFoldDelegateMessages()
+{
+    QCOMPARE(storage->findDelegateAggregation("1").position, qint64(0));
+    QCOMPARE(storage->findDelegateAggregation("1").count, 0);
+    QVERIFY(storage->findDelegateAggregation("1").aggregate.isEmpty());
+
+    storage->foldDelegateMessages("1", { "a", "b" }, "ab", 5);
+    storage->foldDelegateMessages("1", { "c" }, "abc", 7);
+    storage->foldDelegateMessages("2", { "a" }, "a", 1);
+    reopenStorage();
+
+    const auto aggregation = storage->findDelegateAggregation("1");
+    QCOMPARE(aggregation.position, qint64(7));
+    QCOMPARE(aggregation.count, 3);
+    QCOMPARE(aggregation.aggregate, QByteArray("abc"));
+    QVERIFY(storage->checkIfDelegateMessageFolded("1", "b"));
+    QVERIFY(!storage->checkIfDelegateMessageFolded("1", "d"));
+    QVERIFY(!storage->checkIfDelegateMessageFolded("2", "b"));
+}
+
+void StorageConformanceTest::testRemoveDelegateAggregation()
+{
+    storage->foldDelegateMessages("1", { "a" }, "a", 1);
+    storage->foldDelegateMessages("2", { "b" }, "b", 1);
+    storage->removeDelegateAggregation("1");
+
+    QCOMPARE(storage->findDelegateAggregation("1").count, 0);
+    QCOMPARE(storage->findDelegateAggregation("1").position, qint64(0));
+    QVERIFY(!storage->checkIfDelegateMessageFolded("1", "a"));
+    QCOMPARE(storage->findDelegateAggregation("2").count, 1);
+}
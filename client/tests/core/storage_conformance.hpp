@@ -0,0 +1,63 @@
+#pragma once
+
+#include <QObject>
+
+class Storage;
+
+/**
+ * The behaviour every Storage implementation has to share, so they can be
+ * used interchangeably. A test of an implementation derives from this class
+ * to run all of these against it, next to its own tests.
+ */
+class StorageConformanceTest : public QObject {
+    Q_OBJECT
+
+protected:
+    Storage* storage = nullptr;
+
+    // Returns a storage on the data of the current test, including whatever
+    // earlier storages of the test left behind.
+    virtual Storage* createStorage() = 0;
+    // Removes everything the storages of the current test left behind.
+    virtual void removeStorageData() = 0;
+    // Replaces the storage by a new one on the same data, as on a restart.
+    void reopenStorage();
+
+private slots:
+    void init();
+    void cleanup();
+    void testListDataPointsInitiallyEmpty();
+    void testAddAndListDataPoints();
+    void testListDataPointsByName();
+    void testForEachDataPoint();
+    void testForEachDataPointStopsEarly();
+    void testAddDataPoints();
+    void testCheckIfDataPointPresent();
+    void testCheckIfDataPointPresentIsCaseSensitive();
+    void testAddDataPointsFromOtherThread();
+    void testCountCohortsWithoutDataPoints();
+    void testCountDiscreteCohorts();
+    void testCountIntervalCohorts();
+    void testCountCohortsOfSeveralQueries();
+    void testCountHistogramCohorts();
+    void testCountHistogramWithOtherQueries();
+    void testCountManyCohorts();
+    void testFindLatestDataPoint();
+    void testCountLatestCohorts();
+    void testCountSketchedCohorts();
+    void testAddSketchedDataPointsInBatch();
+    void testAddAndListSurveyResponses();
+    void testAddAndListSurveyResponseWithSurvey();
+    void testAddAndListSurveyRecords();
+    void testListSurveyRecordsWithResponse();
+    void testSaveSurveyRecord();
+    void testRollback();
+    void testRollbackNestedTransaction();
+    void testListSurveyRecordsByState();
+    void testSaveSurveyRecordOnCommit();
+    void testRollbackSaveSurveyRecord();
+    void testAddSurveyWorksWithValuesPresent();
+    void testAddSurveyWorksWithReturningNullWhenNotFound();
+    void testFoldDelegateMessages();
+    void testRemoveDelegateAggregation();
+};
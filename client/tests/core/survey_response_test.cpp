@@ -63,6 +63,23 @@ void SurveyResponseTest::testToAndFromByteArray()
         *deserializedResult.getValue()->queryResponses.first());
 }
 
+void SurveyResponseTest::testToAndFromCbor()
+{
+    SurveyResponse response("1");
+    QMap<QString, int> cohortTestData
+        = { { "8", 1 }, { "16", 0 }, { "32", 0 } };
+    response.queryResponses.append(
+        QSharedPointer<QueryResponse>::create("timestamp", cohortTestData));
+
+    const auto result = SurveyResponse::fromCbor(response.toCbor());
+    QVERIFY(result.isSuccess());
+    const auto& deserialized = result.getValue();
+    QCOMPARE(deserialized->surveyId, "1");
+    QCOMPARE(deserialized->queryResponses.count(), 1);
+    QCOMPARE(deserialized->queryResponses.first()->queryId, "timestamp");
+    QCOMPARE(deserialized->queryResponses.first()->cohortData, cohortTestData);
+}
+
 void SurveyResponseTest::testAggregationWithOneQuery()
 {
     auto response = QSharedPointer<SurveyResponse>::create("1");
@@ -9,6 +9,7 @@ private slots:
     void testToByteArrayForEmptyResponse();
     void testToByteArrayForResponse();
     void testToAndFromByteArray();
+    void testToAndFromCbor();
     void testAggregationWithOneQuery();
     void testAggregationWithMultipleQueries();
     void testAggregationReturnsFailureWhenSurveyIdDiffers();
@@ -115,4 +115,103 @@ void SurveyTest::testToByteArrayAndBackWorks()
     QCOMPARE(query->discrete, reimportedQuery->discrete);
 }
 
+void SurveyTest::testFromByteArrayWithHistogram()
+{
+    const auto data = QString(R"({"id": "1234", "name": "test", "queries": [{
+        "id": "1", "data_key": "timestamp", "discrete": false,
+        "histogram": {"start": 0, "width": 10, "bucket_count": 2}
+    }]})")
+                          .toUtf8();
+    const auto surveyParsingResult = Survey::fromByteArray(data);
+    Q_ASSERT(surveyParsingResult.isSuccess());
+    const auto query = surveyParsingResult.getValue()->queries.first();
+
+    const QList<QString> expectedCohorts
+        = { "(-inf, 0)", "[0, 10)", "[10, 20)", "[20, inf)" };
+    QVERIFY(query->histogram.has_value());
+    QCOMPARE(query->histogram->getBucketCount(), 2);
+    QCOMPARE(query->cohorts, expectedCohorts);
+    QCOMPARE(query->discrete, false);
+}
+
+void SurveyTest::testFromByteArrayRejectsTooManyBuckets()
+{
+    const QString data = R"({"id": "1234", "name": "test", "queries": [{
+        "id": "1", "data_key": "timestamp", "discrete": false,
+        "histogram": {"start": 0, "width": 10, "bucket_count": %1}
+    }]})";
+    // The last one would wrap around to 2 as int.
+    for (const auto bucketCount : { "1001", "1000000000", "4294967298" }) {
+        QVERIFY(!Survey::fromByteArray(data.arg(bucketCount).toUtf8())
+                     .isSuccess());
+    }
+}
+
+void SurveyTest::testToByteArrayAndBackWorksWithHistogram()
+{
+    Survey survey("1234", "test");
+    survey.queries.append(QSharedPointer<Query>::create(
+        "1111", "testKey", Histogram(-5, 2.5, 4)));
+
+    const auto reimportedSurveyResult
+        = Survey::fromByteArray(survey.toByteArray());
+    Q_ASSERT(reimportedSurveyResult.isSuccess());
+    const auto query = reimportedSurveyResult.getValue()->queries.first();
+
+    QVERIFY(query->histogram.has_value());
+    QCOMPARE(query->histogram->getStart(), -5.0);
+    QCOMPARE(query->histogram->getWidth(), 2.5);
+    QCOMPARE(query->histogram->getBucketCount(), 4);
+    QCOMPARE(query->cohorts, survey.queries.first()->cohorts);
+}
+
+void SurveyTest::testToCborAndBackWorks()
+{
+    Survey survey("1234", "test");
+    survey.commissioner = QSharedPointer<Commissioner>::create("commissioner");
+    survey.queries.append(QSharedPointer<Query>::create(
+        "1111", "testKey", QList<QString> { "1", "2" }, true, true));
+    survey.queries.append(QSharedPointer<Query>::create(
+        "2222", "otherKey", Histogram(-5, 2.5, 4)));
+
+    const auto result = Survey::fromCbor(survey.toCbor());
+    QVERIFY(result.isSuccess());
+    const auto& reimportedSurvey = result.getValue();
+    QCOMPARE(reimportedSurvey->id, survey.id);
+    QCOMPARE(reimportedSurvey->name, survey.name);
+    QCOMPARE(reimportedSurvey->commissioner->name, "commissioner");
+    QCOMPARE(reimportedSurvey->queries.count(), 2);
+
+    const auto query = reimportedSurvey->queries.at(0);
+    QCOMPARE(query->id, "1111");
+    QCOMPARE(query->dataKey, "testKey");
+    QCOMPARE(query->cohorts, QList<QString>({ "1", "2" }));
+    QVERIFY(query->discrete);
+    QVERIFY(query->latest);
+
+    const auto histogramQuery = reimportedSurvey->queries.at(1);
+    QVERIFY(histogramQuery->histogram.has_value());
+    QCOMPARE(histogramQuery->histogram->getStart(), -5.0);
+    QCOMPARE(histogramQuery->histogram->getWidth(), 2.5);
+    QCOMPARE(histogramQuery->histogram->getBucketCount(), 4);
+    QCOMPARE(histogramQuery->cohorts, survey.queries.at(1)->cohorts);
+
+    QVERIFY(survey.toCbor().size() < survey.toByteArray().size());
+}
+
+void SurveyTest::testToCborAndBackWorksWithoutCommissioner()
+{
+    Survey survey("1234", "test");
+
+    const auto result = Survey::fromCbor(survey.toCbor());
+    QVERIFY(result.isSuccess());
+    QVERIFY(result.getValue()->commissioner.isNull());
+}
+
+void SurveyTest::testFromCborRejectsOtherData()
+{
+    Survey survey("1234", "test");
+    QVERIFY(!Survey::fromCbor(survey.toByteArray()).isSuccess());
+}
+
 QTEST_MAIN(SurveyTest)
@@ -12,4 +12,10 @@ private slots:
     void testListFromByteArrayForSingleSurveyWithQuery();
     void testToByteArrayForSingleSurveyWithQuery();
     void testToByteArrayAndBackWorks();
+    void testFromByteArrayWithHistogram();
+    void testFromByteArrayRejectsTooManyBuckets();
+    void testToByteArrayAndBackWorksWithHistogram();
+    void testToCborAndBackWorks();
+    void testToCborAndBackWorksWithoutCommissioner();
+    void testFromCborRejectsOtherData();
 };
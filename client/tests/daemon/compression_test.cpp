@@ -0,0 +1,33 @@
+#include <QTest>
+
+#include <daemon/compression.hpp>
+
+#include "compression_test.hpp"
+
+void CompressionTest::testRoundTrip()
+{
+    const auto data = QByteArray("1234567890").repeated(1000);
+    const auto compressed = gzip(data);
+    QVERIFY(compressed.size() < data.size());
+    // The gzip magic number.
+    QVERIFY(compressed.startsWith("\x1f\x8b"));
+    QCOMPARE(gunzip(compressed, data.size()).value_or(""), data);
+    QCOMPARE(gunzip(gzip(""), 0).value_or("x"), QByteArray());
+}
+
+void CompressionTest::testRejectsCorruptData()
+{
+    const auto compressed = gzip(QByteArray(1000, '1'));
+    QVERIFY(!gunzip(compressed.left(compressed.size() - 8), 1000));
+    QVERIFY(!gunzip("not gzip", 1000));
+    QVERIFY(!gunzip("", 1000));
+}
+
+void CompressionTest::testLimitsDecompressedSize()
+{
+    const auto compressed = gzip(QByteArray(100000, '1'));
+    QVERIFY(!gunzip(compressed, 99999));
+    QCOMPARE(gunzip(compressed, 100000)->size(), qsizetype(100000));
+}
+
+QTEST_MAIN(CompressionTest)
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <QObject>
+
+class CompressionTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testRoundTrip();
+    void testRejectsCorruptData();
+    void testLimitsDecompressedSize();
+};
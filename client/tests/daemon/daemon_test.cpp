@@ -1,3 +1,4 @@
+#include <QSignalSpy>
 #include <QTest>
 
 #include <core/survey_response.hpp>
@@ -16,7 +17,8 @@ void DaemonTest::testProcessSurveysIgnoresErrors()
     auto network = QSharedPointer<NetworkStub>::create();
     auto encryption = QSharedPointer<IdentityEncryption>::create();
     Daemon daemon(nullptr, storage, network, encryption);
-    daemon.processSurveys();
+    const auto done = daemon.processSurveys();
+    QTRY_VERIFY(done.isFinished());
     QCOMPARE(storage->listSurveyRecords().count(), 0);
 }
 
@@ -32,13 +34,40 @@ void DaemonTest::testProcessSurveysSignsUpForRightCommissioner()
     network->listSurveysResponse
         = QByteArray("[\n" + survey.toByteArray() + "\n]");
 
-    daemon.processSurveys();
+    const auto done = daemon.processSurveys();
+    QTRY_VERIFY(done.isFinished());
     auto records = storage->listSurveyRecords();
     QCOMPARE(records.count(), 1);
     auto first = records.first();
     QCOMPARE(first.survey->id, survey.id);
 }
 
+void DaemonTest::testProcessSurveysBatchesSignups()
+{
+    auto storage = QSharedPointer<StorageStub>::create();
+    auto network = QSharedPointer<NetworkStub>::create();
+    auto encryption = QSharedPointer<IdentityEncryption>::create();
+    Daemon daemon(nullptr, storage, network, encryption);
+
+    QStringList surveys;
+    for (int i = 0; i < 3; i++) {
+        Survey survey(QString("testId%1").arg(i), "testName");
+        survey.commissioner = QSharedPointer<Commissioner>::create("KDE");
+        surveys.append(QString::fromUtf8(survey.toByteArray()));
+    }
+    network->listSurveysResponse
+        = QByteArray("[\n" + surveys.join(",\n").toUtf8() + "\n]");
+
+    const auto done = daemon.processSurveys();
+    QTRY_VERIFY(done.isFinished());
+    QCOMPARE(network->signupBatches, QList<int>({ 3 }));
+    // The listing and one signup request.
+    QCOMPARE(network->requests, 2);
+    const auto records = storage->listSurveyRecords();
+    QCOMPARE(records.count(), 3);
+    QVERIFY(!records.first().clientId.isEmpty());
+}
+
 void DaemonTest::testProcessSurveyDoesNotSignUpForWrongCommissioner()
 {
     auto storage = QSharedPointer<StorageStub>::create();
@@ -51,7 +80,8 @@ void DaemonTest::testProcessSurveyDoesNotSignUpForWrongCommissioner()
     network->listSurveysResponse
         = QByteArray("[\n" + survey.toByteArray() + "\n]");
 
-    daemon.processSurveys();
+    const auto done = daemon.processSurveys();
+    QTRY_VERIFY(done.isFinished());
     QCOMPARE(storage->listSurveyRecords().count(), 0);
 }
 
@@ -69,8 +99,62 @@ void DaemonTest::testProcessSurveyDoesNotSignUpForWhenDataKeyNotPresent()
     network->listSurveysResponse
         = QByteArray("[\n" + survey.toByteArray() + "\n]");
 
-    daemon.processSurveys();
+    const auto done = daemon.processSurveys();
+    QTRY_VERIFY(done.isFinished());
+    QCOMPARE(storage->listSurveyRecords().count(), 0);
+}
+
+void DaemonTest::testProcessSurveysSkipsUnchangedCatalog()
+{
+    auto storage = QSharedPointer<StorageStub>::create();
+    auto network = QSharedPointer<NetworkStub>::create();
+    auto encryption = QSharedPointer<IdentityEncryption>::create();
+    Daemon daemon(nullptr, storage, network, encryption);
+
+    Survey survey("testId", "testName");
+    survey.commissioner = QSharedPointer<Commissioner>::create("KDE");
+    network->listSurveysResponse
+        = QByteArray("[\n" + survey.toByteArray() + "\n]");
+    network->listSurveysEtag = "\"1\"";
+
+    auto done = daemon.processSurveys();
+    QTRY_VERIFY(done.isFinished());
+    QCOMPARE(storage->listSurveyRecords().count(), 1);
+
+    done = daemon.processSurveys();
+    QTRY_VERIFY(done.isFinished());
+    QCOMPARE(network->listSurveysEtags,
+        QList<QByteArray>({ QByteArray(), QByteArray("\"1\"") }));
+    // Two listings and one signup request.
+    QCOMPARE(network->requests, 3);
+    QCOMPARE(network->signupBatches, QList<int>({ 1 }));
+}
+
+void DaemonTest::testProcessSurveysSignsUpOnceDataIsPresent()
+{
+    auto storage = QSharedPointer<StorageStub>::create();
+    auto network = QSharedPointer<NetworkStub>::create();
+    auto encryption = QSharedPointer<IdentityEncryption>::create();
+    Daemon daemon(nullptr, storage, network, encryption);
+
+    Survey survey("testId", "testName");
+    survey.queries.push_back(QSharedPointer<Query>::create(
+        "1", "laterKey", QList<QString> { "1" }, true));
+    survey.commissioner = QSharedPointer<Commissioner>::create("KDE");
+    network->listSurveysResponse
+        = QByteArray("[\n" + survey.toByteArray() + "\n]");
+    network->listSurveysEtag = "\"1\"";
+
+    auto done = daemon.processSurveys();
+    QTRY_VERIFY(done.isFinished());
     QCOMPARE(storage->listSurveyRecords().count(), 0);
+
+    // The catalog didn't change, but the survey qualifies now.
+    storage->addDataPoint("laterKey", "1");
+    done = daemon.processSurveys();
+    QTRY_VERIFY(done.isFinished());
+    QCOMPARE(network->listSurveysEtags.last(), QByteArray("\"1\""));
+    QCOMPARE(storage->listSurveyRecords().count(), 1);
 }
 
 void DaemonTest::testProcessSignupsIgnoresEmptySignupState()
@@ -84,7 +168,8 @@ void DaemonTest::testProcessSignupsIgnoresEmptySignupState()
     storage->addSurveyRecord(
         survey, "1337", "", "", std::nullopt, std::nullopt);
 
-    daemon.processSignups();
+    const auto done = daemon.processSignups();
+    QTRY_VERIFY(done.isFinished());
     QCOMPARE(
         storage->listSurveyRecords().first().getState(), SurveyState::Initial);
 }
@@ -107,7 +192,8 @@ void DaemonTest::testProcessSignupsIgnoresNonStartedAggregations()
         "aggregation_public_key_n": "123"
     })");
 
-    daemon.processSignups();
+    const auto done = daemon.processSignups();
+    QTRY_VERIFY(done.isFinished());
     QCOMPARE(
         storage->listSurveyRecords().first().getState(), SurveyState::Initial);
 }
@@ -130,7 +216,8 @@ void DaemonTest::testProcessSignupsHandlesDelegateCase()
         "aggregation_public_key_n": "123"
     })");
 
-    daemon.processSignups();
+    const auto done = daemon.processSignups();
+    QTRY_VERIFY(done.isFinished());
     auto records = storage->listSurveyRecords();
     QCOMPARE(records.count(), 1);
     auto first = records.first();
@@ -156,7 +243,8 @@ void DaemonTest::testProcessSignupsHandlesNonDelegateCase()
         "aggregation_public_key_n": "123"
     })");
 
-    daemon.processSignups();
+    const auto done = daemon.processSignups();
+    QTRY_VERIFY(done.isFinished());
     auto records = storage->listSurveyRecords();
     QCOMPARE(records.count(), 1);
     auto first = records.first();
@@ -167,6 +255,64 @@ void DaemonTest::testProcessSignupsHandlesNonDelegateCase()
     QCOMPARE(first.getState(), SurveyState::Initial);
 }
 
+void DaemonTest::testProcessSignupsRepostsFailedMemberMessages()
+{
+    auto storage = QSharedPointer<StorageStub>::create();
+    auto network = QSharedPointer<NetworkStub>::create();
+    auto encryption = QSharedPointer<IdentityEncryption>::create();
+    Daemon daemon(nullptr, storage, network, encryption);
+
+    // Knows its delegate, but has no response, as if posting failed.
+    Survey survey("testId", "testName");
+    storage->addSurveyRecord(survey, "1", "1337", "2448", "123", std::nullopt);
+    network->getSignupStateResponse = QByteArray(R"({
+        "aggregation_started": true,
+        "delegate_public_key": "2448",
+        "group_size": 2,
+        "aggregation_public_key_n": "123"
+    })");
+
+    const auto done = daemon.processSignups();
+    QTRY_VERIFY(done.isFinished());
+    QCOMPARE(network->signupStateBatches, QList<int>({ 1 }));
+    QCOMPARE(network->delegateMessages, 1);
+    QCOMPARE(daemon.taskQueueStats().value(Daemon::DelegateWork).started,
+        quint64(0));
+}
+
+void DaemonTest::testNoTransactionIsOpenDuringRequests()
+{
+    auto storage = QSharedPointer<StorageStub>::create();
+    auto network = QSharedPointer<NetworkStub>::create();
+    auto encryption = QSharedPointer<IdentityEncryption>::create();
+    Daemon daemon(nullptr, storage, network, encryption);
+    int requestsInTransaction = 0;
+    network->onRequest = [&storage, &requestsInTransaction]() {
+        if (storage->transactionDepth > 0)
+            requestsInTransaction++;
+    };
+
+    // Signs up, then posts the result right away as delegate of itself.
+    Survey survey("testId", "testName");
+    survey.commissioner = QSharedPointer<Commissioner>::create("KDE");
+    network->listSurveysResponse
+        = QByteArray("[\n" + survey.toByteArray() + "\n]");
+    const auto listed = daemon.processSurveys();
+    QTRY_VERIFY(listed.isFinished());
+    const auto record = storage->listSurveyRecords().first();
+    const QJsonObject state { { "aggregation_started", true },
+        { "delegate_public_key", record.publicKey }, { "group_size", 1 },
+        { "aggregation_public_key_n", "123" } };
+    network->getSignupStateResponse = QJsonDocument(state).toJson();
+    const auto done = daemon.processSignups();
+    QTRY_VERIFY(done.isFinished());
+
+    QTRY_COMPARE(storage->listSurveyResponses().count(), qsizetype(1));
+    QCOMPARE(storage->transactionDepth, 0);
+    QVERIFY(storage->transactions >= 2);
+    QCOMPARE(requestsInTransaction, 0);
+}
+
 void DaemonTest::testProcessSignupsIgnoresEmptyMessagesForDelegate()
 {
     auto storage = QSharedPointer<StorageStub>::create();
@@ -177,7 +323,147 @@ void DaemonTest::testProcessSignupsIgnoresEmptyMessagesForDelegate()
     Survey survey("testId", "testName");
     storage->addSurveyRecord(
         survey, "1337", "1337", "1337", std::nullopt, std::nullopt);
-    daemon.processSignups();
+    const auto done = daemon.processSignups();
+    QTRY_VERIFY(done.isFinished());
+}
+
+void DaemonTest::testProcessSignupsFoldsNewDelegateMessages()
+{
+    auto storage = QSharedPointer<StorageStub>::create();
+    auto network = QSharedPointer<NetworkStub>::create();
+    auto encryption = QSharedPointer<IdentityEncryption>::create();
+
+    Survey survey("testId", "testName");
+    storage->addSurveyRecord(survey, "1", "1337", "1337", "123", 4);
+    const auto message = [](int value) {
+        const EncryptedSurveyResponse response("testId",
+            { QSharedPointer<EncryptedQueryResponse>::create(
+                "query", QMap<QString, mpz_class>({ { "cohort", value } })) });
+        return QString::fromLatin1(response.toJsonByteArray().toBase64());
+    };
+    network->getMessagesForDelegateResponse
+        = QString(R"({"messages": ["%1"], "cursor": 5})")
+              .arg(message(2))
+              .toUtf8();
+
+    {
+        Daemon daemon(nullptr, storage, network, encryption);
+        const auto done = daemon.processSignups();
+        QTRY_VERIFY(done.isFinished());
+    }
+    QCOMPARE(network->messagesSince, QList<qint64>({ 0 }));
+    QCOMPARE(storage->findDelegateAggregation("testId").position, qint64(5));
+    QCOMPARE(storage->findDelegateAggregation("testId").count, 1);
+
+    // A restarted daemon continues from the stored cursor and aggregate, and
+    // doesn't fold in a message sent again.
+    network->getMessagesForDelegateResponse
+        = QString(R"({"messages": ["%1", "%2"], "cursor": 9})")
+              .arg(message(2), message(3))
+              .toUtf8();
+    {
+        Daemon daemon(nullptr, storage, network, encryption);
+        const auto done = daemon.processSignups();
+        QTRY_VERIFY(done.isFinished());
+    }
+    QCOMPARE(network->messagesSince, QList<qint64>({ 0, 5 }));
+    const auto aggregation = storage->findDelegateAggregation("testId");
+    QCOMPARE(aggregation.position, qint64(9));
+    QCOMPARE(aggregation.count, 2);
+    const auto aggregate
+        = EncryptedSurveyResponse::fromJsonByteArray(aggregation.aggregate)
+              .getValue();
+    // Paillier adds by multiplying the ciphertexts.
+    QVERIFY(aggregate->encryptedQueryResponses.first()->cohortData["cohort"]
+        == 6);
+}
+
+void DaemonTest::testProcessSignupsLimitsRecordsInFlight()
+{
+    auto storage = QSharedPointer<StorageStub>::create();
+    auto network = QSharedPointer<NetworkStub>::create();
+    auto encryption = QSharedPointer<IdentityEncryption>::create();
+    Daemon daemon(nullptr, storage, network, encryption, 2);
+
+    // Delegates, which poll their messages one record at a time.
+    for (int i = 0; i < 5; i++) {
+        Survey survey(QString("testId%1").arg(i), "testName");
+        storage->addSurveyRecord(survey, QString::number(i), "1337", "1337",
+            std::nullopt, std::nullopt);
+    }
+    network->replyDelay = 10;
+
+    const auto done = daemon.processSignups();
+    QTRY_VERIFY(done.isFinished());
+    QCOMPARE(network->requests, 5);
+    QCOMPARE(network->maxPendingRequests, 2);
+}
+
+void DaemonTest::testProcessSignupsBatchesSignupStates()
+{
+    auto storage = QSharedPointer<StorageStub>::create();
+    auto network = QSharedPointer<NetworkStub>::create();
+    auto encryption = QSharedPointer<IdentityEncryption>::create();
+    Daemon daemon(nullptr, storage, network, encryption);
+
+    for (int i = 0; i < 250; i++) {
+        Survey survey(QString("testId%1").arg(i), "testName");
+        storage->addSurveyRecord(survey, QString::number(i), "", "",
+            std::nullopt, std::nullopt);
+    }
+
+    const auto done = daemon.processSignups();
+    QTRY_VERIFY(done.isFinished());
+    QCOMPARE(network->requests, 3);
+    QCOMPARE(network->signupStateBatches, QList<int>({ 100, 100, 50 }));
+}
+
+void DaemonTest::testProcessSignupsSkipsRecordsNotDue()
+{
+    auto storage = QSharedPointer<StorageStub>::create();
+    auto network = QSharedPointer<NetworkStub>::create();
+    auto encryption = QSharedPointer<IdentityEncryption>::create();
+    Daemon daemon(nullptr, storage, network, encryption);
+
+    Survey survey("testId", "testName");
+    storage->addSurveyRecord(
+        survey, "1337", "", "", std::nullopt, std::nullopt);
+
+    const auto first = daemon.processSignups();
+    QTRY_VERIFY(first.isFinished());
+    QCOMPARE(network->requests, 1);
+    QVERIFY(daemon.nextRunDelay() > Daemon::minRunDelay);
+
+    // Nothing changed, so the record isn't polled again right away.
+    const auto second = daemon.processSignups();
+    QTRY_VERIFY(second.isFinished());
+    QCOMPARE(network->requests, 1);
+}
+
+void DaemonTest::testSignupEventWakesRecord()
+{
+    auto storage = QSharedPointer<StorageStub>::create();
+    auto network = QSharedPointer<NetworkStub>::create();
+    auto encryption = QSharedPointer<IdentityEncryption>::create();
+    Daemon daemon(nullptr, storage, network, encryption);
+    QSignalSpy spy(&daemon, &Daemon::woken);
+
+    Survey survey("testId", "testName");
+    storage->addSurveyRecord(
+        survey, "1337", "", "", std::nullopt, std::nullopt);
+    network->signupEventTokens = { { "1337", "waiting" } };
+    daemon.listenForSignupEvents();
+
+    const auto done = daemon.processSignups();
+    QTRY_VERIFY(done.isFinished());
+    QVERIFY(!daemon.scheduler.isDue(
+        "testId", QDateTime::currentDateTimeUtc()));
+    // Once the current token is known.
+    QTRY_COMPARE(network->signupEventPolls, 2);
+
+    network->setSignupEventToken("1337", "started");
+    QTRY_COMPARE(spy.count(), 1);
+    QVERIFY(daemon.scheduler.isDue("testId", QDateTime::currentDateTimeUtc()));
 }
 
 // TODO: Instead of testing createSurveyResponse directly, it'd be better to
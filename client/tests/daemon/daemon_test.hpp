@@ -8,13 +8,23 @@ class DaemonTest : public QObject {
 private slots:
     void testProcessSurveysIgnoresErrors();
     void testProcessSurveysSignsUpForRightCommissioner();
+    void testProcessSurveysBatchesSignups();
     void testProcessSurveyDoesNotSignUpForWrongCommissioner();
     void testProcessSurveyDoesNotSignUpForWhenDataKeyNotPresent();
+    void testProcessSurveysSkipsUnchangedCatalog();
+    void testProcessSurveysSignsUpOnceDataIsPresent();
     void testProcessSignupsIgnoresEmptySignupState();
     void testProcessSignupsIgnoresNonStartedAggregations();
     void testProcessSignupsHandlesDelegateCase();
     void testProcessSignupsHandlesNonDelegateCase();
+    void testProcessSignupsRepostsFailedMemberMessages();
+    void testNoTransactionIsOpenDuringRequests();
     void testProcessSignupsIgnoresEmptyMessagesForDelegate();
+    void testProcessSignupsFoldsNewDelegateMessages();
+    void testProcessSignupsLimitsRecordsInFlight();
+    void testProcessSignupsBatchesSignupStates();
+    void testProcessSignupsSkipsRecordsNotDue();
+    void testSignupEventWakesRecord();
     void testCreateSurveyResponseSucceedsForIntervals();
     void testCreateSurveyResponseSucceedsForIntervalsWithInfinity();
 };
@@ -0,0 +1,151 @@
+#include <QTest>
+
+#include <daemon/ingestion_queue.hpp>
+
+#include "../stubs/core/storage_stub.hpp"
+
+#include "ingestion_queue_test.hpp"
+
+namespace {
+// Holds the writer in addDataPoints until released.
+class BlockingStorageStub : public StorageStub {
+public:
+    QSemaphore unblocked;
+
+    bool addDataPoints(const QList<DataPoint>& dataPoints)
+    {
+        unblocked.acquire();
+        return StorageStub::addDataPoints(dataPoints);
+    }
+};
+
+// Fails to store the first few batches.
+class FailingStorageStub : public StorageStub {
+public:
+    std::atomic<int> failuresLeft;
+    std::atomic<int> attempts { 0 };
+
+    explicit FailingStorageStub(int failures)
+        : failuresLeft(failures)
+    {
+    }
+
+    bool addDataPoints(const QList<DataPoint>& dataPoints)
+    {
+        attempts++;
+        if (failuresLeft-- > 0)
+            return false;
+        return StorageStub::addDataPoints(dataPoints);
+    }
+};
+}
+
+void IngestionQueueTest::testFlushStoresEverything()
+{
+    auto storage = QSharedPointer<StorageStub>::create();
+    IngestionQueue queue(storage);
+
+    for (int i = 0; i < 1000; i++)
+        QVERIFY(queue.enqueue("a", QString::number(i)));
+    QVERIFY(queue.flush().result());
+
+    const auto dataPoints = storage->listDataPoints("a");
+    QCOMPARE(dataPoints.count(), 1000);
+    QCOMPARE(dataPoints.last().value, "999");
+    const auto stats = queue.stats();
+    QCOMPARE(stats.depth, quint64(0));
+    QCOMPARE(stats.stored, quint64(1000));
+    QCOMPARE(stats.rejected, quint64(0));
+}
+
+void IngestionQueueTest::testFlushDoesNotBlock()
+{
+    auto storage = QSharedPointer<BlockingStorageStub>::create();
+    IngestionQueue queue(storage);
+    QVERIFY(queue.flush().isFinished());
+
+    queue.enqueue("a", "1");
+    const auto flushed = queue.flush();
+    QVERIFY(!flushed.isFinished());
+
+    storage->unblocked.release();
+    QTRY_VERIFY(flushed.isFinished());
+    QVERIFY(flushed.result());
+    QCOMPARE(storage->listDataPoints("a").count(), 1);
+}
+
+void IngestionQueueTest::testRejectsWhenFull()
+{
+    auto storage = QSharedPointer<BlockingStorageStub>::create();
+    IngestionQueue queue(storage, 2);
+
+    QVERIFY(queue.enqueue("a", "1"));
+    QVERIFY(queue.enqueue("a", "2"));
+    QVERIFY(!queue.enqueue("a", "3"));
+    QCOMPARE(queue.stats().depth, quint64(2));
+
+    storage->unblocked.release(2);
+    QVERIFY(queue.flush().result());
+
+    QCOMPARE(storage->listDataPoints("a").count(), 2);
+    QCOMPARE(queue.stats().rejected, quint64(1));
+    QCOMPARE(queue.stats().maxDepth, quint64(2));
+}
+
+void IngestionQueueTest::testDestructorStoresEverything()
+{
+    auto storage = QSharedPointer<StorageStub>::create();
+    {
+        IngestionQueue queue(storage);
+        queue.enqueue("a", "1");
+        queue.enqueue("b", "2");
+    }
+
+    QCOMPARE(storage->listDataPoints().count(), 2);
+}
+
+void IngestionQueueTest::testTakeStoredKeys()
+{
+    auto storage = QSharedPointer<StorageStub>::create();
+    IngestionQueue queue(storage);
+    queue.enqueue("a", "1");
+    queue.enqueue("b", "2");
+    queue.enqueue("a", "3");
+    QVERIFY(queue.flush().result());
+
+    QCOMPARE(queue.takeStoredKeys(), QSet<QString>({ "a", "b" }));
+    QVERIFY(queue.takeStoredKeys().isEmpty());
+}
+
+void IngestionQueueTest::testRetriesFailedBatches()
+{
+    auto storage = QSharedPointer<FailingStorageStub>::create(2);
+    IngestionQueue queue(storage);
+    queue.enqueue("a", "1");
+    queue.enqueue("a", "2");
+
+    QTRY_COMPARE(queue.stats().stored, quint64(2));
+    QVERIFY(queue.flush().result());
+
+    const auto dataPoints = storage->listDataPoints("a");
+    QCOMPARE(dataPoints.count(), 2);
+    QCOMPARE(dataPoints.first().value, "1");
+    QCOMPARE(dataPoints.last().value, "2");
+    QCOMPARE(storage->attempts.load(), 3);
+    QCOMPARE(queue.stats().failures, quint64(2));
+    QCOMPARE(queue.stats().depth, quint64(0));
+}
+
+void IngestionQueueTest::testFlushReturnsWhenStoringFails()
+{
+    auto storage = QSharedPointer<FailingStorageStub>::create(1000000);
+    IngestionQueue queue(storage);
+    queue.enqueue("a", "1");
+
+    QVERIFY(!queue.flush().result());
+    QCOMPARE(queue.stats().depth, quint64(1));
+    QVERIFY(queue.stats().failures > 0);
+    QVERIFY(storage->listDataPoints().isEmpty());
+}
+
+QTEST_MAIN(IngestionQueueTest)
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <QObject>
+
+class IngestionQueueTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testFlushStoresEverything();
+    void testFlushDoesNotBlock();
+    void testRejectsWhenFull();
+    void testDestructorStoresEverything();
+    void testTakeStoredKeys();
+    void testRetriesFailedBatches();
+    void testFlushReturnsWhenStoringFails();
+};
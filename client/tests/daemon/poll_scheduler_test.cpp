@@ -0,0 +1,96 @@
+#include <QTest>
+
+#include <daemon/poll_scheduler.hpp>
+
+#include "poll_scheduler_test.hpp"
+
+using namespace std::chrono_literals;
+
+namespace {
+const PollIntervals intervals {
+    .nearlyDone = 1000ms,
+    .changed = 10000ms,
+    .max = 40000ms,
+};
+
+const QDateTime start = QDateTime::fromSecsSinceEpoch(1700000000, Qt::UTC);
+
+// Milliseconds from start until the earliest record is due.
+qint64 nextDueAfter(const PollScheduler& scheduler)
+{
+    return start.msecsTo(scheduler.nextDue());
+}
+}
+
+void PollSchedulerTest::testUnknownRecordsAreDue()
+{
+    PollScheduler scheduler(intervals);
+    QVERIFY(scheduler.isDue("1", start));
+    QVERIFY(!scheduler.nextDue().isValid());
+
+    scheduler.polled("1", PollScheduler::Changed, start);
+    QVERIFY(!scheduler.isDue("1", start));
+    QVERIFY(scheduler.isDue("2", start));
+
+    scheduler.remove("1");
+    QVERIFY(scheduler.isDue("1", start));
+}
+
+void PollSchedulerTest::testBacksOffWhileUnchanged()
+{
+    PollScheduler scheduler(intervals);
+    // Each interval is moved by up to a fifth either way.
+    for (const auto expected : { 10000, 20000, 40000, 40000 }) {
+        scheduler.polled("1", PollScheduler::Unchanged, start);
+        const auto due = nextDueAfter(scheduler);
+        QVERIFY2(due >= expected * 0.8 && due <= expected * 1.2,
+            qPrintable(QString::number(due)));
+    }
+
+    scheduler.polled("1", PollScheduler::Changed, start);
+    const auto due = nextDueAfter(scheduler);
+    QVERIFY(due >= 8000 && due <= 12000);
+}
+
+void PollSchedulerTest::testPollsFastWhenNearlyDone()
+{
+    PollScheduler scheduler(intervals);
+    scheduler.polled("1", PollScheduler::Unchanged, start);
+    scheduler.polled("1", PollScheduler::Unchanged, start);
+    scheduler.polled("1", PollScheduler::NearlyDone, start);
+
+    const auto due = nextDueAfter(scheduler);
+    QVERIFY(due >= 800 && due <= 1200);
+    QVERIFY(scheduler.isDue("1", start.addMSecs(1200)));
+}
+
+void PollSchedulerTest::testHonorsRetryAfter()
+{
+    PollScheduler scheduler(intervals);
+    const auto retryAfter = start.addSecs(60);
+    scheduler.notBefore(retryAfter);
+    // An earlier hint doesn't shorten the wait.
+    scheduler.notBefore(start.addSecs(30));
+    scheduler.notBefore(QDateTime());
+
+    QVERIFY(!scheduler.isDue("1", start));
+    QVERIFY(!scheduler.isDue("1", start.addSecs(59)));
+    QVERIFY(scheduler.isDue("1", retryAfter));
+
+    scheduler.polled("1", PollScheduler::NearlyDone, start);
+    QCOMPARE(scheduler.nextDue(), retryAfter);
+}
+
+void PollSchedulerTest::testNextDueIsEarliestRecord()
+{
+    PollScheduler scheduler(intervals);
+    scheduler.polled("1", PollScheduler::Changed, start);
+    scheduler.polled("2", PollScheduler::NearlyDone, start);
+
+    const auto due = nextDueAfter(scheduler);
+    QVERIFY(due >= 800 && due <= 1200);
+    QVERIFY(scheduler.isDue("2", scheduler.nextDue()));
+    QVERIFY(!scheduler.isDue("1", scheduler.nextDue()));
+}
+
+QTEST_MAIN(PollSchedulerTest)
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <QObject>
+
+class PollSchedulerTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testUnknownRecordsAreDue();
+    void testBacksOffWhileUnchanged();
+    void testPollsFastWhenNearlyDone();
+    void testHonorsRetryAfter();
+    void testNextDueIsEarliestRecord();
+};
@@ -0,0 +1,68 @@
+#include <QTest>
+
+#include <daemon/response_planner.hpp>
+
+#include "../stubs/core/storage_stub.hpp"
+
+#include "response_planner_test.hpp"
+
+namespace {
+QSharedPointer<Survey> createSurvey(const QString& id, const QString& queryId)
+{
+    auto survey = QSharedPointer<Survey>::create(id, "testName");
+    survey->queries.append(QSharedPointer<Query>::create(
+        queryId, "testKey", QList<QString> { "1", "2" }, true));
+    return survey;
+}
+}
+
+void ResponsePlannerTest::testCreateSurveyResponseWithoutDataPoints()
+{
+    auto storage = QSharedPointer<StorageStub>::create();
+    ResponsePlanner planner(storage);
+
+    const auto response = planner.createSurveyResponse(createSurvey("1", "1"));
+    QCOMPARE(response->surveyId, "1");
+    QCOMPARE(response->queryResponses.count(), 0);
+}
+
+void ResponsePlannerTest::testPlannedQueriesShareSingleScan()
+{
+    auto storage = QSharedPointer<StorageStub>::create();
+    storage->addDataPoint("testKey", "1");
+    storage->addDataPoint("testKey", "2");
+    storage->addDataPoint("testKey", "2");
+    ResponsePlanner planner(storage);
+
+    const auto first = createSurvey("1", "1");
+    const auto second = createSurvey("2", "2");
+    planner.plan({ first, second });
+
+    const auto firstResponse = planner.createSurveyResponse(first);
+    const auto secondResponse = planner.createSurveyResponse(second);
+
+    const QMap<QString, int> expected = { { "1", 1 }, { "2", 2 } };
+    QCOMPARE(storage->countCohortsCalls, 1);
+    QCOMPARE(firstResponse->queryResponses.first()->cohortData, expected);
+    QCOMPARE(secondResponse->queryResponses.first()->cohortData, expected);
+}
+
+void ResponsePlannerTest::testCountsAreKeptUntilInvalidated()
+{
+    auto storage = QSharedPointer<StorageStub>::create();
+    storage->addDataPoint("testKey", "1");
+    ResponsePlanner planner(storage);
+    const auto survey = createSurvey("1", "1");
+
+    planner.createSurveyResponse(survey);
+    planner.createSurveyResponse(survey);
+    QCOMPARE(storage->countCohortsCalls, 1);
+
+    storage->addDataPoint("testKey", "1");
+    planner.invalidate("testKey");
+    const auto response = planner.createSurveyResponse(survey);
+    QCOMPARE(storage->countCohortsCalls, 2);
+    QCOMPARE(response->queryResponses.first()->cohortData.value("1"), 2);
+}
+
+QTEST_MAIN(ResponsePlannerTest)
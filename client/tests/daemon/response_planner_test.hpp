@@ -0,0 +1,12 @@
+#pragma once
+
+#include <QObject>
+
+class ResponsePlannerTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testCreateSurveyResponseWithoutDataPoints();
+    void testPlannedQueriesShareSingleScan();
+    void testCountsAreKeptUntilInvalidated();
+};
@@ -0,0 +1,229 @@
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTest>
+
+#include <daemon/compression.hpp>
+#include <daemon/server_network.hpp>
+
+#include "server_network_test.hpp"
+
+using namespace std::chrono_literals;
+
+namespace {
+// Of headers with lowercase names.
+QByteArray headerValue(const QByteArray& headers, const QByteArray& name)
+{
+    for (const auto& line : headers.split('\n')) {
+        if (line.startsWith(name + ":"))
+            return line.mid(name.size() + 1).trimmed();
+    }
+    return {};
+}
+
+// Answers every request with the response and its ETag, or not modified if
+// the request had that ETag, keeping the connections open. Doesn't answer at
+// all while hanging.
+class HttpServer : public QTcpServer {
+public:
+    struct Request {
+        // In lowercase.
+        QByteArray headers;
+        QByteArray body;
+    };
+
+    int connections = 0;
+    bool hanging = false;
+    QByteArray response = "[]";
+    // Whether responses say gzip compressed requests are fine.
+    bool acceptsGzip = false;
+    // Whether responses are compressed for requests that accept that.
+    bool compressing = false;
+    QList<Request> requests;
+
+    HttpServer()
+    {
+        listen(QHostAddress::LocalHost);
+        connect(this, &QTcpServer::newConnection, this, [this]() {
+            while (auto* socket = nextPendingConnection()) {
+                connections++;
+                connect(socket, &QTcpSocket::readyRead, this,
+                    [this, socket]() { answer(socket); });
+                connect(socket, &QTcpSocket::disconnected, this,
+                    [this, socket]() {
+                        buffers.remove(socket);
+                        socket->deleteLater();
+                    });
+            }
+        });
+        // For the ServerNetwork created next.
+        qputenv("PRIVACT_CLIENT_SERVER_URL",
+            QString("http://127.0.0.1:%1").arg(serverPort()).toLatin1());
+    }
+
+private:
+    QHash<QTcpSocket*, QByteArray> buffers;
+
+    // Answers the requests that arrived completely, bodies included.
+    void answer(QTcpSocket* socket)
+    {
+        auto& buffer = buffers[socket];
+        buffer += socket->readAll();
+        for (auto end = buffer.indexOf("\r\n\r\n"); end >= 0;
+             end = buffer.indexOf("\r\n\r\n")) {
+            const auto headers = buffer.left(end).toLower();
+            const auto length
+                = headerValue(headers, "content-length").toLongLong();
+            if (buffer.size() < end + 4 + length)
+                return;
+            requests.append({ .headers = headers,
+                .body = buffer.mid(end + 4, length) });
+            buffer.remove(0, end + 4 + length);
+            if (hanging)
+                continue;
+            if (headers.contains("if-none-match: \"1\"")) {
+                socket->write("HTTP/1.1 304 Not Modified\r\n"
+                              "ETag: \"1\"\r\n"
+                              "\r\n");
+                continue;
+            }
+            QByteArray extraHeaders;
+            auto content = response;
+            if (acceptsGzip)
+                extraHeaders += "Accept-Encoding: gzip\r\n";
+            if (compressing
+                && headerValue(headers, "accept-encoding").contains("gzip")) {
+                extraHeaders += "Content-Encoding: gzip\r\n";
+                content = gzip(content);
+            }
+            socket->write("HTTP/1.1 200 OK\r\n"
+                          "Content-Type: application/json\r\n"
+                          "ETag: \"1\"\r\n"
+                + extraHeaders + "Content-Length: "
+                + QByteArray::number(content.size()) + "\r\n\r\n"
+                + content);
+        }
+    }
+};
+}
+
+void ServerNetworkTest::testReusesConnection()
+{
+    HttpServer server;
+    ServerNetwork network;
+
+    for (int i = 0; i < 3; i++) {
+        const auto reply = network.listSurveys("");
+        QTRY_VERIFY(reply.isFinished());
+        QCOMPARE(reply.result().data, QByteArray("[]"));
+    }
+    QCOMPARE(server.connections, 1);
+    QCOMPARE(network.stats().requests, 3);
+#if QT_VERSION >= QT_VERSION_CHECK(6, 3, 0)
+    QCOMPARE(network.stats().newConnections.value_or(-1), 1);
+#else
+    QVERIFY(!network.stats().newConnections.has_value());
+#endif
+}
+
+void ServerNetworkTest::testListsSurveysConditionally()
+{
+    HttpServer server;
+    ServerNetwork network;
+
+    const auto listed = network.listSurveys("");
+    QTRY_VERIFY(listed.isFinished());
+    QVERIFY(listed.result().modified);
+    QCOMPARE(listed.result().etag, QByteArray("\"1\""));
+
+    const auto unchanged = network.listSurveys(listed.result().etag);
+    QTRY_VERIFY(unchanged.isFinished());
+    QVERIFY(!unchanged.result().modified);
+    QVERIFY(unchanged.result().data.isEmpty());
+
+    const auto changed = network.listSurveys("\"0\"");
+    QTRY_VERIFY(changed.isFinished());
+    QVERIFY(changed.result().modified);
+    QCOMPARE(changed.result().data, QByteArray("[]"));
+}
+
+void ServerNetworkTest::testCompressesRequestsOnceAccepted()
+{
+    HttpServer server;
+    server.acceptsGzip = true;
+    ServerNetwork network(ServerNetwork::defaultTimeout, 100);
+    const QByteArray data(1000, '1');
+
+    // Nothing is known about the server before its first response.
+    auto posted = network.postAggregationResult("1", data);
+    QTRY_VERIFY(posted.isFinished());
+    posted = network.postAggregationResult("1", data);
+    QTRY_VERIFY(posted.isFinished());
+    // Below the threshold.
+    posted = network.postAggregationResult("1", "[]");
+    QTRY_VERIFY(posted.isFinished());
+
+    QCOMPARE(server.requests.count(), 3);
+    QVERIFY(!server.requests[0].headers.contains("content-encoding"));
+    QCOMPARE(server.requests[0].body, data);
+    QCOMPARE(headerValue(server.requests[1].headers, "content-encoding"),
+        QByteArray("gzip"));
+    QCOMPARE(gunzip(server.requests[1].body, data.size()).value_or(""), data);
+    QCOMPARE(server.requests[2].body, QByteArray("[]"));
+
+    const auto stats = network.stats();
+    QCOMPARE(stats.compressedRequests, 1);
+    QCOMPARE(stats.bytesSent,
+        qint64(data.size() + server.requests[1].body.size() + 2));
+    QCOMPARE(
+        stats.bytesSaved, qint64(data.size() - server.requests[1].body.size()));
+}
+
+void ServerNetworkTest::testDecompressesResponses()
+{
+    HttpServer server;
+    server.compressing = true;
+    server.response = "[" + QByteArray(1000, '1') + "]";
+    ServerNetwork network;
+
+    const auto reply = network.listSurveys("");
+    QTRY_VERIFY(reply.isFinished());
+    QCOMPARE(reply.result().data, server.response);
+
+    const auto stats = network.stats();
+    QVERIFY(stats.bytesReceived < server.response.size());
+    QCOMPARE(
+        stats.bytesSaved, qint64(server.response.size() - stats.bytesReceived));
+}
+
+void ServerNetworkTest::testTimesOutHungRequests()
+{
+    HttpServer server;
+    server.hanging = true;
+    ServerNetwork network(100ms);
+
+    const auto reply = network.listSurveys("");
+    QTRY_VERIFY(reply.isFinished());
+    QVERIFY(!reply.result().modified);
+    QCOMPARE(network.stats().timeouts, 1);
+    QCOMPARE(network.stats().canceled, 0);
+}
+
+void ServerNetworkTest::testCancelsPendingRequests()
+{
+    HttpServer server;
+    server.hanging = true;
+    ServerNetwork network;
+
+    auto canceled = network.listSurveys("");
+    canceled.cancel();
+    QTRY_COMPARE(network.stats().canceled, 1);
+
+    const auto pending = network.listSurveys("");
+    network.cancelPendingRequests();
+    QTRY_VERIFY(pending.isFinished());
+    QVERIFY(!pending.result().modified);
+    QCOMPARE(network.stats().canceled, 2);
+    QCOMPARE(network.stats().timeouts, 0);
+}
+
+QTEST_MAIN(ServerNetworkTest)
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <QObject>
+
+class ServerNetworkTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testReusesConnection();
+    void testListsSurveysConditionally();
+    void testCompressesRequestsOnceAccepted();
+    void testDecompressesResponses();
+    void testTimesOutHungRequests();
+    void testCancelsPendingRequests();
+};
@@ -0,0 +1,86 @@
+#include <QSignalSpy>
+#include <QTest>
+
+#include <daemon/signup_event_channel.hpp>
+
+#include "../stubs/daemon/network_stub.hpp"
+
+#include "signup_event_channel_test.hpp"
+
+using namespace std::chrono_literals;
+
+void SignupEventChannelTest::testEmitsChangedTokens()
+{
+    auto network = QSharedPointer<NetworkStub>::create();
+    network->signupEventTokens = { { "1", "waiting" }, { "2", "waiting" } };
+    SignupEventChannel channel(network);
+    QSignalSpy spy(&channel, &SignupEventChannel::changed);
+
+    channel.watch({ "1", "2" });
+    channel.start();
+    // The first poll only learns the current tokens.
+    QTRY_COMPARE(network->signupEventPolls, 2);
+    QCOMPARE(spy.count(), 0);
+
+    network->setSignupEventToken("2", "started");
+    QTRY_COMPARE(spy.count(), 1);
+    QCOMPARE(spy.takeFirst().at(0).toString(), "2");
+
+    // Unchanged tokens don't count.
+    network->setSignupEventToken("2", "started");
+    network->setSignupEventToken("1", "messages:1");
+    QTRY_COMPARE(spy.count(), 1);
+    QCOMPARE(spy.takeFirst().at(0).toString(), "1");
+}
+
+void SignupEventChannelTest::testWaitsForClientIdsToWatch()
+{
+    auto network = QSharedPointer<NetworkStub>::create();
+    SignupEventChannel channel(network);
+
+    channel.start();
+    QTest::qWait(10);
+    QCOMPARE(network->signupEventPolls, 0);
+
+    channel.watch({ "1" });
+    QTRY_VERIFY(network->signupEventPolls > 0);
+}
+
+void SignupEventChannelTest::testReconnectsAfterFailures()
+{
+    auto network = QSharedPointer<NetworkStub>::create();
+    network->signupEventTokens = { { "1", "waiting" } };
+    network->failingSignupEventPolls = 2;
+    SignupEventChannel channel(network, 10ms);
+    QSignalSpy spy(&channel, &SignupEventChannel::changed);
+
+    channel.watch({ "1" });
+    channel.start();
+    // Two failures, then one learning the token and one waiting.
+    QTRY_COMPARE(network->signupEventPolls, 4);
+
+    network->setSignupEventToken("1", "started");
+    QTRY_COMPARE(spy.count(), 1);
+}
+
+void SignupEventChannelTest::testWatchesOneBatchAtMost()
+{
+    auto network = QSharedPointer<NetworkStub>::create();
+    SignupEventChannel channel(network);
+
+    channel.watch({ "watched" });
+    channel.start();
+    QTRY_COMPARE(network->polledClientIds, QList<QString>({ "watched" }));
+
+    QSet<QString> clientIds { "watched" };
+    for (int i = 0; i < Network::maxBatchSize; i++)
+        clientIds.insert(QString::number(i));
+    channel.watch(clientIds);
+    // Answers the pending poll, so the next one has the new client IDs.
+    network->setSignupEventToken("watched", "waiting");
+    QTRY_COMPARE(
+        network->polledClientIds.count(), qsizetype(Network::maxBatchSize));
+    QVERIFY(network->polledClientIds.contains("watched"));
+}
+
+QTEST_MAIN(SignupEventChannelTest)
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <QObject>
+
+class SignupEventChannelTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testEmitsChangedTokens();
+    void testWaitsForClientIdsToWatch();
+    void testReconnectsAfterFailures();
+    void testWatchesOneBatchAtMost();
+};
@@ -0,0 +1,79 @@
+#include <QTest>
+
+#include <daemon/survey_catalog.hpp>
+
+#include "survey_catalog_test.hpp"
+
+namespace {
+// Lists surveys by ID and name.
+QByteArray listOf(const QList<QPair<QString, QString>>& surveys)
+{
+    QJsonArray array;
+    for (const auto& [id, name] : surveys) {
+        const auto data = Survey(id, name).toByteArray();
+        array.append(QJsonDocument::fromJson(data).object());
+    }
+    return QJsonDocument(array).toJson();
+}
+}
+
+void SurveyCatalogTest::testReturnsNewSurveys()
+{
+    SurveyCatalog catalog;
+    QVERIFY(catalog.etag().isEmpty());
+
+    const auto result = catalog.update(
+        listOf({ { "1", "first" }, { "2", "second" } }), "\"a\"");
+    QVERIFY(result.isSuccess());
+    QCOMPARE(result.getValue().count(), 2);
+    QCOMPARE(catalog.count(), 2);
+    QCOMPARE(catalog.etag(), QByteArray("\"a\""));
+    QCOMPARE(catalog.find("2")->name, QString("second"));
+    QVERIFY(catalog.find("3").isNull());
+}
+
+void SurveyCatalogTest::testReturnsOnlyChangedSurveys()
+{
+    SurveyCatalog catalog;
+    catalog.update(
+        listOf({ { "1", "first" }, { "2", "second" } }), "\"a\"");
+    const auto unchanged = catalog.find("1");
+
+    const auto result = catalog.update(
+        listOf({ { "1", "first" }, { "2", "renamed" }, { "3", "third" } }),
+        "\"b\"");
+    QVERIFY(result.isSuccess());
+    const auto changed = result.getValue();
+    QCOMPARE(changed.count(), 2);
+    QCOMPARE(changed[0]->id, QString("2"));
+    QCOMPARE(changed[1]->id, QString("3"));
+    // Not parsed again.
+    QCOMPARE(catalog.find("1"), unchanged);
+    QCOMPARE(catalog.find("2")->name, QString("renamed"));
+}
+
+void SurveyCatalogTest::testDropsRemovedSurveys()
+{
+    SurveyCatalog catalog;
+    catalog.update(
+        listOf({ { "1", "first" }, { "2", "second" } }), "\"a\"");
+
+    const auto result = catalog.update(listOf({ { "2", "second" } }), "");
+    QVERIFY(result.isSuccess());
+    QVERIFY(result.getValue().isEmpty());
+    QCOMPARE(catalog.count(), 1);
+    QVERIFY(catalog.find("1").isNull());
+    QVERIFY(catalog.etag().isEmpty());
+}
+
+void SurveyCatalogTest::testKeepsListOnErrors()
+{
+    SurveyCatalog catalog;
+    catalog.update(listOf({ { "1", "first" } }), "\"a\"");
+
+    QVERIFY(!catalog.update("{", "\"b\"").isSuccess());
+    QCOMPARE(catalog.count(), 1);
+    QCOMPARE(catalog.etag(), QByteArray("\"a\""));
+}
+
+QTEST_MAIN(SurveyCatalogTest)
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <QObject>
+
+class SurveyCatalogTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testReturnsNewSurveys();
+    void testReturnsOnlyChangedSurveys();
+    void testDropsRemovedSurveys();
+    void testKeepsListOnErrors();
+};
@@ -0,0 +1,83 @@
+#include <QTest>
+
+#include <daemon/task_queue.hpp>
+
+#include "task_queue_test.hpp"
+
+namespace {
+// Finishes after the delay, counting the tasks running meanwhile.
+QFuture<void> runFor(QObject* context, int delay, int& running, int& maxRunning)
+{
+    running++;
+    maxRunning = qMax(maxRunning, running);
+    const auto completion = createCompletion();
+    QTimer::singleShot(delay, context, [completion, &running]() { running--; });
+    return completion->future();
+}
+}
+
+void TaskQueueTest::testStartsByPriority()
+{
+    QObject context;
+    TaskQueue queue(&context, 1);
+    QList<QString> started;
+    const auto task = [&started](const QString& name) {
+        return [&started, name]() {
+            started.append(name);
+            return QtFuture::makeReadyFuture();
+        };
+    };
+
+    queue.enqueue(2, task("discovery"));
+    queue.enqueue(1, task("member"));
+    queue.enqueue(0, task("delegate"));
+    const auto last = queue.enqueue(1, task("second member"));
+
+    QTRY_VERIFY(last.isFinished());
+    QCOMPARE(started,
+        QList<QString>({ "delegate", "member", "second member", "discovery" }));
+}
+
+void TaskQueueTest::testLimitsTasksInFlight()
+{
+    QObject context;
+    TaskQueue queue(&context, 2);
+    int running = 0;
+    int maxRunning = 0;
+
+    QList<QFuture<void>> futures;
+    for (int i = 0; i < 5; i++) {
+        futures.append(queue.enqueue(0, [&]() {
+            return runFor(&context, 10, running, maxRunning);
+        }));
+    }
+
+    for (const auto& future : futures)
+        QTRY_VERIFY(future.isFinished());
+    QCOMPARE(running, 0);
+    QCOMPARE(maxRunning, 2);
+}
+
+void TaskQueueTest::testReportsDelaysByPriority()
+{
+    QObject context;
+    TaskQueue queue(&context, 1);
+    int running = 0;
+    int maxRunning = 0;
+
+    queue.enqueue(
+        0, [&]() { return runFor(&context, 20, running, maxRunning); });
+    const auto waiting = queue.enqueue(
+        1, [&]() { return runFor(&context, 0, running, maxRunning); });
+    QTRY_VERIFY(waiting.isFinished());
+
+    const auto stats = queue.stats();
+    QCOMPARE(stats.keys(), QList<int>({ 0, 1 }));
+    QCOMPARE(stats[0].started, quint64(1));
+    QCOMPARE(stats[1].started, quint64(1));
+    // The second task waited for the first one to finish.
+    QVERIFY(stats[1].maxDelayMs >= 20);
+    QVERIFY(stats[1].averageDelayMs <= stats[1].maxDelayMs);
+}
+
+QTEST_MAIN(TaskQueueTest)
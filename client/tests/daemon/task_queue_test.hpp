@@ -0,0 +1,12 @@
+#pragma once
+
+#include <QObject>
+
+class TaskQueueTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void testStartsByPriority();
+    void testLimitsTasksInFlight();
+    void testReportsDelaysByPriority();
+};
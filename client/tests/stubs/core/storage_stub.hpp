@@ -9,8 +9,12 @@ private:
     QList<SurveyResponseRecord> surveyResponses;
     QList<SurveyRecord> surveyRecords;
     QList<QSharedPointer<Survey>> surveys;
+    QHash<QString, DelegateAggregation> delegateAggregations;
+    QHash<QString, QSet<QByteArray>> foldedDelegateMessages;
 
 public:
+    mutable int countCohortsCalls = 0;
+
     QList<DataPoint> listDataPoints(const QString& key) const
     {
         QList<DataPoint> matchingValues;
@@ -19,16 +23,51 @@ public:
         return matchingValues;
     };
 
+    void forEachDataPoint(const QString& key,
+        const std::function<bool(const DataPoint&)>& callback) const
+    {
+        for (const auto& dataPoint : dataPoints)
+            if ((key.isEmpty() || dataPoint.first == key)
+                && !callback({ .key = dataPoint.first,
+                    .value = dataPoint.second }))
+                return;
+    }
+
     void addDataPoint(const QString& dataKey, const QString& data)
     {
         dataPoints.push_back(QPair<QString, QString>(dataKey, data));
     }
 
+    bool addDataPoints(const QList<DataPoint>& dataPoints)
+    {
+        for (const auto& dataPoint : dataPoints)
+            addDataPoint(dataPoint.key, dataPoint.value);
+        return true;
+    }
+
+    bool enableSketch(const QString&) { return true; }
+
+    std::optional<DataPoint> findLatestDataPoint(const QString& key) const
+    {
+        for (auto it = dataPoints.rbegin(); it != dataPoints.rend(); ++it)
+            if (it->first == key)
+                return DataPoint { .key = key, .value = it->second };
+        return std::nullopt;
+    }
+
     QList<SurveyResponseRecord> listSurveyResponses() const
     {
         return surveyResponses;
     }
 
+    void forEachSurveyResponse(
+        const std::function<bool(const SurveyResponseRecord&)>& callback) const
+    {
+        for (const auto& response : surveyResponses)
+            if (!callback(response))
+                return;
+    }
+
     bool checkIfDataPointPresent(const QString& key) const
     {
         for (const auto& dataPoint : dataPoints) {
@@ -39,6 +78,31 @@ public:
         return false;
     }
 
+    QHash<QString, QMap<QString, int>> countCohorts(
+        const QString& key, const QList<QSharedPointer<Query>>& queries) const
+    {
+        countCohortsCalls++;
+        QList<QString> values;
+        for (const auto& dataPoint : dataPoints)
+            if (dataPoint.first == key)
+                values.push_back(dataPoint.second);
+        if (values.isEmpty())
+            return {};
+
+        QHash<QString, QMap<QString, int>> cohortCounts;
+        for (const auto& query : queries) {
+            auto& cohortData = cohortCounts[query->id];
+            for (const auto& cohort : query->cohorts)
+                cohortData[cohort] = 0;
+            const auto queryValues
+                = query->latest ? QList<QString> { values.last() } : values;
+            for (const auto& value : queryValues)
+                for (const auto& cohort : query->matchingCohorts(value))
+                    cohortData[cohort]++;
+        }
+        return cohortCounts;
+    }
+
     void addSurveyResponse(const SurveyResponse& response, const Survey& survey)
     {
         surveyResponses.push_back(
@@ -71,6 +135,15 @@ public:
         return records;
     }
 
+    QList<SurveyRecord> listSurveyRecords(const SurveyState& state) const
+    {
+        QList<SurveyRecord> records;
+        for (const auto& record : listSurveyRecords())
+            if (record.getState() == state)
+                records.append(record);
+        return records;
+    }
+
     void addSurveyRecord(const Survey& survey, const QString& clientId,
         const QString& publicKey, const QString& delegatePublicKey,
         const std::optional<QString>& aggregationPublicKey,
@@ -112,4 +185,46 @@ public:
     {
         return nullptr;
     }
+
+    DelegateAggregation findDelegateAggregation(const QString& surveyId) const
+    {
+        return delegateAggregations.value(surveyId);
+    }
+
+    bool checkIfDelegateMessageFolded(
+        const QString& surveyId, const QByteArray& digest) const
+    {
+        return foldedDelegateMessages.value(surveyId).contains(digest);
+    }
+
+    void foldDelegateMessages(const QString& surveyId,
+        const QList<QByteArray>& digests, const QByteArray& aggregate,
+        qint64 position)
+    {
+        auto& folded = foldedDelegateMessages[surveyId];
+        for (const auto& digest : digests)
+            folded.insert(digest);
+        delegateAggregations.insert(surveyId,
+            { .position = position,
+                .count = int(folded.count()),
+                .aggregate = aggregate });
+    }
+
+    void removeDelegateAggregation(const QString& surveyId)
+    {
+        delegateAggregations.remove(surveyId);
+        foldedDelegateMessages.remove(surveyId);
+    }
+
+    // Transactions currently open, and all that were started.
+    int transactionDepth = 0;
+    int transactions = 0;
+
+    void transaction()
+    {
+        transactionDepth++;
+        transactions++;
+    }
+    void commit() { transactionDepth--; }
+    void rollback() { transactionDepth--; }
 };
@@ -1,36 +1,168 @@
 #include <daemon/network.hpp>
 
+// Replies asynchronously like the real network, after replyDelay milliseconds.
 class NetworkStub : public Network {
 public:
     QByteArray listSurveysResponse;
+    // Sent along with listSurveysResponse. Requests with the same ETag get a
+    // not modified reply, unless it's empty.
+    QByteArray listSurveysEtag;
+    // The ETag of each listSurveys() call.
+    mutable QList<QByteArray> listSurveysEtags;
     QByteArray getSignupStateResponse;
+    QByteArray getMessagesForDelegateResponse;
+    // The number of surveys or client IDs of each batch request.
+    QList<int> signupBatches;
+    mutable QList<int> signupStateBatches;
+    mutable int delegateMessages = 0;
+    // The since cursor of each getMessagesForDelegate() call.
+    mutable QList<qint64> messagesSince;
+    QDateTime retryAfterTime;
+    int replyDelay = 0;
+    // Requests sent so far, and the most that were waiting at once.
+    mutable int requests = 0;
+    mutable int maxPendingRequests = 0;
+    // Called whenever a request is sent, to check the client's state then.
+    std::function<void()> onRequest;
+    // Stands in for the server's signup events: a long poll finishes once one
+    // of its tokens differs from these, set with setSignupEventToken().
+    QHash<QString, QString> signupEventTokens;
+    // Long polls that fail before the next one works.
+    mutable int failingSignupEventPolls = 0;
+    mutable int signupEventPolls = 0;
+    // The client IDs of the last long poll.
+    mutable QList<QString> polledClientIds;
 
-    QByteArray listSurveys() const { return listSurveysResponse; }
+    QFuture<ConditionalReply> listSurveys(const QByteArray& etag) const
+    {
+        listSurveysEtags.append(etag);
+        if (!listSurveysEtag.isEmpty() && etag == listSurveysEtag)
+            return reply(ConditionalReply());
+        return reply(ConditionalReply { .modified = true,
+            .etag = listSurveysEtag,
+            .data = listSurveysResponse });
+    }
 
-    QByteArray surveySignup(const QString& surveyId, const QString& publicKey)
+    // Hands out a new client ID for every survey, like the server.
+    QFuture<QByteArray> surveySignups(const QHash<QString, QString>& publicKeys)
     {
-        return {};
+        signupBatches.append(publicKeys.count());
+        QJsonObject clientIds;
+        for (const auto& surveyId : publicKeys.keys()) {
+            clientIds[surveyId]
+                = QUuid::createUuid().toString(QUuid::WithoutBraces);
+        }
+        const QJsonObject response { { "client_ids", clientIds } };
+        return reply(QJsonDocument(response).toJson());
     }
 
-    QByteArray getSignupState(const QString& clientId) const
+    // Answers every client ID with getSignupStateResponse, unless it's empty.
+    QFuture<QByteArray> getSignupStates(const QStringList& clientIds) const
     {
-        return getSignupStateResponse;
+        signupStateBatches.append(clientIds.count());
+        QJsonObject states;
+        const auto state = QJsonDocument::fromJson(getSignupStateResponse);
+        for (const auto& clientId : clientIds) {
+            if (!state.isNull())
+                states[clientId] = state.object();
+        }
+        const QJsonObject response { { "states", states } };
+        return reply(QJsonDocument(response).toJson());
     }
 
-    QByteArray getMessagesForDelegate(const QString& delegatePublicKey) const
+    QFuture<QByteArray> getMessagesForDelegate(
+        const QString& delegatePublicKey, qint64 since) const
     {
-        return {};
+        messagesSince.append(since);
+        return reply(getMessagesForDelegateResponse);
     }
 
-    bool postMessageToDelegate(
+    QFuture<bool> postMessageToDelegate(
         const QString& delegatePublicKey, const QString& message) const
     {
-        return true;
+        delegateMessages++;
+        return reply(true);
     }
 
-    bool postAggregationResult(
+    QFuture<bool> postAggregationResult(
         const QString& delegatePublicKey, const QByteArray& data)
     {
-        return true;
+        return reply(true);
+    }
+
+    QFuture<QByteArray> waitForSignupEvents(
+        const QHash<QString, QString>& tokens) const
+    {
+        signupEventPolls++;
+        auto promise = QSharedPointer<QPromise<QByteArray>>::create();
+        promise->start();
+        if (failingSignupEventPolls > 0) {
+            failingSignupEventPolls--;
+            QTimer::singleShot(replyDelay, &context, [promise]() {
+                promise->addResult(QByteArray());
+                promise->finish();
+            });
+            return promise->future();
+        }
+
+        polledTokens = tokens;
+        polledClientIds = tokens.keys();
+        signupEventPoll = promise;
+        QTimer::singleShot(
+            replyDelay, &context, [this]() { answerSignupEventPoll(); });
+        return promise->future();
+    }
+
+    void setSignupEventToken(const QString& clientId, const QString& token)
+    {
+        signupEventTokens.insert(clientId, token);
+        answerSignupEventPoll();
+    }
+
+    QDateTime retryAfter() const { return retryAfterTime; }
+
+private:
+    mutable int pendingRequests = 0;
+    QObject context;
+    mutable QHash<QString, QString> polledTokens;
+    mutable QSharedPointer<QPromise<QByteArray>> signupEventPoll;
+
+    // Waits on while nothing changed, there's no timeout.
+    void answerSignupEventPoll() const
+    {
+        if (signupEventPoll.isNull())
+            return;
+
+        QJsonObject events;
+        for (auto it = polledTokens.cbegin(); it != polledTokens.cend(); ++it) {
+            const auto token = signupEventTokens.value(it.key(), "unknown");
+            if (token != it.value())
+                events[it.key()] = token;
+        }
+        if (events.isEmpty())
+            return;
+
+        const auto promise = std::exchange(signupEventPoll, {});
+        promise->addResult(
+            QJsonDocument(QJsonObject { { "events", events } }).toJson());
+        promise->finish();
+    }
+
+    template <typename T> QFuture<T> reply(const T& value) const
+    {
+        if (onRequest)
+            onRequest();
+        requests++;
+        pendingRequests++;
+        maxPendingRequests = qMax(maxPendingRequests, pendingRequests);
+
+        auto promise = QSharedPointer<QPromise<T>>::create();
+        promise->start();
+        QTimer::singleShot(replyDelay, &context, [this, promise, value]() {
+            pendingRequests--;
+            promise->addResult(value);
+            promise->finish();
+        });
+        return promise->future();
     }
 };
@@ -1,10 +1,15 @@
+import math
+
 from rest_framework import serializers
 
 from .models.commissioner import Commissioner
 from .models.data_point import DataPoint
+from .models.histogram import histogram_cohorts
 from .models.response import QueryResponse, SurveyResponse
 from .models.survey import Query, Survey
 
+HISTOGRAM_KEYS = ("start", "width", "bucket_count")
+
 
 class CommissionerSerializer(serializers.ModelSerializer):
     class Meta:
@@ -27,12 +32,24 @@ class QuerySerializer(serializers.ModelSerializer):
 
     class Meta:
         model = Query
-        fields = ["id", "data_key", "cohorts", "discrete"]
+        fields = [
+            "id",
+            "data_key",
+            "cohorts",
+            "discrete",
+            "histogram",
+            "latest",
+        ]
         read_only_fields = ["id"]
 
     def to_representation(self, instance):
         representation = super().to_representation(instance)
         representation["data_key"] = instance.data_point.to_data_key()
+        # Clients derive the cohorts from the histogram, no need to send both
+        if instance.histogram:
+            del representation["cohorts"]
+        else:
+            del representation["histogram"]
         return representation
 
     def validate_data_key(self, value):
@@ -46,6 +63,34 @@ class QuerySerializer(serializers.ModelSerializer):
         except Exception as e:
             raise serializers.ValidationError(str(e))
 
+    def validate_histogram(self, value):
+        if value is None:
+            return value
+        if not isinstance(value, dict) or set(value) != set(HISTOGRAM_KEYS):
+            raise serializers.ValidationError(
+                "Histogram needs exactly start, width and bucket_count"
+            )
+        start, width, bucket_count = (value[key] for key in HISTOGRAM_KEYS)
+        # bool is an int too, but never a meaningful bound
+        if any(
+            isinstance(number, bool) or not isinstance(number, (int, float))
+            for number in (start, width, bucket_count)
+        ):
+            raise serializers.ValidationError(
+                "Histogram values must be numbers"
+            )
+        if not math.isfinite(start) or not math.isfinite(width):
+            raise serializers.ValidationError("Histogram bounds must be finite")
+        if not isinstance(bucket_count, int):
+            raise serializers.ValidationError(
+                "Histogram bucket_count must be an integer"
+            )
+        try:
+            histogram_cohorts(start, width, bucket_count)
+        except ValueError as e:
+            raise serializers.ValidationError(str(e))
+        return value
+
     def create(self, validated_data):
         data_point = validated_data.pop("data_key")
         return Query.objects.create(data_point=data_point, **validated_data)
@@ -0,0 +1,55 @@
+import io
+import zlib
+
+from django.conf import settings
+from django.http import HttpResponse
+
+# Content codings accepted for request bodies, advertised on every response.
+ACCEPTED_ENCODINGS = "gzip"
+
+
+class RequestDecompressionMiddleware:
+    """
+    Decodes request bodies sent with "Content-Encoding: gzip", so views read
+    them like plain ones. Other codings are answered with 415 Unsupported Media
+    Type. Every response has an Accept-Encoding header (RFC 7694), which tells
+    clients they may compress what they send next.
+    """
+
+    def __init__(self, get_response):
+        self.get_response = get_response
+
+    def __call__(self, request):
+        encoding = request.headers.get("Content-Encoding", "identity")
+        encoding = encoding.strip().lower()
+        if encoding == "gzip":
+            body = decompress(request.body)
+            if body is None:
+                return HttpResponse("Invalid gzip body", status=400)
+            # Both, for views that read the stream instead of the body.
+            request._body = body
+            request._stream = io.BytesIO(body)
+            request.META["CONTENT_LENGTH"] = str(len(body))
+            response = self.get_response(request)
+        elif encoding == "identity":
+            response = self.get_response(request)
+        else:
+            response = HttpResponse("Unsupported Content-Encoding", status=415)
+        response["Accept-Encoding"] = ACCEPTED_ENCODINGS
+        return response
+
+
+def decompress(data):
+    """
+    Returns the decompressed gzip data, or None if it's corrupt or larger than
+    uploads may be.
+    """
+    max_size = settings.DATA_UPLOAD_MAX_MEMORY_SIZE or 0
+    decompressor = zlib.decompressobj(wbits=16 + zlib.MAX_WBITS)
+    try:
+        body = decompressor.decompress(data, max_size)
+    except zlib.error:
+        return None
+    if decompressor.unconsumed_tail or not decompressor.eof:
+        return None
+    return body
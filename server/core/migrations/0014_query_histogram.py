@@ -0,0 +1,16 @@
+from django.db import migrations, models
+
+
+class Migration(migrations.Migration):
+
+    dependencies = [
+        ("core", "0013_load_fixture_data_points_data"),
+    ]
+
+    operations = [
+        migrations.AddField(
+            model_name="query",
+            name="histogram",
+            field=models.JSONField(blank=True, null=True),
+        ),
+    ]
@@ -0,0 +1,16 @@
+from django.db import migrations, models
+
+
+class Migration(migrations.Migration):
+
+    dependencies = [
+        ("core", "0014_query_histogram"),
+    ]
+
+    operations = [
+        migrations.AddField(
+            model_name="query",
+            name="latest",
+            field=models.BooleanField(default=False),
+        ),
+    ]
@@ -0,0 +1,34 @@
+from django.db import migrations, models
+
+
+def number_messages(apps, schema_editor):
+    ClientToDelegateMessage = apps.get_model("core", "ClientToDelegateMessage")
+    sequences = {}
+    for message in ClientToDelegateMessage.objects.order_by("delegate_id"):
+        sequence = sequences.get(message.delegate_id, 0) + 1
+        sequences[message.delegate_id] = sequence
+        message.sequence = sequence
+        message.save(update_fields=["sequence"])
+
+
+class Migration(migrations.Migration):
+
+    dependencies = [
+        ("core", "0015_query_latest"),
+    ]
+
+    operations = [
+        migrations.AddField(
+            model_name="clienttodelegatemessage",
+            name="sequence",
+            field=models.PositiveBigIntegerField(default=0, editable=False),
+        ),
+        migrations.RunPython(number_messages, migrations.RunPython.noop),
+        migrations.AddConstraint(
+            model_name="clienttodelegatemessage",
+            constraint=models.UniqueConstraint(
+                fields=("delegate_id", "sequence"),
+                name="unique_message_sequence",
+            ),
+        ),
+    ]
@@ -1,7 +1,10 @@
 import uuid
 
 from core.models.aggregation_group import AggregationGroup
-from django.db import models
+from django.db import IntegrityError, models, transaction
+
+# Appends that collide on the sequence are retried this often.
+APPEND_ATTEMPTS = 3
 
 
 class ClientToDelegateMessage(models.Model):
@@ -11,5 +14,42 @@ class ClientToDelegateMessage(models.Model):
         AggregationGroup, on_delete=models.DO_NOTHING, editable=False
     )
     content = models.TextField(editable=False)
+    # Counts up per delegate, so delegates can fetch only the messages after
+    # the last one they have.
+    sequence = models.PositiveBigIntegerField(default=0, editable=False)
 
     objects = models.Manager()
+
+    class Meta:
+        constraints = [
+            models.UniqueConstraint(
+                fields=["delegate_id", "sequence"],
+                name="unique_message_sequence",
+            )
+        ]
+
+    @classmethod
+    def append(cls, delegate_id, group, content):
+        """
+        Stores the message with the next sequence of the delegate. Locking the
+        group row keeps concurrent appends apart on databases that support
+        it, on others the losing append retries with the next sequence.
+        """
+        for attempt in range(APPEND_ATTEMPTS):
+            try:
+                with transaction.atomic():
+                    AggregationGroup.objects.select_for_update().filter(
+                        pk=group.pk
+                    ).first()
+                    last = cls.objects.filter(
+                        delegate_id=delegate_id
+                    ).aggregate(models.Max("sequence"))["sequence__max"]
+                    return cls.objects.create(
+                        delegate_id=delegate_id,
+                        group=group,
+                        content=content,
+                        sequence=(last or 0) + 1,
+                    )
+            except IntegrityError:
+                if attempt == APPEND_ATTEMPTS - 1:
+                    raise
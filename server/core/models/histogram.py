@@ -0,0 +1,39 @@
+from typing import List
+
+
+# Beyond this, floats can't represent every integer
+MAX_EXACT_INTEGER = 2**53
+# Each bucket is a cohort on the server and on every client, keep in sync with
+# Histogram::maxBucketCount in the client
+MAX_BUCKET_COUNT = 1000
+
+
+def format_bound(bound: float) -> str:
+    # Same formatting as the client, so both arrive at the same cohort names:
+    # integers up to 2^53 without decimals, anything else as repr()
+    if float(bound).is_integer() and abs(bound) <= MAX_EXACT_INTEGER:
+        return str(int(bound))
+    return repr(float(bound))
+
+
+def histogram_cohorts(
+    start: float, width: float, bucket_count: int
+) -> List[str]:
+    if width <= 0:
+        raise ValueError(f"Histogram width {width} must be positive")
+    if bucket_count <= 0:
+        raise ValueError(
+            f"Histogram bucket count {bucket_count} must be positive"
+        )
+    if bucket_count > MAX_BUCKET_COUNT:
+        raise ValueError(
+            f"Histogram bucket count {bucket_count} exceeds {MAX_BUCKET_COUNT}"
+        )
+
+    cohorts = [f"(-inf, {format_bound(start)})"]
+    for i in range(bucket_count):
+        lower = format_bound(start + i * width)
+        upper = format_bound(start + (i + 1) * width)
+        cohorts.append(f"[{lower}, {upper})")
+    cohorts.append(f"[{format_bound(start + bucket_count * width)}, inf)")
+    return cohorts
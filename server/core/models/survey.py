@@ -3,6 +3,7 @@ import uuid
 from core.models.check_intervals import check_intervals
 from core.models.commissioner import Commissioner
 from core.models.data_point import DataPoint
+from core.models.histogram import histogram_cohorts
 from django.core.serializers.json import DjangoJSONEncoder
 from django.db import models
 from phe import paillier
@@ -32,6 +33,11 @@ class Query(models.Model):
     )
     cohorts = models.JSONField(encoder=DjangoJSONEncoder, default=list)
     discrete = models.BooleanField(default=True)
+    # Optional compact cohort specification with the keys start, width and
+    # bucket_count, the cohorts are derived from it if set.
+    histogram = models.JSONField(null=True, blank=True)
+    # Only count each participant's most recent value for the data point.
+    latest = models.BooleanField(default=False)
     number_participants = models.IntegerField(default=0, editable=False)
     aggregated_results = models.JSONField(default=dict, editable=False)
 
@@ -39,7 +45,14 @@ class Query(models.Model):
         return f"Query on {self.data_point.name}"
 
     def save(self, *args, **kwargs):
-        if not self.discrete:
+        if self.histogram:
+            self.discrete = False
+            self.cohorts = histogram_cohorts(
+                float(self.histogram["start"]),
+                float(self.histogram["width"]),
+                int(self.histogram["bucket_count"]),
+            )
+        elif not self.discrete:
             check_intervals(
                 self.cohorts,
                 self.data_point.min_value,
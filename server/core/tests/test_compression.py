@@ -0,0 +1,110 @@
+import gzip
+import json
+
+from core.models.aggregation_group import AggregationGroup
+from core.models.client_to_delegate_message import ClientToDelegateMessage
+from core.models.commissioner import Commissioner
+from core.models.data_point import DataPoint, Types
+from core.models.survey import Query, Survey
+from core.models.survey_signup import SurveySignup
+from django.test import TestCase
+from django.urls import reverse
+from phe import paillier
+
+
+class CompressionTest(TestCase):
+    def setUp(self):
+        self.commissioner = Commissioner.objects.create(name="TestCommissioner")
+        survey = Survey.objects.create(
+            name="TestSurvey", commissioner=self.commissioner
+        )
+        self.signup = SurveySignup.objects.create(
+            survey=survey, public_key="123"
+        )
+        self.signup.group = AggregationGroup.objects.create(
+            survey=survey, delegate=self.signup
+        )
+        self.signup.save()
+
+    def post_message(self, body, encoding):
+        return self.client.post(
+            reverse("message-to-delegate"),
+            body,
+            content_type="application/json",
+            HTTP_CONTENT_ENCODING=encoding,
+        )
+
+    def test_advertises_accepted_encodings(self):
+        response = self.client.get(reverse("get-surveys"))
+
+        self.assertEqual(response.status_code, 200)
+        self.assertEqual(response["Accept-Encoding"], "gzip")
+
+    def test_accepts_gzip_request_bodies(self):
+        message = "1234567890" * 100
+        body = json.dumps({"public_key": "123", "message": message})
+
+        response = self.post_message(gzip.compress(body.encode()), "gzip")
+
+        self.assertEqual(response.status_code, 201)
+        self.assertEqual(ClientToDelegateMessage.objects.get().content, message)
+
+    def test_accepts_gzip_aggregation_results(self):
+        data_point = DataPoint.objects.create(
+            name="test", key="test", type=Types.INTEGER.value
+        )
+        query = Query.objects.create(
+            survey=self.signup.survey, data_point=data_point, cohorts=["yes"]
+        )
+        public_key = paillier.PaillierPublicKey(
+            n=int(self.signup.group.aggregation_public_key_n)
+        )
+        result = {
+            "survey_id": str(self.signup.survey.id),
+            "query_responses": [
+                {
+                    "query_id": str(query.id),
+                    "data": {"yes": public_key.encrypt(3).ciphertext()},
+                }
+            ],
+        }
+
+        response = self.client.post(
+            reverse("post-aggregation-result", args=[self.signup.id]),
+            gzip.compress(json.dumps(result).encode()),
+            content_type="application/json",
+            HTTP_CONTENT_ENCODING="gzip",
+        )
+
+        self.assertEqual(response.status_code, 201)
+        query.refresh_from_db()
+        self.assertEqual(query.aggregated_results["yes"], 3)
+
+    def test_rejects_corrupt_gzip_request_bodies(self):
+        body = gzip.compress(b'{"public_key": "123", "message": "1"}')
+
+        response = self.post_message(body[:-8], "gzip")
+
+        self.assertEqual(response.status_code, 400)
+        self.assertFalse(ClientToDelegateMessage.objects.exists())
+
+    def test_rejects_unknown_encodings(self):
+        response = self.post_message(b"{}", "br")
+
+        self.assertEqual(response.status_code, 415)
+        self.assertEqual(response["Accept-Encoding"], "gzip")
+
+    def test_compresses_responses(self):
+        for i in range(20):
+            Survey.objects.create(
+                name=f"Survey {i}", commissioner=self.commissioner
+            )
+
+        response = self.client.get(
+            reverse("get-surveys"), HTTP_ACCEPT_ENCODING="gzip"
+        )
+
+        self.assertEqual(response.status_code, 200)
+        self.assertEqual(response["Content-Encoding"], "gzip")
+        surveys = json.loads(gzip.decompress(response.content))
+        self.assertEqual(len(surveys), 21)
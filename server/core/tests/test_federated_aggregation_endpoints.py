@@ -113,6 +113,109 @@ class GetSignupStateTest(TestCase):
         self.assertEqual(response.status_code, 404)
 
 
+class SurveySignupsTest(TestCase):
+    def setUp(self):
+        commissioner = Commissioner.objects.create(name="TestCommissioner")
+        self.surveys = [
+            Survey.objects.create(
+                name=f"TestSurvey{i}",
+                commissioner=commissioner,
+                group_size=1,
+                group_count=1,
+            )
+            for i in range(2)
+        ]
+
+    def sign_up(self, public_keys):
+        return self.client.post(
+            reverse("survey-signups"),
+            content_type="application/json",
+            data=json.dumps({"public_keys": public_keys}),
+        )
+
+    def test_signs_up_for_all_surveys(self):
+        public_keys = {
+            str(survey.id): f"key{i}" for i, survey in enumerate(self.surveys)
+        }
+        missing_id = str(uuid.uuid4())
+        public_keys[missing_id] = "missing"
+
+        response = self.sign_up(public_keys)
+
+        self.assertEqual(response.status_code, 201)
+        client_ids = response.json()["client_ids"]
+        self.assertNotIn(missing_id, client_ids)
+        for i, survey in enumerate(self.surveys):
+            signup = SurveySignup.objects.get(id=client_ids[str(survey.id)])
+            self.assertEqual(signup.survey, survey)
+            self.assertEqual(signup.public_key, f"key{i}")
+
+    def test_400_with_invalid_survey_id(self):
+        response = self.sign_up({"invalid": "123"})
+
+        self.assertEqual(response.status_code, 400)
+        self.assertEqual(len(SurveySignup.objects.all()), 0)
+
+
+class GetSignupStatesTest(TestCase):
+    def setUp(self):
+        commissioner = Commissioner.objects.create(name="TestCommissioner")
+        self.survey = Survey.objects.create(
+            name="TestSurvey", commissioner=commissioner, group_size=1
+        )
+        self.signup = SurveySignup.objects.create(
+            survey=self.survey, public_key="123"
+        )
+        self.signup2 = SurveySignup.objects.create(
+            survey=self.survey, public_key="456"
+        )
+
+    def get_states(self, client_ids):
+        return self.client.post(
+            reverse("get-signup-states"),
+            content_type="application/json",
+            data=json.dumps({"client_ids": client_ids}),
+        )
+
+    def test_returns_states_by_client_id(self):
+        aggregation_group = AggregationGroup.objects.create(
+            survey=self.survey, delegate=self.signup
+        )
+        self.signup.group = aggregation_group
+        self.signup.save()
+        missing_id = str(uuid.uuid4())
+
+        response = self.get_states(
+            [str(self.signup.id), str(self.signup2.id), missing_id]
+        )
+
+        self.assertEqual(response.status_code, 200)
+        self.assertEqual(
+            response.json()["states"],
+            {
+                str(self.signup.id): {
+                    "delegate_public_key": "123",
+                    "aggregation_started": True,
+                    "group_size": 1,
+                    "aggregation_public_key_n": str(
+                        aggregation_group.aggregation_public_key_n
+                    ),
+                },
+                str(self.signup2.id): {
+                    "delegate_public_key": "",
+                    "aggregation_started": False,
+                },
+            },
+        )
+
+    def test_400_with_too_many_client_ids(self):
+        client_ids = [str(uuid.uuid4()) for _ in range(101)]
+
+        response = self.get_states(client_ids)
+
+        self.assertEqual(response.status_code, 400)
+
+
 class ResultPostingTest(TestCase):
     def setUp(self):
         commissioner = Commissioner.objects.create(name="TestCommissioner")
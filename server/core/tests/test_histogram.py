@@ -0,0 +1,104 @@
+from core.json_serializers import QuerySerializer
+from core.models.commissioner import Commissioner
+from core.models.data_point import DataPoint, Types
+from core.models.histogram import (
+    MAX_BUCKET_COUNT,
+    format_bound,
+    histogram_cohorts,
+)
+from core.models.survey import Query, Survey
+from django.test import TestCase
+
+# Kept in sync with HistogramTest::testFormatBound in the client
+BOUNDS = [
+    (0, "0"),
+    (-2.5, "-2.5"),
+    (0.0001, "0.0001"),
+    (0.00001, "1e-05"),
+    (2e15, "2000000000000000"),
+    (2**53, "9007199254740992"),
+    (2**53 + 2, "9007199254740994.0"),
+    (1234567890123456.5, "1234567890123456.5"),
+    (1e16, "1e+16"),
+    (1.5e16, "1.5e+16"),
+]
+
+
+class HistogramTestCase(TestCase):
+    def test_cohorts_match_the_client(self):
+        self.assertEqual(
+            histogram_cohorts(0, 2.5, 2),
+            ["(-inf, 0)", "[0, 2.5)", "[2.5, 5)", "[5, inf)"],
+        )
+
+    def test_bounds_are_formatted_like_the_client(self):
+        for bound, expected in BOUNDS:
+            with self.subTest(bound=bound):
+                self.assertEqual(format_bound(float(bound)), expected)
+
+    def test_invalid_histograms_fail(self):
+        with self.assertRaises(ValueError):
+            histogram_cohorts(0, 0, 1)
+        with self.assertRaises(ValueError):
+            histogram_cohorts(0, 1, 0)
+        with self.assertRaises(ValueError):
+            histogram_cohorts(0, 1, MAX_BUCKET_COUNT + 1)
+        self.assertEqual(
+            len(histogram_cohorts(0, 1, MAX_BUCKET_COUNT)), MAX_BUCKET_COUNT + 2
+        )
+
+    def test_query_derives_cohorts_from_histogram(self):
+        commissioner = Commissioner.objects.create(name="test")
+        survey = Survey.objects.create(name="test", commissioner=commissioner)
+        data_point = DataPoint.objects.create(
+            name="test", key="test", type=Types.INTEGER.value
+        )
+        query = Query.objects.create(
+            survey=survey,
+            data_point=data_point,
+            histogram={"start": 0, "width": 10, "bucket_count": 1},
+        )
+
+        self.assertFalse(query.discrete)
+        self.assertEqual(query.cohorts, ["(-inf, 0)", "[0, 10)", "[10, inf)"])
+        self.assertEqual(
+            query.aggregated_results,
+            {"(-inf, 0)": 0, "[0, 10)": 0, "[10, inf)": 0},
+        )
+
+        representation = QuerySerializer(query).data
+        self.assertNotIn("cohorts", representation)
+        self.assertEqual(representation["histogram"]["bucket_count"], 1)
+
+    def test_serializer_rejects_invalid_histograms(self):
+        DataPoint.objects.create(
+            name="test", key="test", type=Types.INTEGER.value
+        )
+        valid = {"start": 0, "width": 2.5, "bucket_count": 2}
+        for histogram in [
+            {"start": 0, "width": 1},
+            {**valid, "extra": 1},
+            {**valid, "start": "0"},
+            {**valid, "width": 0},
+            {**valid, "bucket_count": 0},
+            {**valid, "bucket_count": 1.5},
+            {**valid, "bucket_count": True},
+            {**valid, "bucket_count": MAX_BUCKET_COUNT + 1},
+            {**valid, "bucket_count": 10**9},
+            [0, 1, 2],
+        ]:
+            with self.subTest(histogram=histogram):
+                serializer = QuerySerializer(
+                    data={
+                        "data_key": "test",
+                        "discrete": False,
+                        "histogram": histogram,
+                    }
+                )
+                self.assertFalse(serializer.is_valid())
+                self.assertIn("histogram", serializer.errors)
+
+        serializer = QuerySerializer(
+            data={"data_key": "test", "discrete": False, "histogram": valid}
+        )
+        self.assertTrue(serializer.is_valid(), serializer.errors)
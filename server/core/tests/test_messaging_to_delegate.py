@@ -1,10 +1,12 @@
 import json
+from unittest import mock
 
 from core.models.aggregation_group import AggregationGroup
 from core.models.client_to_delegate_message import ClientToDelegateMessage
 from core.models.commissioner import Commissioner
 from core.models.survey import Survey
 from core.models.survey_signup import SurveySignup
+from django.db.models import QuerySet
 from django.test import TestCase
 from django.urls import reverse
 
@@ -112,7 +114,8 @@ class MessagingToDelegateTest(TestCase):
 
         response_content = get_response.content.decode("utf-8")
         self.assertJSONEqual(
-            response_content, '{"messages": ["secureencryptedmessagetrustme"]}'
+            response_content,
+            '{"messages": ["secureencryptedmessagetrustme"], "cursor": 1}',
         )
 
         post_response = self.client.post(
@@ -134,6 +137,49 @@ class MessagingToDelegateTest(TestCase):
         response_content = get_response.content.decode("utf-8")
         expected_response = (
             '{"messages": ["secureencryptedmessagetrustme"'
-            + ',"secureencryptedmessagetrustmeagain"]}'
+            + ',"secureencryptedmessagetrustmeagain"], "cursor": 2}'
         )
         self.assertJSONEqual(response_content, expected_response)
+
+        get_response = self.client.get(
+            get_url, {"since": 1}, content_type="application/json"
+        )
+        self.assertEqual(get_response.status_code, 200)
+        self.assertJSONEqual(
+            get_response.content.decode("utf-8"),
+            '{"messages": ["secureencryptedmessagetrustmeagain"], "cursor": 2}',
+        )
+
+        get_response = self.client.get(
+            get_url, {"since": 2}, content_type="application/json"
+        )
+        self.assertEqual(get_response.status_code, 204)
+
+    def test_retrieving_with_invalid_cursor_gives_400(self):
+        get_url = reverse("get-messages-for-delegate", args=[self.signup.id])
+        get_response = self.client.get(get_url, {"since": "latest"})
+        self.assertEqual(get_response.status_code, 400)
+
+    def test_colliding_sequences_are_retried(self):
+        ClientToDelegateMessage.append(
+            self.signup.id, self.aggregation_group, "first"
+        )
+        aggregate = QuerySet.aggregate
+        calls = []
+
+        # The first append sees the state from before the other one.
+        def stale_aggregate(queryset, *args, **kwargs):
+            calls.append(queryset)
+            if len(calls) == 1:
+                return {"sequence__max": None}
+            return aggregate(queryset, *args, **kwargs)
+
+        with mock.patch.object(
+            QuerySet, "aggregate", autospec=True, side_effect=stale_aggregate
+        ):
+            message = ClientToDelegateMessage.append(
+                self.signup.id, self.aggregation_group, "second"
+            )
+
+        self.assertEqual(message.sequence, 2)
+        self.assertEqual(len(calls), 2)
@@ -0,0 +1,123 @@
+import json
+import uuid
+
+from core.models.aggregation_group import AggregationGroup
+from core.models.client_to_delegate_message import ClientToDelegateMessage
+from core.models.commissioner import Commissioner
+from core.models.survey import Survey
+from core.models.survey_signup import SurveySignup
+from core.views import MAX_BATCH_SIZE
+from django.test import TestCase
+from django.urls import reverse
+
+
+class SignupEventsTest(TestCase):
+    def setUp(self):
+        commissioner = Commissioner.objects.create(name="TestCommissioner")
+        self.survey = Survey.objects.create(
+            name="TestSurvey", commissioner=commissioner, group_size=2
+        )
+        self.delegate = SurveySignup.objects.create(
+            survey=self.survey, public_key="123"
+        )
+        self.member = SurveySignup.objects.create(
+            survey=self.survey, public_key="456"
+        )
+
+    def wait_for_events(self, client_ids, timeout=0):
+        return self.client.post(
+            reverse("signup-events"),
+            json.dumps({"client_ids": client_ids, "timeout": timeout}),
+            content_type="application/json",
+        )
+
+    def start_aggregation(self):
+        group = AggregationGroup.objects.create(
+            survey=self.survey, delegate=self.delegate
+        )
+        for signup in [self.delegate, self.member]:
+            signup.group = group
+            signup.save()
+        return group
+
+    def test_returns_tokens_of_unknown_signups(self):
+        missing_id = str(uuid.uuid4())
+        response = self.wait_for_events(
+            {str(self.member.id): "", missing_id: ""}
+        )
+
+        self.assertEqual(response.status_code, 200)
+        self.assertEqual(
+            response.json()["events"],
+            {str(self.member.id): "waiting", missing_id: "unknown"},
+        )
+
+    def test_returns_nothing_without_changes(self):
+        response = self.wait_for_events({str(self.member.id): "waiting"})
+
+        self.assertEqual(response.status_code, 200)
+        self.assertEqual(response.json()["events"], {})
+
+    def test_reports_aggregation_start_and_messages(self):
+        group = self.start_aggregation()
+        ClientToDelegateMessage.objects.create(
+            delegate_id=self.delegate.id, group=group, content="message"
+        )
+
+        response = self.wait_for_events(
+            {str(self.delegate.id): "waiting", str(self.member.id): "waiting"}
+        )
+
+        self.assertEqual(
+            response.json()["events"],
+            {
+                str(self.delegate.id): "messages:1",
+                str(self.member.id): "started",
+            },
+        )
+
+    def test_rejects_missing_client_ids(self):
+        response = self.client.post(
+            reverse("signup-events"),
+            json.dumps({"timeout": 0}),
+            content_type="application/json",
+        )
+
+        self.assertEqual(response.status_code, 400)
+
+    def test_rejects_non_finite_timeouts(self):
+        for timeout in ["nan", float("nan"), "inf", float("-inf")]:
+            with self.subTest(timeout=timeout):
+                response = self.wait_for_events(
+                    {str(self.member.id): "waiting"}, timeout
+                )
+
+                self.assertEqual(response.status_code, 400)
+
+    def test_clamps_negative_timeouts(self):
+        response = self.wait_for_events({str(self.member.id): "waiting"}, -5)
+
+        self.assertEqual(response.status_code, 200)
+        self.assertEqual(response.json()["events"], {})
+
+    def test_rejects_too_many_client_ids(self):
+        client_ids = {str(uuid.uuid4()): "" for _ in range(MAX_BATCH_SIZE + 1)}
+
+        response = self.wait_for_events(client_ids)
+
+        self.assertEqual(response.status_code, 400)
+
+    def test_checks_all_signups_with_one_query(self):
+        group = self.start_aggregation()
+        ClientToDelegateMessage.objects.create(
+            delegate_id=self.delegate.id, group=group, content="message"
+        )
+        client_ids = {str(uuid.uuid4()): "" for _ in range(10)}
+        client_ids.update({str(self.delegate.id): "", "invalid": ""})
+
+        with self.assertNumQueries(1):
+            response = self.wait_for_events(client_ids)
+
+        events = response.json()["events"]
+        self.assertEqual(events[str(self.delegate.id)], "messages:1")
+        self.assertEqual(events["invalid"], "unknown")
@@ -0,0 +1,40 @@
+from core.models.commissioner import Commissioner
+from core.models.survey import Survey
+from django.test import TestCase
+from django.urls import reverse
+
+
+class SurveyCatalogTest(TestCase):
+    def setUp(self):
+        self.commissioner = Commissioner.objects.create(name="KDE")
+        Survey.objects.create(name="TestSurvey", commissioner=self.commissioner)
+
+    def get_surveys(self, etag=None):
+        headers = {"HTTP_IF_NONE_MATCH": etag} if etag else {}
+        return self.client.get(reverse("get-surveys"), **headers)
+
+    def test_returns_surveys_with_etag(self):
+        response = self.get_surveys()
+
+        self.assertEqual(response.status_code, 200)
+        self.assertEqual(len(response.json()), 1)
+        self.assertTrue(response["ETag"])
+
+    def test_304_while_unchanged(self):
+        etag = self.get_surveys()["ETag"]
+
+        response = self.get_surveys(etag)
+
+        self.assertEqual(response.status_code, 304)
+        self.assertEqual(response["ETag"], etag)
+        self.assertEqual(response.content, b"")
+
+    def test_200_after_changes(self):
+        etag = self.get_surveys()["ETag"]
+        Survey.objects.create(name="NewSurvey", commissioner=self.commissioner)
+
+        response = self.get_surveys(etag)
+
+        self.assertEqual(response.status_code, 200)
+        self.assertEqual(len(response.json()), 2)
+        self.assertNotEqual(response["ETag"], etag)
@@ -1,4 +1,8 @@
+import hashlib
 import json
+import math
+import time
+import uuid
 
 from core.json_serializers import SurveyResponseSerializer, SurveySerializer
 from core.models.aggregation_group import AggregationGroup
@@ -6,13 +10,25 @@ from core.models.client_to_delegate_message import ClientToDelegateMessage
 from core.models.grouping_logic import group_ungrouped_signups
 from core.models.survey import Survey
 from core.models.survey_signup import SurveySignup
+from django.core.exceptions import ValidationError
+from django.db.models import Count, OuterRef, Subquery
+from django.db.models.functions import Coalesce
 from django.http import HttpResponse, HttpResponseBadRequest, JsonResponse
 from django.shortcuts import get_object_or_404
+from django.utils.cache import get_conditional_response
+from django.utils.http import quote_etag
 from django.views.decorators.csrf import csrf_exempt
 from django.views.decorators.http import require_http_methods
 from phe import paillier
 from rest_framework.parsers import JSONParser
 
+# Longest a client waits for signup events, and how often they are checked
+# meanwhile.
+SIGNUP_EVENTS_TIMEOUT = 25
+SIGNUP_EVENTS_CHECK_INTERVAL = 0.5
+# Most signups or signup states a single batch request may cover.
+MAX_BATCH_SIZE = 100
+
 
 @csrf_exempt
 @require_http_methods(["POST"])
@@ -36,9 +52,24 @@ def save_survey_response(request):
 
 @require_http_methods(["GET"])
 def get_surveys(request):
-    surveys = Survey.objects.all()
+    """
+    Lists all surveys, or answers 304 Not Modified if the If-None-Match header
+    has the ETag of the current list.
+    """
+    # Ordered, so the ETag only changes with the surveys.
+    surveys = Survey.objects.order_by("id")
     serializer = SurveySerializer(surveys, many=True)
-    return JsonResponse(serializer.data, safe=False)
+    response = JsonResponse(serializer.data, safe=False)
+    etag = quote_etag(hashlib.sha256(response.content).hexdigest())
+    response["ETag"] = etag
+    return get_conditional_response(request, etag=etag, response=response)
+
+
+def group_signups(survey):
+    group_ungrouped_signups(
+        ungrouped_signups=list(SurveySignup.objects.filter(group__isnull=True)),
+        survey=survey,
+    )
 
 
 @csrf_exempt
@@ -60,12 +91,7 @@ def signup_to_survey(request):
             "time": survey_signup.time.isoformat(),
         }
 
-        group_ungrouped_signups(
-            ungrouped_signups=list(
-                SurveySignup.objects.filter(group__isnull=True)
-            ),
-            survey=survey,
-        )
+        group_signups(survey)
 
         return JsonResponse(response_data, status=201)
     # TODO: Improve error description
@@ -75,34 +101,105 @@ def signup_to_survey(request):
         return HttpResponse("Invalid JSON", status=400)
 
 
+@csrf_exempt
+@require_http_methods(["POST"])
+def signup_to_surveys(request):
+    """
+    Signs up for several surveys at once, with one public key per survey ID.
+    Returns the client IDs by survey ID, leaving out unknown surveys.
+    """
+    try:
+        public_keys = json.loads(request.body)["public_keys"]
+    except (KeyError, TypeError, ValueError):
+        return HttpResponseBadRequest("Invalid JSON")
+
+    if (
+        not isinstance(public_keys, dict)
+        or len(public_keys) > MAX_BATCH_SIZE
+        or not all(isinstance(key, str) for key in public_keys.values())
+    ):
+        return HttpResponseBadRequest("Invalid JSON")
+
+    try:
+        surveys = Survey.objects.in_bulk(list(public_keys.keys()))
+    except ValidationError:
+        return HttpResponseBadRequest("Invalid survey ID")
+
+    client_ids = {}
+    for survey_id, public_key in public_keys.items():
+        survey = surveys.get(uuid.UUID(survey_id))
+        if survey is None:
+            continue
+        # TODO: Do we need to check whether it's a correct public key?
+        survey_signup = SurveySignup.objects.create(
+            survey=survey, public_key=public_key
+        )
+        client_ids[survey_id] = str(survey_signup.id)
+
+    # Once per survey instead of after every signup.
+    for survey in surveys.values():
+        group_signups(survey)
+
+    return JsonResponse({"client_ids": client_ids}, status=201)
+
+
+def signup_state(survey_signup):
+    aggregation_group = survey_signup.group
+
+    if not aggregation_group or not aggregation_group.delegate:
+        return {"delegate_public_key": "", "aggregation_started": False}
+
+    delegate: SurveySignup = aggregation_group.delegate
+
+    return {
+        "delegate_public_key": str(delegate.public_key),
+        "aggregation_started": True,
+        "group_size": survey_signup.survey.group_size,
+        "aggregation_public_key_n": str(
+            aggregation_group.aggregation_public_key_n
+        ),
+    }
+
+
 @csrf_exempt
 @require_http_methods(["GET"])
 def get_signup_state(request, client_id):
-    try:
-        survey_signup = get_object_or_404(SurveySignup, id=client_id)
-        aggregation_group = survey_signup.group
+    survey_signup = get_object_or_404(SurveySignup, id=client_id)
+    return JsonResponse(signup_state(survey_signup), status=200)
+
 
-        if not aggregation_group or not aggregation_group.delegate:
-            response_data = {
-                "delegate_public_key": "",
-                "aggregation_started": False,
-            }
-            return JsonResponse(response_data, status=200)
+@csrf_exempt
+@require_http_methods(["POST"])
+def get_signup_states(request):
+    """
+    Returns the signup states of several signups at once by client ID,
+    leaving out unknown ones.
+    """
+    try:
+        client_ids = json.loads(request.body)["client_ids"]
+    except (KeyError, TypeError, ValueError):
+        return HttpResponseBadRequest("Invalid JSON")
 
-        delegate: SurveySignup = aggregation_group.delegate
+    if (
+        not isinstance(client_ids, list)
+        or len(client_ids) > MAX_BATCH_SIZE
+        or not all(isinstance(client_id, str) for client_id in client_ids)
+    ):
+        return HttpResponseBadRequest("Invalid JSON")
 
-        response_data = {
-            "delegate_public_key": str(delegate.public_key),
-            "aggregation_started": True,
-            "group_size": survey_signup.survey.group_size,
-            "aggregation_public_key_n": str(
-                aggregation_group.aggregation_public_key_n
-            ),
-        }
+    try:
+        signups = SurveySignup.objects.select_related(
+            "group__delegate", "survey"
+        ).in_bulk(client_ids)
+    except ValidationError:
+        return HttpResponseBadRequest("Invalid client ID")
 
-        return JsonResponse(response_data, status=200)
-    except json.JSONDecodeError:
-        return HttpResponse("Invalid JSON", status=400)
+    states = {}
+    for client_id in client_ids:
+        signup = signups.get(uuid.UUID(client_id))
+        if signup is not None:
+            states[client_id] = signup_state(signup)
+    return JsonResponse({"states": states}, status=200)
 
 
 @csrf_exempt
@@ -122,7 +219,7 @@ def message_to_delegate(request):
     except json.JSONDecodeError:
         return HttpResponseBadRequest("Invalid JSON")
 
-    ClientToDelegateMessage.objects.create(
+    ClientToDelegateMessage.append(
         delegate_id=delegate.id, group=aggregation_group, content=message
     )
 
@@ -132,13 +229,27 @@ def message_to_delegate(request):
 @csrf_exempt
 @require_http_methods(["GET"])
 def get_messages_for_delegate(request, delegate_id):
-    messages = ClientToDelegateMessage.objects.filter(delegate_id=delegate_id)
+    # Only the messages after the cursor returned with the previous ones.
+    try:
+        since = int(request.GET.get("since", 0))
+    except ValueError:
+        return HttpResponseBadRequest("Invalid cursor")
+
+    messages = list(
+        ClientToDelegateMessage.objects.filter(
+            delegate_id=delegate_id, sequence__gt=since
+        ).order_by("sequence")
+    )
 
     if len(messages) == 0:
-        return JsonResponse({"messages": []}, status=204)
+        return JsonResponse({"messages": [], "cursor": since}, status=204)
 
     return JsonResponse(
-        {"messages": [message.content for message in messages]}, status=200
+        {
+            "messages": [message.content for message in messages],
+            "cursor": messages[-1].sequence,
+        },
+        status=200,
     )
 
 
@@ -184,3 +295,82 @@ def post_aggregation_result(request, delegate_id):
             return JsonResponse(serializer.errors, status=400)
     except json.JSONDecodeError:
         return HttpResponse("Invalid JSON", status=400)
+
+
+def signup_event_tokens(client_ids) -> dict:
+    """
+    Returns tokens by client ID that change whenever the signup has something
+    new to act on: its aggregation started, or, for delegates, messages
+    arrived. Takes one query for all of them.
+    """
+    # Normalized, since clients may write UUIDs differently.
+    keys = {}
+    for client_id in client_ids:
+        try:
+            keys[client_id] = str(uuid.UUID(str(client_id)))
+        except ValueError:
+            pass
+
+    message_counts = (
+        ClientToDelegateMessage.objects.filter(delegate_id=OuterRef("id"))
+        .values("delegate_id")
+        .annotate(count=Count("id"))
+        .values("count")
+    )
+    signups = (
+        SurveySignup.objects.filter(id__in=keys.values())
+        .select_related("group")
+        .annotate(message_count=Coalesce(Subquery(message_counts), 0))
+    )
+    tokens_by_id = {}
+    for signup in signups:
+        group = signup.group
+        if not group or not group.delegate_id:
+            token = "waiting"
+        elif group.delegate_id != signup.id:
+            token = "started"
+        else:
+            token = f"messages:{signup.message_count}"
+        tokens_by_id[str(signup.id)] = token
+
+    return {
+        client_id: tokens_by_id.get(keys.get(client_id), "unknown")
+        for client_id in client_ids
+    }
+
+
+@csrf_exempt
+@require_http_methods(["POST"])
+def wait_for_signup_events(request):
+    """
+    Long polls for changes of the tokens of the supplied signups, returning
+    the changed ones as soon as there are any, or none after the timeout.
+    """
+    try:
+        data = json.loads(request.body)
+        known_tokens = data["client_ids"]
+        timeout = float(data.get("timeout", SIGNUP_EVENTS_TIMEOUT))
+    except (KeyError, TypeError, ValueError):
+        return HttpResponseBadRequest("Invalid JSON")
+
+    # NaN would never reach the deadline
+    if not math.isfinite(timeout):
+        return HttpResponseBadRequest("Invalid timeout")
+    timeout = min(max(timeout, 0), SIGNUP_EVENTS_TIMEOUT)
+
+    if not isinstance(known_tokens, dict):
+        return HttpResponseBadRequest("Invalid JSON")
+    # Every check costs a query, for as long as the poll holds a worker.
+    if len(known_tokens) > MAX_BATCH_SIZE:
+        return HttpResponseBadRequest("Too many client IDs")
+
+    deadline = time.monotonic() + timeout
+    while True:
+        events = {}
+        tokens = signup_event_tokens(list(known_tokens.keys()))
+        for client_id, known_token in known_tokens.items():
+            if tokens[client_id] != known_token:
+                events[client_id] = tokens[client_id]
+        if events or time.monotonic() >= deadline:
+            return JsonResponse({"events": events}, status=200)
+        time.sleep(SIGNUP_EVENTS_CHECK_INTERVAL)
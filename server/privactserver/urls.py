@@ -18,11 +18,14 @@ Including another URLconf
 from core.views import (
     get_messages_for_delegate,
     get_signup_state,
+    get_signup_states,
     get_surveys,
     message_to_delegate,
     post_aggregation_result,
     save_survey_response,
     signup_to_survey,
+    signup_to_surveys,
+    wait_for_signup_events,
 )
 from django.contrib import admin
 from django.urls import path
@@ -32,11 +35,13 @@ urlpatterns = [
     path("api/survey-response/", save_survey_response, name="survey-response"),
     path("api/surveys/", get_surveys, name="get-surveys"),
     path("api/survey-signup/", signup_to_survey, name="survey-signup"),
+    path("api/survey-signups/", signup_to_surveys, name="survey-signups"),
     path(
         "api/signup-state/<uuid:client_id>/",
         get_signup_state,
         name="get-signup-state",
     ),
+    path("api/signup-states/", get_signup_states, name="get-signup-states"),
     path(
         "api/message-to-delegate/",
         message_to_delegate,
@@ -52,4 +57,5 @@ urlpatterns = [
         post_aggregation_result,
         name="post-aggregation-result",
     ),
+    path("api/signup-events/", wait_for_signup_events, name="signup-events"),
 ]